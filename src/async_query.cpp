@@ -0,0 +1,321 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    async_query.cpp
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <algorithm>
+#include <memory>
+
+#include "sybase.h"
+#include "async_query.h"
+#include "connection.h"
+#include "parallel.h"
+
+// maximum number of idle connections kept for each datasource string
+static const size_t ASYNC_MAX_IDLE = 4;
+// maximum number of worker threads executing queries
+static const int ASYNC_MAX_WORKERS = 8;
+
+namespace ss {
+
+AsyncQueryManager async_queries;
+
+class AsyncQuery {
+public:
+    std::string dsstr;
+    QoreStringNode* sql;
+    QoreListNode* args;
+    // return a list of row hashes instead of a hash of column lists
+    bool rows;
+
+    // the following members are protected by the manager's lock
+    bool done = false;
+    bool canceled = false;
+    // the id of the connection while the query is executing
+    int64 conn_id = 0;
+    QoreValue result;
+    ExceptionSink err;
+
+    DLLLOCAL AsyncQuery(const QoreStringNode* dsstr, const QoreStringNode* sql, const QoreListNode* args, bool rows)
+            : dsstr(dsstr->c_str()), sql(sql->stringRefSelf()), args(args ? args->listRefSelf() : nullptr),
+            rows(rows) {
+    }
+
+    DLLLOCAL ~AsyncQuery() {
+        ExceptionSink xsink;
+        sql->deref();
+        if (args)
+            args->deref(&xsink);
+        result.discard(&xsink);
+        err.clear();
+    }
+};
+
+int64 AsyncQueryManager::start(const QoreStringNode* dsstr, const QoreStringNode* sql, const QoreListNode* args,
+        const QoreHashNode* opts, ExceptionSink* xsink) {
+    bool rows = opts && opts->getKeyValue("rows").getAsBool();
+    AsyncQuery* q = new AsyncQuery(dsstr, sql, args, rows);
+
+    int64 id;
+    {
+        AutoLocker al(lck);
+        id = ++next_id;
+        queries[id] = q;
+        pending.push_back(q);
+        // a new worker is only started if the running workers cannot take the query
+        if (running >= ASYNC_MAX_WORKERS || (int)pending.size() <= running - busy)
+            return id;
+        ++running;
+    }
+
+    if (q_start_thread(xsink, worker, this) < 0) {
+        AutoLocker al(lck);
+        --running;
+        // other queries may have been queued in the meantime, so the query is not necessarily the last entry
+        std::deque<AsyncQuery*>::iterator i = std::find(pending.begin(), pending.end(), q);
+        // the query has already been taken or will be executed by a running worker
+        if (running || i == pending.end()) {
+            xsink->clear();
+            return id;
+        }
+        pending.erase(i);
+        queries.erase(id);
+        delete q;
+        return 0;
+    }
+    return id;
+}
+
+AsyncQuery* AsyncQueryManager::find(int64 id, ExceptionSink* xsink) {
+    query_map_t::iterator i = queries.find(id);
+    if (i == queries.end()) {
+        xsink->raiseException("TDS-ASYNC-ERROR", "asynchronous query handle " QLLD " is unknown or has already "
+            "been waited for", id);
+        return nullptr;
+    }
+    return i->second;
+}
+
+bool AsyncQueryManager::poll(int64 id, ExceptionSink* xsink) {
+    AutoLocker al(lck);
+    AsyncQuery* q = find(id, xsink);
+    return q ? q->done : false;
+}
+
+QoreValue AsyncQueryManager::wait(int64 id, int64 timeout_ms, ExceptionSink* xsink) {
+    AsyncQuery* q;
+    {
+        AutoLocker al(lck);
+        q = find(id, xsink);
+        if (!q)
+            return QoreValue();
+
+        int64 deadline = timeout_ms > 0 ? q_clock_getmillis() + timeout_ms : 0;
+        while (!q->done) {
+            if (!deadline) {
+                cond.wait(&lck);
+                continue;
+            }
+            int64 remaining = deadline - q_clock_getmillis();
+            if (remaining <= 0 || (cond.wait(&lck, (int)remaining) && !q->done)) {
+                xsink->raiseException("TDS-ASYNC-TIMEOUT", "timeout waiting " QLLD " ms for asynchronous query "
+                    "handle " QLLD, timeout_ms, id);
+                return QoreValue();
+            }
+        }
+        queries.erase(id);
+    }
+
+    std::unique_ptr<AsyncQuery> holder(q);
+    if (q->err) {
+        xsink->assimilate(q->err);
+        return QoreValue();
+    }
+    QoreValue rv = q->result;
+    q->result = QoreValue();
+    return rv;
+}
+
+int64 AsyncQueryManager::waitAny(const QoreListNode* ids, int64 timeout_ms, ExceptionSink* xsink) {
+    AutoLocker al(lck);
+    std::vector<AsyncQuery*> ql;
+    std::vector<int64> idl;
+    ConstListIterator li(ids);
+    while (li.next()) {
+        int64 id = li.getValue().getAsBigInt();
+        AsyncQuery* q = find(id, xsink);
+        if (!q)
+            return 0;
+        ql.push_back(q);
+        idl.push_back(id);
+    }
+
+    int64 deadline = timeout_ms > 0 ? q_clock_getmillis() + timeout_ms : 0;
+    while (true) {
+        for (size_t i = 0; i < ql.size(); ++i) {
+            if (ql[i]->done)
+                return idl[i];
+        }
+        if (ql.empty())
+            return 0;
+        if (!deadline) {
+            cond.wait(&lck);
+            continue;
+        }
+        int64 remaining = deadline - q_clock_getmillis();
+        if (remaining <= 0)
+            return 0;
+        cond.wait(&lck, (int)remaining);
+    }
+}
+
+bool AsyncQueryManager::cancel(int64 id) {
+    AutoLocker al(lck);
+    query_map_t::iterator i = queries.find(id);
+    if (i == queries.end() || i->second->done)
+        return false;
+    AsyncQuery* q = i->second;
+    q->canceled = true;
+    // the connection id is only set while the query is executing on the connection
+    if (q->conn_id)
+        connection_registry.cancel(q->conn_id);
+    return true;
+}
+
+void AsyncQueryManager::shutdown() {
+    AutoLocker al(lck);
+    for (auto& i : queries) {
+        i.second->canceled = true;
+        if (i.second->conn_id)
+            connection_registry.cancel(i.second->conn_id);
+    }
+    while (running)
+        cond.wait(&lck);
+    for (auto& i : queries)
+        delete i.second;
+    queries.clear();
+    for (auto& i : idle) {
+        for (auto* ds : i.second)
+            close_datasource(ds);
+    }
+    idle.clear();
+}
+
+Datasource* AsyncQueryManager::getDatasource(const std::string& dsstr, ExceptionSink* xsink) {
+    {
+        AutoLocker al(lck);
+        ds_map_t::iterator i = idle.find(dsstr);
+        if (i != idle.end() && !i->second.empty()) {
+            Datasource* ds = i->second.back();
+            i->second.pop_back();
+            return ds;
+        }
+    }
+    return open_datasource(dsstr.c_str(), xsink);
+}
+
+void AsyncQueryManager::releaseDatasource(const std::string& dsstr, Datasource* ds, bool ok) {
+    if (ok) {
+        AutoLocker al(lck);
+        std::vector<Datasource*>& dl = idle[dsstr];
+        if (dl.size() < ASYNC_MAX_IDLE) {
+            dl.push_back(ds);
+            return;
+        }
+    }
+    close_datasource(ds);
+}
+
+void AsyncQueryManager::worker(ExceptionSink* xsink, void* arg) {
+    AsyncQueryManager* mgr = reinterpret_cast<AsyncQueryManager*>(arg);
+    while (true) {
+        AsyncQuery* q;
+        {
+            AutoLocker al(mgr->lck);
+            if (mgr->pending.empty()) {
+                --mgr->running;
+                mgr->cond.broadcast();
+                return;
+            }
+            q = mgr->pending.front();
+            mgr->pending.pop_front();
+            ++mgr->busy;
+        }
+        mgr->run(q);
+    }
+}
+
+void AsyncQueryManager::run(AsyncQuery* q) {
+    ExceptionSink xsink;
+    ValueHolder rv(&xsink);
+
+    bool canceled;
+    {
+        AutoLocker al(lck);
+        canceled = q->canceled;
+    }
+
+    Datasource* ds = canceled ? nullptr : getDatasource(q->dsstr, &xsink);
+    if (canceled) {
+        xsink.raiseException("TDS-ASYNC-CANCELED", "the asynchronous query was canceled before it was executed");
+    } else if (ds) {
+        connection* conn = (connection*)ds->getPrivateData();
+        {
+            AutoLocker al(lck);
+            canceled = q->canceled;
+            if (!canceled)
+                q->conn_id = conn->getId();
+        }
+
+        if (canceled) {
+            xsink.raiseException("TDS-ASYNC-CANCELED", "the asynchronous query was canceled before it was executed");
+        } else {
+            try {
+                rv = q->rows ? conn->exec_rows(q->sql, q->args, &xsink) : conn->select(q->sql, q->args, &xsink);
+                // end the chained transaction started by the query
+                if (!xsink)
+                    conn->commit(&xsink);
+            } catch (const ss::Error& e) {
+                e.raise(&xsink);
+            }
+
+            AutoLocker al(lck);
+            q->conn_id = 0;
+        }
+        releaseDatasource(q->dsstr, ds, !xsink);
+    }
+
+    AutoLocker al(lck);
+    if (xsink)
+        q->err.assimilate(xsink);
+    else
+        q->result = rv.release();
+    q->done = true;
+    --busy;
+    cond.broadcast();
+}
+
+} // namespace ss
+
+// EOF
@@ -0,0 +1,105 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    async_query.h
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SYBASE_ASYNC_QUERY_H_
+#define SYBASE_ASYNC_QUERY_H_
+
+#include "qore/Qore.h"
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ss {
+
+class AsyncQuery;
+
+// runs queries in the background on private connections; each query is identified by a handle that can be polled
+// or waited for from any thread
+// queries are executed by a pool of at most ASYNC_MAX_WORKERS threads; further queries wait in a queue until a
+// worker is free
+class AsyncQueryManager {
+public:
+    // queues a query for a connection for the given datasource string and returns its handle
+    // returns 0 on error (exception raised)
+    DLLLOCAL int64 start(const QoreStringNode* dsstr, const QoreStringNode* sql, const QoreListNode* args,
+            const QoreHashNode* opts, ExceptionSink* xsink);
+
+    // returns true if the query has completed
+    DLLLOCAL bool poll(int64 id, ExceptionSink* xsink);
+
+    // waits for the query to complete and returns its result; the handle is released unless the wait times out
+    // a timeout <= 0 means to wait indefinitely
+    DLLLOCAL QoreValue wait(int64 id, int64 timeout_ms, ExceptionSink* xsink);
+
+    // waits for any of the given queries to complete and returns its handle or 0 if the wait timed out
+    DLLLOCAL int64 waitAny(const QoreListNode* ids, int64 timeout_ms, ExceptionSink* xsink);
+
+    // sends a cancel request for the query; returns true if the query was still running
+    DLLLOCAL bool cancel(int64 id);
+
+    // cancels all running queries, waits for them to complete, and closes all idle connections; called when the
+    // module is deleted
+    DLLLOCAL void shutdown();
+
+private:
+    typedef std::map<int64, AsyncQuery*> query_map_t;
+    typedef std::map<std::string, std::vector<Datasource*>> ds_map_t;
+
+    QoreThreadLock lck;
+    QoreCondition cond;
+    query_map_t queries;
+    // queries waiting for a worker thread
+    std::deque<AsyncQuery*> pending;
+    // open connections available for new queries by datasource string
+    ds_map_t idle;
+    int64 next_id = 0;
+    // number of worker threads running
+    int running = 0;
+    // number of worker threads executing a query
+    int busy = 0;
+
+    // returns the query for the handle; raises an exception if the handle is unknown
+    DLLLOCAL AsyncQuery* find(int64 id, ExceptionSink* xsink);
+
+    // returns an idle connection or opens a new one
+    DLLLOCAL Datasource* getDatasource(const std::string& dsstr, ExceptionSink* xsink);
+    // keeps the connection for reuse if "ok" is true, otherwise it's closed
+    DLLLOCAL void releaseDatasource(const std::string& dsstr, Datasource* ds, bool ok);
+
+    // executes queued queries until the queue is empty
+    DLLLOCAL static void worker(ExceptionSink* xsink, void* arg);
+    DLLLOCAL void run(AsyncQuery* q);
+};
+
+DLLLOCAL extern AsyncQueryManager async_queries;
+
+} // namespace ss
+
+#endif
+
+// EOF
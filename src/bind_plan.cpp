@@ -0,0 +1,208 @@
+/* -*- indent-tabs-mode: nil -*- */
+/*
+    bind_plan.cpp
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <string.h>
+#include <stdio.h>
+
+#include "sybase.h"
+#include "bind_plan.h"
+
+// maximum number of plans cached for commands executed directly on a connection
+static const size_t BIND_PLAN_CACHE_SIZE = 16;
+// maximum size used for output placeholders bound with the type of the procedure parameter; larger parameters like
+// varchar(max) are bound with this size
+static const int OUTPUT_TYPE_MAX_SIZE = 8000;
+
+namespace ss {
+
+static qore_type_t get_arg_type(const QoreListNode* args, int i) {
+    if (!args || i < 0 || (size_t)i >= args->size())
+        return NT_NOTHING;
+    return args->retrieveEntry(i).getType();
+}
+
+// returns the explicit bind type of a {type: ..., value: ...} hash argument or nullptr if there is none
+static const char* get_arg_hint_type(const QoreListNode* args, int i) {
+    if (!args || i < 0 || (size_t)i >= args->size())
+        return nullptr;
+    const QoreHashNode* h = args->retrieveEntry(i).get<const QoreHashNode>();
+    QoreValue t = h->getKeyValue("type");
+    return t.getType() == NT_STRING ? t.get<const QoreStringNode>()->c_str() : nullptr;
+}
+
+bool BindPlan::matches(const sybase_query& query, const QoreListNode* args) const {
+    size_t nargs = args ? args->size() : 0;
+    if (nargs != sig.size() || rpc != query.rpc || cmd.size() != query.m_cmd.size()
+        || memcmp(cmd.data(), query.buff(), cmd.size()))
+        return false;
+
+    for (size_t i = 0; i < nargs; ++i) {
+        if (args->retrieveEntry(i).getType() != sig[i])
+            return false;
+    }
+
+    // the explicit bind types must be the same as when the plan was built
+    if (hinted) {
+        for (const BindEntry& e : plan) {
+            if (e.hint_type.empty() || !e.hint_arg)
+                continue;
+            const char* tname = get_arg_hint_type(args, e.arg);
+            if (!tname || e.hint_type != tname)
+                return false;
+        }
+    }
+    return true;
+}
+
+void BindPlan::setBind(BindEntry& e, const QoreListNode* args) {
+    qore_type_t t = get_arg_type(args, e.arg);
+    // output placeholders without a value are bound as null strings that the server will convert
+    e.bind = (e.output && (t == NT_NOTHING || t == NT_NULL))
+        ? &command::bind_output_null
+        : command::get_bind_func(t);
+    if (t != NT_HASH)
+        return;
+
+    // hashes with an unknown bind type are left to bind_hash(), which raises the error
+    const char* tname = get_arg_hint_type(args, e.arg);
+    if (tname && !command::parse_bind_hint(tname, e.hint, e.hint_arg1, e.hint_arg2)) {
+        e.hint_type = tname;
+        e.hint_arg = true;
+        hinted = true;
+    }
+}
+
+void BindPlan::setOutputType(BindEntry& e, const rpc_param& param) {
+    // types that are not supported as explicit bind types are bound as strings by bind_output_null()
+    if (param.type.empty() || command::parse_bind_hint(param.type.c_str(), e.hint, e.hint_arg1, e.hint_arg2))
+        return;
+#ifndef CS_BIGINT_TYPE
+    if (e.hint == command::BH_BIGINT)
+        return;
+#endif
+
+    e.hint_type = param.type;
+    e.hint_arg = false;
+    if (e.hint == command::BH_NUMERIC) {
+        e.hint_arg1 = param.type_arg1;
+        e.hint_arg2 = param.type_arg2;
+    } else {
+        e.hint_arg1 = param.type_arg1 > 0 && param.type_arg1 < OUTPUT_TYPE_MAX_SIZE
+            ? param.type_arg1
+            : OUTPUT_TYPE_MAX_SIZE;
+    }
+}
+
+void BindPlan::build(const sybase_query& query, const QoreListNode* args) {
+    cmd = query.buff();
+    rpc = query.rpc;
+    sig.clear();
+    plan.clear();
+    hinted = false;
+
+    size_t nargs = args ? args->size() : 0;
+    sig.reserve(nargs);
+    for (size_t i = 0; i < nargs; ++i) {
+        sig.push_back(args->retrieveEntry(i).getType());
+    }
+
+    if (query.rpc) {
+        plan.reserve(query.rpc_params.size());
+        for (unsigned i = 0, n = query.rpc_params.size(); i < n; ++i) {
+            const rpc_param& param = query.rpc_params[i];
+
+            BindEntry e;
+            memset(&e.datafmt, 0, sizeof(e.datafmt));
+            e.datafmt.status = param.output ? CS_RETURN : CS_INPUTVALUE;
+            if (param.name.empty()) {
+                // positional parameter
+                e.datafmt.namelen = 0;
+            } else {
+                e.datafmt.namelen = CS_NULLTERM;
+                snprintf(e.datafmt.name, sizeof(e.datafmt.name), "%s", param.name.c_str());
+            }
+            e.datafmt.maxlength = CS_UNUSED;
+            e.datafmt.count = 1;
+            e.arg = param.arg;
+            e.pos = i;
+            e.output = param.output;
+            e.hint_arg = false;
+            setBind(e, args);
+            if (e.bind == &command::bind_output_null)
+                setOutputType(e, param);
+            plan.push_back(e);
+        }
+        return;
+    }
+
+    unsigned nparams = query.param_list.size();
+    plan.reserve(nparams);
+    for (unsigned i = 0; i < nparams; ++i) {
+        if (query.param_list[i] == 'd')
+            continue;
+
+        BindEntry e;
+        memset(&e.datafmt, 0, sizeof(e.datafmt));
+        e.datafmt.status = CS_INPUTVALUE;
+        e.datafmt.namelen = CS_NULLTERM;
+        sprintf(e.datafmt.name, "@par%d", int(i + 1));
+        e.datafmt.maxlength = CS_UNUSED;
+        e.datafmt.count = 1;
+        e.arg = i;
+        e.pos = i;
+        e.output = false;
+        e.hint_arg = false;
+        setBind(e, args);
+        plan.push_back(e);
+    }
+}
+
+BindPlan& BindPlanCache::get(const sybase_query& query) {
+    size_t len = query.m_cmd.size();
+    cached_plan* lru = nullptr;
+    for (auto& i : plans) {
+        if (i.cmd.size() == len && !memcmp(i.cmd.data(), query.buff(), len)) {
+            i.last_used = ++use_count;
+            return *i.plan;
+        }
+        if (!lru || i.last_used < lru->last_used)
+            lru = &i;
+    }
+
+    // the least recently used plan is replaced if the cache is full
+    if (plans.size() < BIND_PLAN_CACHE_SIZE) {
+        plans.push_back(cached_plan());
+        lru = &plans.back();
+        lru->plan.reset(new BindPlan);
+    } else {
+        lru->plan->clear();
+    }
+    lru->cmd.assign(query.buff(), len);
+    lru->last_used = ++use_count;
+    return *lru->plan;
+}
+
+} // namespace ss
@@ -0,0 +1,138 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    bind_plan.h
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SYBASE_BIND_PLAN_H_
+#define SYBASE_BIND_PLAN_H_
+
+#include <ctpublic.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "command.h"
+
+namespace ss {
+
+// a single precomputed parameter binding
+struct BindEntry {
+    // the format template with the name, status and count already set
+    CS_DATAFMT datafmt;
+    // the index of the argument or -1 for RPC output placeholders without a value
+    int arg;
+    // the position of the parameter in the command for error messages
+    unsigned pos;
+    bool output;
+    // the function that binds values of the argument's type
+    command::bind_func_t bind;
+    // the explicit bind type of a {type: ..., value: ...} hash argument or the type of the procedure parameter for
+    // RPC output placeholders without a value as parsed when the plan was built; empty if there is no valid type
+    std::string hint_type;
+    command::bind_hint_t hint;
+    int hint_arg1;
+    int hint_arg2;
+    // true if the type was given in the argument, false if it was taken from the procedure's metadata
+    bool hint_arg;
+};
+
+typedef std::vector<BindEntry> bind_entry_list_t;
+
+// parameter binder plan for a command; the plan is built on first use and reused as long as the command text and
+// the types of the arguments stay the same
+// the plan only describes the format of each parameter; the values are bound in buffers owned by the command, which
+// are released after the command has been sent, so cached plans do not keep bound values alive
+class BindPlan {
+public:
+    DLLLOCAL BindPlan() {}
+
+    // returns true if the plan can be used to bind the given arguments for the given query
+    DLLLOCAL bool matches(const sybase_query& query, const QoreListNode* args) const;
+
+    // (re)builds the plan for the given query and arguments
+    DLLLOCAL void build(const sybase_query& query, const QoreListNode* args);
+
+    DLLLOCAL const bind_entry_list_t& entries() const {
+        return plan;
+    }
+
+    DLLLOCAL void clear() {
+        cmd.clear();
+        rpc = false;
+        sig.clear();
+        plan.clear();
+        hinted = false;
+    }
+
+private:
+    // the command text the plan was built for
+    std::string cmd;
+    // true if the plan was built for an RPC command
+    bool rpc = false;
+    // the argument type signature the plan was built for
+    std::vector<qore_type_t> sig;
+    bind_entry_list_t plan;
+    // true if any entry has an explicit bind type
+    bool hinted = false;
+
+    DLLLOCAL BindPlan(const BindPlan&) = delete;
+    DLLLOCAL BindPlan& operator=(const BindPlan&) = delete;
+
+    // sets the bind function for the entry's argument and parses any explicit bind type
+    DLLLOCAL void setBind(BindEntry& e, const QoreListNode* args);
+
+    // sets the type of an RPC output placeholder without a value from the procedure parameter's type
+    DLLLOCAL void setOutputType(BindEntry& e, const rpc_param& param);
+};
+
+// the binder plans for commands executed directly on a connection keyed by the command text, so that the plans of
+// statements that are executed alternately are all reused; the least recently used plan is discarded when the cache
+// is full
+class BindPlanCache {
+public:
+    DLLLOCAL BindPlanCache() {}
+
+    // returns the plan for the query's command text
+    DLLLOCAL BindPlan& get(const sybase_query& query);
+
+private:
+    struct cached_plan {
+        std::string cmd;
+        std::unique_ptr<BindPlan> plan;
+        int64 last_used;
+    };
+
+    std::vector<cached_plan> plans;
+    int64 use_count = 0;
+
+    DLLLOCAL BindPlanCache(const BindPlanCache&) = delete;
+    DLLLOCAL BindPlanCache& operator=(const BindPlanCache&) = delete;
+};
+
+} // namespace ss
+
+#endif
+
+// EOF
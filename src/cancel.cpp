@@ -0,0 +1,155 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    cancel.cpp
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "sybase.h"
+#include "cancel.h"
+#include "connection.h"
+
+namespace ss {
+
+CancelStats cancel_stats;
+ConnectionRegistry connection_registry;
+CommandWatchdog command_watchdog;
+
+QoreHashNode* CancelStats::getHash() const {
+    ReferenceHolder<QoreHashNode> h(new QoreHashNode(bigIntTypeInfo), nullptr);
+    h->setKeyValue("drained", drained.load(), nullptr);
+    h->setKeyValue("canceled", canceled.load(), nullptr);
+    h->setKeyValue("skipped", skipped.load(), nullptr);
+    return h.release();
+}
+
+int64 ConnectionRegistry::add(connection* conn) {
+    AutoLocker al(lck);
+    int64 id = ++next_id;
+    conns[id] = conn;
+    return id;
+}
+
+void ConnectionRegistry::remove(int64 id) {
+    AutoLocker al(lck);
+    conns.erase(id);
+}
+
+bool ConnectionRegistry::cancel(int64 id) {
+    // the lock is held while canceling so that the connection cannot be deleted in the meantime
+    AutoLocker al(lck);
+    conn_map_t::iterator i = conns.find(id);
+    if (i == conns.end())
+        return false;
+    return !i->second->cancel();
+}
+
+QoreListNode* ConnectionRegistry::getMessages(int64 id) {
+    AutoLocker al(lck);
+    conn_map_t::iterator i = conns.find(id);
+    if (i == conns.end())
+        return nullptr;
+    return i->second->getMessages();
+}
+
+int64 CommandWatchdog::add(connection* conn, int64 timeout_ms, ExceptionSink* xsink) {
+    AutoLocker al(lck);
+    int64 handle = ++next_handle;
+    cmds[handle] = {conn, q_clock_getmillis() + timeout_ms, false};
+
+    if (!running) {
+        running = true;
+        if (q_start_thread(xsink, run, this) < 0) {
+            running = false;
+            cmds.erase(handle);
+            return 0;
+        }
+    } else {
+        // wake up the watchdog in case the new deadline is the earliest
+        cond.signal();
+    }
+    return handle;
+}
+
+bool CommandWatchdog::remove(int64 handle) {
+    AutoLocker al(lck);
+    cmd_map_t::iterator i = cmds.find(handle);
+    assert(i != cmds.end());
+    bool fired = i->second.fired;
+    cmds.erase(i);
+    return fired;
+}
+
+void CommandWatchdog::run(ExceptionSink* xsink, void* arg) {
+    reinterpret_cast<CommandWatchdog*>(arg)->runIntern();
+}
+
+void CommandWatchdog::runIntern() {
+    AutoLocker al(lck);
+    while (true) {
+        // find the earliest pending deadline and cancel all expired commands
+        int64 now = q_clock_getmillis();
+        int64 next = 0;
+        bool pending = false;
+        for (auto& i : cmds) {
+            entry& e = i.second;
+            if (e.fired)
+                continue;
+            if (e.deadline <= now) {
+                printd(5, "CommandWatchdog::runIntern() canceling command on connection %p\n", e.conn);
+                e.fired = true;
+                // the connection cannot be deleted while the command is registered
+                e.conn->cancel();
+                continue;
+            }
+            if (!pending || e.deadline < next) {
+                next = e.deadline;
+                pending = true;
+            }
+        }
+
+        if (!pending) {
+            // exit when there is nothing left to watch; the thread is restarted on demand
+            running = false;
+            return;
+        }
+
+        cond.wait(&lck, (int)(next - now));
+    }
+}
+
+CommandTimer::CommandTimer(connection& conn, int timeout_ms, ExceptionSink* xsink) {
+    if (timeout_ms > 0)
+        handle = command_watchdog.add(&conn, timeout_ms, xsink);
+}
+
+bool CommandTimer::stop() {
+    if (handle) {
+        timed_out = command_watchdog.remove(handle);
+        handle = 0;
+    }
+    return timed_out;
+}
+
+} // namespace ss
+
+// EOF
@@ -0,0 +1,133 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    cancel.h
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SYBASE_CANCEL_H_
+#define SYBASE_CANCEL_H_
+
+#include "qore/Qore.h"
+
+#include <atomic>
+#include <map>
+
+class connection;
+
+namespace ss {
+
+// counts how the results of unfinished commands were discarded
+struct CancelStats {
+    // results read and discarded without a cancel
+    std::atomic<int64> drained{0};
+    // cancels sent to the server
+    std::atomic<int64> canceled{0};
+    // cancels skipped because there were no pending results
+    std::atomic<int64> skipped{0};
+
+    DLLLOCAL QoreHashNode* getHash() const;
+};
+
+DLLLOCAL extern CancelStats cancel_stats;
+
+// process-wide registry of open connections by id so that commands can be canceled from other threads
+class ConnectionRegistry {
+public:
+    // registers the connection and returns its id
+    DLLLOCAL int64 add(connection* conn);
+
+    DLLLOCAL void remove(int64 id);
+
+    // sends an attention to the server for the connection's current command
+    // returns true if the connection was found and the cancel request was sent
+    DLLLOCAL bool cancel(int64 id);
+
+    // returns the most recent messages for the connection or nullptr if the connection was not found
+    DLLLOCAL QoreListNode* getMessages(int64 id);
+
+private:
+    typedef std::map<int64, connection*> conn_map_t;
+
+    QoreThreadLock lck;
+    conn_map_t conns;
+    int64 next_id = 0;
+};
+
+DLLLOCAL extern ConnectionRegistry connection_registry;
+
+// cancels commands that exceed their timeout from a background thread; the thread runs only while there are
+// commands to watch
+class CommandWatchdog {
+public:
+    // starts watching a command on the given connection; returns a handle for remove()
+    // returns 0 on error (exception raised)
+    DLLLOCAL int64 add(connection* conn, int64 timeout_ms, ExceptionSink* xsink);
+
+    // stops watching the command; the connection is not canceled for this handle after this call returns
+    // returns true if the command was canceled because it timed out
+    DLLLOCAL bool remove(int64 handle);
+
+private:
+    struct entry {
+        connection* conn;
+        // deadline in milliseconds
+        int64 deadline;
+        bool fired;
+    };
+    typedef std::map<int64, entry> cmd_map_t;
+
+    QoreThreadLock lck;
+    QoreCondition cond;
+    cmd_map_t cmds;
+    int64 next_handle = 0;
+    bool running = false;
+
+    DLLLOCAL static void run(ExceptionSink* xsink, void* arg);
+    DLLLOCAL void runIntern();
+};
+
+DLLLOCAL extern CommandWatchdog command_watchdog;
+
+// watches a command for the lifetime of the object
+class CommandTimer {
+public:
+    // a timeout of 0 disables the timer
+    DLLLOCAL CommandTimer(connection& conn, int timeout_ms, ExceptionSink* xsink);
+
+    DLLLOCAL ~CommandTimer() {
+        stop();
+    }
+
+    // stops the timer; returns true if the command was canceled because it timed out
+    DLLLOCAL bool stop();
+
+private:
+    int64 handle = 0;
+    bool timed_out = false;
+};
+
+} // namespace ss
+
+#endif
+
+// EOF
@@ -37,9 +37,16 @@
 #include "connection.h"
 #include "utils.h"
 #include "resultfactory.h"
+#include "bind_plan.h"
 
 #include "minitest.hpp"
 
+// minimum buffer size for string output parameters of RPC commands
+static const CS_INT RPC_OUTPUT_MAXLENGTH = 255;
+
+// maximum precision of number values bound as NUMERIC; numbers with more digits are bound as strings
+static const int NUMERIC_MAX_PRECISION = 38;
+
 static std::string get_placeholder_at(const Placeholders *ph, size_t i) {
    if (!ph || ph->size() <= i) return ss::string_cast(i);
    if (ph->at(i).empty()) return ss::string_cast(i);
@@ -47,11 +54,30 @@ static std::string get_placeholder_at(const Placeholders *ph, size_t i) {
 }
 
 command::command(connection& conn, ExceptionSink* xsink) : m_conn(conn), m_cmd(0), rowcount(-1), lastRes(RES_NONE) {
-   CS_RETCODE err = ct_cmd_alloc(m_conn.getConnection(), &m_cmd);
+   reinit(xsink);
+}
+
+int command::reinit(ExceptionSink* xsink) {
+   assert(!m_cmd);
+   rowcount = -1;
+   lastRes = RES_NONE;
+   results_read = false;
+   commit_appended = false;
+   cursor_name.clear();
+   colinfo.reset();
+
+   // reuses a free command handle from the connection if possible
+   CS_RETCODE err = m_conn.allocCommand(m_cmd);
    if (err != CS_SUCCEED) {
       xsink->raiseException("TDS-EXEC-EXCEPTION", "Sybase call ct_cmd_alloc() failed with error %d", (int)err);
-      return;
+      return -1;
    }
+   m_parent = m_conn.getConnection();
+   return 0;
+}
+
+void command_recycler::operator()(command* cmd) const {
+   cmd->getConnection().recycleCommand(cmd);
 }
 
 //------------------------------------------------------------------------------
@@ -61,22 +87,93 @@ command::~command() {
 
 void command::clear() {
    if (!m_cmd) return;
-   // cancel only unfinished, not already canceled command
-   if (lastRes != RES_CANCELED && lastRes != RES_END && !m_conn.wasConnectionAborted()) {
-      if (ct_cancel(0, m_cmd, CS_CANCEL_ALL) != CS_SUCCEED) {
-         throw ss::Error("TDS-EXEC-EXCEPTION", "ct_cancel failed");
+   if (lastRes == RES_END) {
+      // all results of the command have been read, so no cancel is necessary
+      if (results_read)
+         ++ss::cancel_stats.skipped;
+   } else if (pending && lastRes != RES_CANCELED && !m_conn.wasConnectionAborted()) {
+      // only unfinished commands that have been sent need to be canceled; the last few results of an exhausted
+      // single statement are read instead, which is cheaper than the round trip for a cancel
+      if (!drain()) {
+         ++ss::cancel_stats.drained;
+      } else {
+         ++ss::cancel_stats.canceled;
+         if (ct_cancel(0, m_cmd, CS_CANCEL_ALL) != CS_SUCCEED) {
+            set_pending(false);
+            ct_cmd_drop(m_cmd);
+            m_cmd = 0;
+            throw ss::Error("TDS-EXEC-EXCEPTION", "ct_cancel failed");
+         }
       }
    }
-   ct_cmd_drop(m_cmd);
+   set_pending(false);
+   // releases the values of a command that failed before it was sent
+   in_buffers.clear();
+   // handles from a previous connection or an aborted connection cannot be reused
+   bool reuse = m_parent == m_conn.getConnection() && !m_conn.wasConnectionAborted();
+   // the handle cannot be reused if the cursor could not be closed
+   if (reuse && isCursor() && close_cursor())
+      reuse = false;
+   if (reuse)
+      m_conn.releaseCommand(m_cmd);
+   else
+      ct_cmd_drop(m_cmd);
    m_cmd = 0;
+   if (query.get())
+      m_conn.recycleQuery(query.release());
+}
+
+void command::set_pending(bool p) {
+   if (pending == p)
+      return;
+   pending = p;
+   m_conn.setCommandPending(p);
+}
+
+int command::drain() {
+   // if no results have been read yet, the server may still be executing the command, and unread rows of the
+   // current result set may not have been sent yet
+   if (!results_read || (lastRes != RES_NONE && lastRes != RES_DONE))
+      return -1;
+   // the server may still be executing the remaining statements of a batch or procedure
+   std::string keyword;
+   if (isCursor() || !query.get() || query->rpc || !sybase_query::isSingleStatement(query->buff(), keyword))
+      return -1;
+
+   // only the end of the statement is left, which the server sends together with the last rows
+   while (true) {
+      CS_INT result_type;
+      CS_RETCODE err = ct_results(m_cmd, &result_type);
+      if (err == CS_END_RESULTS) {
+         lastRes = RES_END;
+         return 0;
+      }
+      if (err != CS_SUCCEED)
+         return -1;
+
+      switch (result_type) {
+         case CS_CMD_DONE:
+         case CS_CMD_SUCCEED:
+            lastRes = RES_DONE;
+            break;
+         default:
+            // further results with data or errors
+            return -1;
+      }
+   }
 }
 
 void command::send(ExceptionSink *xsink) {
    CS_RETCODE err = ct_send(m_cmd);
+   // the parameter values have been sent; bound values are not kept alive by the buffers, which are reused
+   in_buffers.clear();
 
    if (err != CS_SUCCEED) {
       m_conn.do_exception(xsink, "TDS-EXEC-ERROR", "ct_send() failed");
    }
+   set_pending(true);
+   // the command may start a transaction
+   m_conn.setTransactionOpen();
 }
 
 void command::initiate_language_command(const char* cmd_text, ExceptionSink* xsink) {
@@ -87,6 +184,60 @@ void command::initiate_language_command(const char* cmd_text, ExceptionSink* xsi
    }
 }
 
+void command::initiate_rpc_command(const char* proc, ExceptionSink* xsink) {
+   assert(proc && proc[0]);
+   CS_RETCODE err = ct_command(m_cmd, CS_RPC_CMD, (CS_CHAR*)proc, CS_NULLTERM, CS_NO_RECOMPILE);
+   if (err != CS_SUCCEED) {
+      m_conn.do_exception(xsink, "TDS-EXEC-ERROR", "ct_command(CS_RPC_CMD, '%s') failed with error %d", proc, (int)err);
+   }
+}
+
+void command::initiate_cursor_command(const char* cmd_text, ExceptionSink* xsink) {
+   assert(cmd_text && cmd_text[0]);
+   assert(isCursor());
+   CS_RETCODE err = ct_cursor(m_cmd, CS_CURSOR_DECLARE, (CS_CHAR*)cursor_name.c_str(), CS_NULLTERM,
+      (CS_CHAR*)cmd_text, CS_NULLTERM, cursor_updatable ? CS_FOR_UPDATE : CS_READ_ONLY);
+   if (err != CS_SUCCEED) {
+      m_conn.do_exception(xsink, "TDS-EXEC-ERROR", "ct_cursor(CS_CURSOR_DECLARE, '%s') failed with error %d", cmd_text, (int)err);
+      return;
+   }
+   if (cursor_rows > 0) {
+      err = ct_cursor(m_cmd, CS_CURSOR_ROWS, nullptr, CS_UNUSED, nullptr, CS_UNUSED, (CS_INT)cursor_rows);
+      if (err != CS_SUCCEED) {
+         m_conn.do_exception(xsink, "TDS-EXEC-ERROR", "ct_cursor(CS_CURSOR_ROWS, %d) failed with error %d", cursor_rows, (int)err);
+         return;
+      }
+   }
+   // the open is sent in the same batch as the declaration; any parameters are bound for the open
+   err = ct_cursor(m_cmd, CS_CURSOR_OPEN, nullptr, CS_UNUSED, nullptr, CS_UNUSED, CS_UNUSED);
+   if (err != CS_SUCCEED) {
+      m_conn.do_exception(xsink, "TDS-EXEC-ERROR", "ct_cursor(CS_CURSOR_OPEN) failed with error %d", (int)err);
+   }
+}
+
+int command::close_cursor() {
+   assert(isCursor());
+   int rc = 0;
+   if (ct_cursor(m_cmd, CS_CURSOR_CLOSE, nullptr, CS_UNUSED, nullptr, CS_UNUSED, CS_DEALLOC) != CS_SUCCEED
+      || ct_send(m_cmd) != CS_SUCCEED) {
+      rc = -1;
+   } else {
+      // read all results of the close command
+      CS_INT result_type;
+      CS_RETCODE err;
+      while ((err = ct_results(m_cmd, &result_type)) == CS_SUCCEED) {
+         if (result_type == CS_CMD_FAIL)
+            rc = -1;
+      }
+      if (err != CS_END_RESULTS)
+         rc = -1;
+   }
+   if (rc)
+      m_conn.discard_messages();
+   cursor_name.clear();
+   return rc;
+}
+
 bool command::fetch_row_into_buffers(ExceptionSink* xsink) {
    CS_INT rows_read;
    CS_RETCODE err = ct_fetch(m_cmd, CS_UNUSED, CS_UNUSED, CS_UNUSED, &rows_read);
@@ -122,207 +273,734 @@ unsigned command::get_column_count(ExceptionSink* xsink) {
    return num_cols;
 }
 
-// FIXME: use ct_setparam to avoid copying data
-void command::set_params(sybase_query &query, const QoreListNode* args, ExceptionSink *xsink) {
-    unsigned nparams = query.param_list.size();
+// parameters are bound with ct_setparam() against the command's buffers, so string and binary values are sent
+// directly from their Qore buffers without being copied; the values are released by send()
+void command::set_params(sybase_query &query, const QoreListNode* args, ss::BindPlan& plan, ExceptionSink *xsink) {
+    if (!plan.matches(query, args))
+        plan.build(query, args);
+
+    const ss::bind_entry_list_t& entries = plan.entries();
+    in_buffers.resize(entries.size());
+
+    for (size_t i = 0, n = entries.size(); i < n; ++i) {
+        const ss::BindEntry& e = entries[i];
+        QoreValue val = (args && e.arg >= 0) ? args->retrieveEntry(e.arg) : QoreValue();
+
+        // copy the precomputed format; ct-lib may update it
+        CS_DATAFMT datafmt = e.datafmt;
+        input_value_buffer& buf = *in_buffers[i];
+        // explicit bind types are parsed when the plan is built
+        CS_RETCODE err;
+        if (e.hint_type.empty())
+            err = (this->*e.bind)(datafmt, val, buf, e.output, xsink);
+        else if (e.hint_arg)
+            err = bind_hash_hint(datafmt, val.get<const QoreHashNode>(), e.hint, e.hint_arg1, e.hint_arg2,
+                e.hint_type.c_str(), e.output, buf, xsink);
+        else
+            // output placeholders without a value are bound as null values of the procedure parameter's type
+            err = bind_hint(datafmt, e.hint, e.hint_arg1, e.hint_arg2, QoreValue(), e.hint_type.c_str(), true, buf,
+                xsink);
+        if (*xsink)
+            return;
+        if (err != CS_SUCCEED) {
+            m_conn.do_exception(xsink, "TDS-EXEC-ERROR", "ct_setparam() for parameter %u failed with error %d",
+                e.pos, (int)err);
+            return;
+        }
+    }
+}
 
-    for (unsigned i = 0; i < nparams; ++i) {
-        if (query.param_list[i] == 'd')
-            continue;
+command::bind_func_t command::get_bind_func(qore_type_t t) {
+    switch (t) {
+        case NT_NOTHING:
+        case NT_NULL:
+            return &command::bind_null;
+        case NT_STRING:
+            return &command::bind_string;
+        case NT_NUMBER:
+            return &command::bind_number;
+        case NT_DATE:
+            return &command::bind_date;
+        case NT_INT:
+            return &command::bind_int;
+        case NT_BOOLEAN:
+            return &command::bind_bool;
+        case NT_FLOAT:
+            return &command::bind_float;
+        case NT_BINARY:
+            return &command::bind_binary;
+        case NT_HASH:
+            return &command::bind_hash;
+        default:
+            return &command::bind_unknown;
+    }
+}
 
-        QoreValue val = args ? args->retrieveEntry(i) : QoreValue();
+CS_RETCODE command::bind_null(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+        ExceptionSink* xsink) {
+#ifdef FREETDS
+    // it seems to be necessary to specify a type like
+    // this to get a null value to be bound with freetds
+    datafmt.datatype = CS_CHAR_TYPE;
+    datafmt.format = CS_FMT_NULLTERM;
+    datafmt.maxlength = 1;
+#endif
+    // SQL NULL value
+    buf.set_null();
+    return setparam(datafmt, buf);
+}
 
-        CS_DATAFMT datafmt;
-        memset(&datafmt, 0, sizeof(datafmt));
-        datafmt.status = CS_INPUTVALUE;
-        datafmt.namelen = CS_NULLTERM;
-        sprintf(datafmt.name, "@par%d", int(i + 1));
-        datafmt.maxlength = CS_UNUSED;
-        datafmt.count = 1;
+CS_RETCODE command::bind_output_null(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+        ExceptionSink* xsink) {
+    datafmt.datatype = CS_CHAR_TYPE;
+    datafmt.format = CS_FMT_UNUSED;
+    datafmt.maxlength = RPC_OUTPUT_MAXLENGTH;
+    buf.set_null();
+    return setparam(datafmt, buf);
+}
 
-        CS_RETCODE err = CS_FAIL;
+CS_RETCODE command::bind_string(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+        ExceptionSink* xsink) {
+    const QoreStringNode *str = val.get<const QoreStringNode>();
+    // ensure we bind with the proper encoding for the connection
+    TempEncodingHelper s(str, m_conn.getEncoding(), xsink);
+    if (!s) throw ss::Error("TDS-EXEC-ERROR", "encoding");
+
+    int slen = s->strlen();
+    // note that freetds requires maxlength to be set to the byte length of the string
+    // even if CS_FMT_NULLTERM is used, therefore we set CS_FMT_UNUSED
+    datafmt.datatype = CS_CHAR_TYPE;
+    datafmt.format = CS_FMT_UNUSED;
+    // NOTE: setting large sizes here like 2GB works for sybase ctlib,
+    // not for freetds
+    datafmt.maxlength = slen;
+    // output parameters need room for the value returned
+    if (output && datafmt.maxlength < RPC_OUTPUT_MAXLENGTH)
+        datafmt.maxlength = RPC_OUTPUT_MAXLENGTH;
+    // bind the string in place if no conversion was necessary, otherwise take the converted buffer
+    if (s.is_temp())
+        buf.set_owned(s.giveBuffer(), slen);
+    else
+        buf.set_ref(str, str->c_str(), slen);
+    return setparam(datafmt, buf);
+}
 
-        if (val.isNullOrNothing()) {
-#ifdef FREETDS
-            // it seems to be necessary to specify a type like
-            // this to get a null value to be bound with freetds
-            datafmt.datatype = CS_CHAR_TYPE;
-            datafmt.format = CS_FMT_NULLTERM;
-            datafmt.maxlength = 1;
-#endif
-            // SQL NULL value
-            err = ct_param(m_cmd, &datafmt, 0, CS_UNUSED, -1);
-            if (err != CS_SUCCEED) {
-                m_conn.do_exception(xsink, "TDS-EXEC-ERROR",
-                    "ct_param() for 'null' failed for parameter %u with error %d", i, (int)err);
-                return;
-            }
-            continue;
+// gets the precision and scale of a plain decimal number string
+// returns 0 if the number can be bound as NUMERIC, -1 if not (exponent, special value, too many digits)
+static int get_numeric_precision(const char* str, int& precision, int& scale) {
+    const char* p = str;
+    if (*p == '-' || *p == '+')
+        ++p;
+    // skip leading zeros in the integer part
+    while (*p == '0')
+        ++p;
+    int digits = 0;
+    while (isdigit(*p)) {
+        ++digits;
+        ++p;
+    }
+    scale = 0;
+    if (*p == '.') {
+        ++p;
+        while (isdigit(*p)) {
+            ++scale;
+            ++p;
         }
+    }
+    if (*p)
+        return -1;
+    precision = digits + scale;
+    if (!precision)
+        precision = 1;
+    return precision > NUMERIC_MAX_PRECISION ? -1 : 0;
+}
 
-        qore_type_t ntype = val.getType();
+// converts a string to the given fixed-length type with cs_convert() and binds the result
+CS_RETCODE command::bind_converted(CS_DATAFMT& datafmt, CS_INT datatype, const char* str, size_t len, int precision,
+        int scale, input_value_buffer& buf, ExceptionSink* xsink) {
+    CS_DATAFMT srcfmt;
+    memset(&srcfmt, 0, sizeof(srcfmt));
+    srcfmt.datatype = CS_CHAR_TYPE;
+    srcfmt.format = CS_FMT_UNUSED;
+    srcfmt.maxlength = len;
+    srcfmt.count = 1;
+
+    CS_DATAFMT dstfmt;
+    memset(&dstfmt, 0, sizeof(dstfmt));
+    dstfmt.datatype = datatype;
+    dstfmt.format = CS_FMT_UNUSED;
+    dstfmt.maxlength = sizeof(CS_NUMERIC);
+    dstfmt.precision = precision;
+    dstfmt.scale = scale;
+    dstfmt.count = 1;
+
+    // large enough for all fixed-length types converted here
+    CS_NUMERIC val;
+    CS_INT olen = 0;
+    CS_RETCODE err = cs_convert(m_conn.getContext(), &srcfmt, (CS_VOID*)str, &dstfmt, &val, &olen);
+    if (err != CS_SUCCEED) {
+        m_conn.do_exception(xsink, "TDS-BIND-ERROR", "cannot convert value '%s' for binding; cs_convert() to "
+            "type %d failed with error %d", str, (int)datatype, (int)err);
+        return CS_FAIL;
+    }
 
-        switch (ntype) {
-            case NT_STRING: {
-                const QoreStringNode *str = val.get<const QoreStringNode>();
-                // ensure we bind with the proper encoding for the connection
-                TempEncodingHelper s(str, m_conn.getEncoding(), xsink);
-                if (!s) throw ss::Error("TDS-EXEC-ERROR", "encoding");
+    datafmt.datatype = datatype;
+    datafmt.format = CS_FMT_UNUSED;
+    datafmt.maxlength = olen;
+    datafmt.precision = precision;
+    datafmt.scale = scale;
+    buf.set_fixed(&val, olen);
+    return setparam(datafmt, buf);
+}
 
-                int slen = s->strlen();
-                // note that freetds requires maxlength to be set to the byte length of the string
-                // even if CS_FMT_NULLTERM is used, therefore we set CS_FMT_UNUSED
-                datafmt.datatype = CS_CHAR_TYPE;
-                datafmt.format = CS_FMT_UNUSED;
-                // NOTE: setting large sizes here like 2GB works for sybase ctlib,
-                // not for freetds
-                datafmt.maxlength = slen;
-                err = ct_param(m_cmd, &datafmt, (CS_VOID*)s->getBuffer(), slen, 0);
-                break;
-            }
+CS_RETCODE command::bind_number(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+        ExceptionSink* xsink) {
+    QoreStringValueHelper vh(val);
+    // bind numbers natively as NUMERIC values if possible so the server does not have to convert them
+    int precision, scale;
+    if (!get_numeric_precision(vh->c_str(), precision, scale))
+        return bind_converted(datafmt, CS_NUMERIC_TYPE, vh->c_str(), vh->strlen(), precision, scale, buf, xsink);
+
+    int slen = vh->strlen();
+    datafmt.datatype = CS_CHAR_TYPE;
+    datafmt.format = CS_FMT_NULLTERM;
+    datafmt.maxlength = slen + 1;
+    buf.set_string(vh->c_str(), slen);
+    return setparam(datafmt, buf);
+}
 
-            case NT_NUMBER: {
-                QoreStringValueHelper vh(val);
-                int slen = vh->strlen();
-                datafmt.datatype = CS_CHAR_TYPE;
-                datafmt.format = CS_FMT_NULLTERM;
-                datafmt.maxlength = slen + 1;
-                err = ct_param(m_cmd, &datafmt, (CS_VOID *)vh->getBuffer(), slen, 0);
-                break;
-            }
+// binds the date as a string in the server's time zone
+CS_RETCODE command::bind_date_string(CS_DATAFMT& datafmt, const DateTimeNode* date, input_value_buffer& buf,
+        bool time_only) {
+    qore_tm info;
+    date->getInfo(m_conn.getTZ(), info);
+    char str[32];
+    int slen;
+    if (time_only) {
+        slen = info.us
+            ? snprintf(str, sizeof(str), "%02d:%02d:%02d.%06d", info.hour, info.minute, info.second, info.us)
+            : snprintf(str, sizeof(str), "%02d:%02d:%02d", info.hour, info.minute, info.second);
+    } else {
+        slen = info.us
+            ? snprintf(str, sizeof(str), "%04d-%02d-%02dT%02d:%02d:%02d.%06d", info.year, info.month, info.day,
+                info.hour, info.minute, info.second, info.us)
+            : snprintf(str, sizeof(str), "%04d-%02d-%02dT%02d:%02d:%02d", info.year, info.month, info.day,
+                info.hour, info.minute, info.second);
+    }
+    datafmt.datatype = CS_CHAR_TYPE;
+    datafmt.format = CS_FMT_UNUSED;
+    datafmt.maxlength = slen;
+    buf.set_string(str, slen);
+    return setparam(datafmt, buf);
+}
 
-            case NT_DATE: {
-                const DateTimeNode* date = val.get<const DateTimeNode>();
-                if (m_conn.optimizedDateBinds()) {
-                    // must bind the date in the server's time zone
-                    qore_tm info;
-                    date->getInfo(m_conn.getTZ(), info);
-                    QoreStringMaker str("%04d-%02d-%02dT%02d:%02d:%02d", info.year, info.month, info.day, info.hour,
-                        info.minute, info.second);
-                    if (info.us) {
-                        str.sprintf(".%06d", info.us);
-                    }
-                    datafmt.datatype = CS_CHAR_TYPE;
-                    datafmt.format = CS_FMT_UNUSED;
-                    int slen = str.strlen();
-                    datafmt.maxlength = slen;
-                    err = ct_param(m_cmd, &datafmt, (CS_VOID*)str.c_str(), slen, 0);
-                } else {
-                    // this is the only reliable way to bind values with sub-second resolution
-                    CS_DATETIME dt;
-                    ss::Conversions conv;
-                    if (conv.DateTime_to_DATETIME(date, dt, xsink)) {
-                        throw ss::Error("TDS-EXEC-ERROR", "can't convert date");
-                    }
-
-                    datafmt.datatype = CS_DATETIME_TYPE;
-                    err = ct_param(m_cmd, &datafmt, &dt, sizeof(dt), 0);
-                }
-                break;
-            }
+CS_RETCODE command::bind_date(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+        ExceptionSink* xsink) {
+    const DateTimeNode* date = val.get<const DateTimeNode>();
+    if (m_conn.optimizedDateBinds()) {
+        // must bind the date in the server's time zone
+        return bind_date_string(datafmt, date, buf);
+    }
+
+    // this is the only reliable way to bind values with sub-second resolution
+    CS_DATETIME dt;
+    ss::Conversions conv;
+    if (conv.DateTime_to_DATETIME(date, dt, xsink)) {
+        throw ss::Error("TDS-EXEC-ERROR", "can't convert date");
+    }
 
-            case NT_INT: {
-                int64 ival = val.getAsBigInt();
+    datafmt.datatype = CS_DATETIME_TYPE;
+    buf.set_fixed(&dt, sizeof(dt));
+    return setparam(datafmt, buf);
+}
+
+CS_RETCODE command::bind_int(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+        ExceptionSink* xsink) {
+    int64 ival = val.getAsBigInt();
 #ifdef CS_BIGINT_TYPE
-                datafmt.datatype = CS_BIGINT_TYPE;
-                err = ct_param(m_cmd, &datafmt, &ival, sizeof(int64), 0);
+    datafmt.datatype = CS_BIGINT_TYPE;
+    buf.set_fixed(&ival, sizeof(int64));
 #else
-                // if it's a 32-bit integer, bind as integer
-                if (ival <= 2147483647 && ival >= -2147483647) {
-                    datafmt.datatype = CS_INT_TYPE;
-                    CS_INT vint = ival;
-                    err = ct_param(m_cmd, &datafmt, &vint, sizeof(CS_INT), 0);
-                } else { // bind as float
-                    CS_FLOAT fval = ival;
-                    datafmt.datatype = CS_FLOAT_TYPE;
-                    err = ct_param(m_cmd, &datafmt, &fval, sizeof(CS_FLOAT), 0);
-                }
+    // if it's a 32-bit integer, bind as integer
+    if (ival <= 2147483647 && ival >= -2147483647) {
+        datafmt.datatype = CS_INT_TYPE;
+        CS_INT vint = ival;
+        buf.set_fixed(&vint, sizeof(CS_INT));
+    } else { // bind as float
+        CS_FLOAT fval = ival;
+        datafmt.datatype = CS_FLOAT_TYPE;
+        buf.set_fixed(&fval, sizeof(CS_FLOAT));
+    }
+#endif
+    return setparam(datafmt, buf);
+}
+
+CS_RETCODE command::bind_bool(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+        ExceptionSink* xsink) {
+    // Seems mssql doesn't like  CS_BIT_TYPE for some reason.
+    // Replacing by CS_INT_TYPE helps
+    //
+    // The "BIT" code is supposed to be like this:
+    // datafmt.datatype = CS_BIT_TYPE;
+    // err = ct_param(m_cmd, &datafmt, &bval, sizeof(bval), 0);
+    // ... but it doesn't work
+
+    // the value must have the size of the declared type, otherwise the wrong half is sent on big-endian hosts
+    CS_INT ival = val.getAsBool() ? 1 : 0;
+    datafmt.datatype = CS_INT_TYPE;
+    buf.set_fixed(&ival, sizeof(ival));
+    return setparam(datafmt, buf);
+}
+
+CS_RETCODE command::bind_float(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+        ExceptionSink* xsink) {
+    CS_FLOAT fval = val.getAsFloat();
+    datafmt.datatype = CS_FLOAT_TYPE;
+    buf.set_fixed(&fval, sizeof(CS_FLOAT));
+    return setparam(datafmt, buf);
+}
+
+CS_RETCODE command::bind_binary(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+        ExceptionSink* xsink) {
+    const BinaryNode *b = val.get<const BinaryNode>();
+    datafmt.datatype = CS_BINARY_TYPE;
+    datafmt.maxlength = b->size();
+    datafmt.count = 1;
+    // binary data is always bound in place
+    buf.set_ref(b, b->getPtr(), b->size());
+    return setparam(datafmt, buf);
+}
+
+struct bind_hint_info {
+    const char* name;
+    command::bind_hint_t hint;
+};
+
+// explicit bind types supported in {type: ..., value: ...} hashes
+static const bind_hint_info bind_hints[] = {
+    {"char", command::BH_CHAR},
+    {"varchar", command::BH_VARCHAR},
+    {"nchar", command::BH_NCHAR},
+    {"unichar", command::BH_NCHAR},
+    {"nvarchar", command::BH_NVARCHAR},
+    {"univarchar", command::BH_NVARCHAR},
+    {"text", command::BH_TEXT},
+    {"tinyint", command::BH_TINYINT},
+    {"smallint", command::BH_SMALLINT},
+    {"int", command::BH_INT},
+    {"integer", command::BH_INT},
+    {"bigint", command::BH_BIGINT},
+    {"numeric", command::BH_NUMERIC},
+    {"decimal", command::BH_NUMERIC},
+    {"money", command::BH_MONEY},
+    {"smallmoney", command::BH_SMALLMONEY},
+    {"float", command::BH_FLOAT},
+    {"datetime", command::BH_DATETIME},
+    {"smalldatetime", command::BH_SMALLDATETIME},
+    {"date", command::BH_DATE},
+    {"bigdatetime", command::BH_BIGDATETIME},
+    {"datetime2", command::BH_BIGDATETIME},
+    {"time", command::BH_TIME},
+    {"binary", command::BH_BINARY},
+    {"varbinary", command::BH_BINARY},
+    {"image", command::BH_IMAGE},
+};
+
+static const char* skip_space(const char* p) {
+    while (isspace(*p))
+        ++p;
+    return p;
+}
+
+int command::parse_bind_hint(const char* str, bind_hint_t& hint, int& arg1, int& arg2) {
+    arg1 = arg2 = -1;
+    const char* p = skip_space(str);
+    const char* start = p;
+    while (isalnum(*p))
+        ++p;
+    size_t len = p - start;
+    if (!len)
+        return -1;
+
+    bool found = false;
+    for (const bind_hint_info& i : bind_hints) {
+        if (strlen(i.name) == len && !strncasecmp(i.name, start, len)) {
+            hint = i.hint;
+            found = true;
+            break;
+        }
+    }
+    if (!found)
+        return -1;
+
+    p = skip_space(p);
+    if (*p == '(') {
+        char* end;
+        arg1 = strtol(p + 1, &end, 10);
+        if (end == p + 1 || arg1 < 0)
+            return -1;
+        p = skip_space(end);
+        if (*p == ',') {
+            arg2 = strtol(p + 1, &end, 10);
+            if (end == p + 1 || arg2 < 0)
+                return -1;
+            p = skip_space(end);
+        }
+        if (*p != ')')
+            return -1;
+        p = skip_space(p + 1);
+    }
+    return *p ? -1 : 0;
+}
+
+// returns the ct-lib type used to bind values with the given hint
+static CS_INT get_hint_datatype(command::bind_hint_t hint) {
+    switch (hint) {
+        case command::BH_NCHAR:
+        case command::BH_NVARCHAR: return CS_UNICHAR_TYPE;
+        case command::BH_TEXT: return CS_TEXT_TYPE;
+        case command::BH_TINYINT: return CS_TINYINT_TYPE;
+        case command::BH_SMALLINT: return CS_SMALLINT_TYPE;
+        case command::BH_INT: return CS_INT_TYPE;
+#ifdef CS_BIGINT_TYPE
+        case command::BH_BIGINT: return CS_BIGINT_TYPE;
+#endif
+        case command::BH_NUMERIC: return CS_NUMERIC_TYPE;
+        case command::BH_MONEY: return CS_MONEY_TYPE;
+        case command::BH_SMALLMONEY: return CS_MONEY4_TYPE;
+        case command::BH_FLOAT: return CS_FLOAT_TYPE;
+        case command::BH_DATETIME: return CS_DATETIME_TYPE;
+        case command::BH_SMALLDATETIME: return CS_DATETIME4_TYPE;
+        case command::BH_BINARY: return CS_BINARY_TYPE;
+        case command::BH_IMAGE: return CS_IMAGE_TYPE;
+#ifdef CS_DATE_TYPE
+        case command::BH_DATE: return CS_DATE_TYPE;
+#endif
+#ifdef CS_TIME_TYPE
+        case command::BH_TIME: return CS_TIME_TYPE;
+#endif
+#ifdef CS_BIGDATETIME_TYPE
+        case command::BH_BIGDATETIME: return CS_BIGDATETIME_TYPE;
+#endif
+        default:
+            return CS_CHAR_TYPE;
+    }
+}
+
+// returns the encoding for UTF-16 data in the native byte order for CS_UNICHAR_TYPE values
+static const QoreEncoding* get_unichar_encoding() {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return QCS_UTF16BE;
+#else
+    return QCS_UTF16LE;
+#endif
+}
+
+CS_RETCODE command::bind_hash(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+        ExceptionSink* xsink) {
+    const QoreHashNode* h = val.get<const QoreHashNode>();
+    QoreValue t = h->getKeyValue("type");
+    if (!t || t.getType() != NT_STRING)
+        return bind_unknown(datafmt, val, buf, output, xsink);
+
+    const char* tname = t.get<const QoreStringNode>()->c_str();
+    bind_hint_t hint;
+    int arg1, arg2;
+    if (parse_bind_hint(tname, hint, arg1, arg2)) {
+        m_conn.do_exception(xsink, "TDS-BIND-ERROR", "unknown explicit bind type '%s'", tname);
+        return CS_FAIL;
+    }
+
+    return bind_hash_hint(datafmt, h, hint, arg1, arg2, tname, output, buf, xsink);
+}
+
+CS_RETCODE command::bind_hash_hint(CS_DATAFMT& datafmt, const QoreHashNode* h, bind_hint_t hint, int arg1, int arg2,
+        const char* tname, bool output, input_value_buffer& buf, ExceptionSink* xsink) {
+    // explicit size, precision, and scale keys override any values given in the type string
+    if (hint == BH_NUMERIC) {
+        QoreValue p = h->getKeyValue("precision");
+        if (!p.isNothing())
+            arg1 = (int)p.getAsBigInt();
+        QoreValue s = h->getKeyValue("scale");
+        if (!s.isNothing())
+            arg2 = (int)s.getAsBigInt();
+    } else {
+        QoreValue s = h->getKeyValue("size");
+        if (!s.isNothing())
+            arg1 = (int)s.getAsBigInt();
+    }
+
+    return bind_hint(datafmt, hint, arg1, arg2, h->getKeyValue("value"), tname, output, buf, xsink);
+}
+
+CS_RETCODE command::bind_hint(CS_DATAFMT& datafmt, bind_hint_t hint, int arg1, int arg2, QoreValue v,
+        const char* tname, bool output, input_value_buffer& buf, ExceptionSink* xsink) {
+#ifndef CS_BIGINT_TYPE
+    if (hint == BH_BIGINT) {
+        m_conn.do_exception(xsink, "TDS-BIND-ERROR", "bind type '%s' is not supported by this version of the "
+            "client library", tname);
+        return CS_FAIL;
+    }
 #endif
+
+    // bind a typed null value
+    if (v.isNullOrNothing()) {
+        datafmt.datatype = get_hint_datatype(hint);
+        switch (hint) {
+            case BH_NUMERIC:
+                datafmt.precision = arg1 > 0 ? arg1 : NUMERIC_MAX_PRECISION;
+                datafmt.scale = arg2 > 0 ? arg2 : 0;
+                datafmt.maxlength = sizeof(CS_NUMERIC);
+                break;
+            case BH_NCHAR:
+            case BH_NVARCHAR:
+                datafmt.maxlength = arg1 > 0 ? arg1 * 2 : 2;
                 break;
+            case BH_DATE:
+            case BH_BIGDATETIME:
+            case BH_TIME:
+                // date and time types are bound as strings if the client library has no native type
+                if (datafmt.datatype != CS_CHAR_TYPE)
+                    break;
+                // fall through
+            case BH_CHAR:
+            case BH_VARCHAR:
+            case BH_TEXT:
+            case BH_BINARY:
+            case BH_IMAGE:
+                datafmt.maxlength = arg1 > 0 ? arg1 : 1;
+                break;
+            default:
+                break;
+        }
+        if (output && datafmt.datatype == CS_CHAR_TYPE && datafmt.maxlength < RPC_OUTPUT_MAXLENGTH)
+            datafmt.maxlength = RPC_OUTPUT_MAXLENGTH;
+        buf.set_null();
+        return setparam(datafmt, buf);
+    }
+
+    switch (hint) {
+        case BH_CHAR:
+        case BH_VARCHAR:
+        case BH_TEXT:
+        case BH_NCHAR:
+        case BH_NVARCHAR: {
+            bool unichar = hint == BH_NCHAR || hint == BH_NVARCHAR;
+            const QoreEncoding* enc = unichar ? get_unichar_encoding() : m_conn.getEncoding();
+            // bind strings in place if no conversion is necessary
+            if (v.getType() == NT_STRING && v.get<const QoreStringNode>()->getEncoding() == enc) {
+                const QoreStringNode* str = v.get<const QoreStringNode>();
+                buf.set_ref(str, str->c_str(), str->size());
+            } else {
+                QoreStringValueHelper sv(v, enc, xsink);
+                if (*xsink)
+                    return CS_FAIL;
+                buf.set_string(sv->c_str(), sv->size());
             }
+            // the size is given in characters for UTF-16 strings
+            CS_INT size = arg1 > 0 ? (unichar ? arg1 * 2 : arg1) : -1;
+            if (size > 0 && buf.value_len > size) {
+                m_conn.do_exception(xsink, "TDS-BIND-ERROR", "value with a length of %d bytes exceeds the size of "
+                    "bind type '%s'", (int)buf.value_len, tname);
+                return CS_FAIL;
+            }
+            datafmt.datatype = get_hint_datatype(hint);
+            datafmt.format = CS_FMT_UNUSED;
+            datafmt.maxlength = size > 0 ? size : buf.value_len;
+            if (output && datafmt.maxlength < RPC_OUTPUT_MAXLENGTH)
+                datafmt.maxlength = RPC_OUTPUT_MAXLENGTH;
+            return setparam(datafmt, buf);
+        }
 
-            case NT_BOOLEAN: {
-                // Seems mssql doesn't like  CS_BIT_TYPE for some reason.
-                // Replacing by CS_INT_TYPE helps
-                //
-                // The "BIT" code is supposed to be like this:
-                // datafmt.datatype = CS_BIT_TYPE;
-                // err = ct_param(m_cmd, &datafmt, &bval, sizeof(bval), 0);
-                // ... but it doesn't work
-
-                CS_BIT bval = val.getAsBool();
-                datafmt.datatype = CS_INT_TYPE;
-                int64 ival = bval ? 1 : 0;
-                err = ct_param(m_cmd, &datafmt, &ival, sizeof(ival), 0);
-                break;
+        case BH_TINYINT:
+        case BH_SMALLINT:
+        case BH_INT:
+        case BH_BIGINT: {
+            int64 ival = v.getAsBigInt();
+            datafmt.datatype = get_hint_datatype(hint);
+            bool range_error = false;
+            switch (hint) {
+                case BH_TINYINT: {
+                    range_error = ival < 0 || ival > 255;
+                    CS_TINYINT i1 = (CS_TINYINT)ival;
+                    buf.set_fixed(&i1, sizeof(i1));
+                    break;
+                }
+                case BH_SMALLINT: {
+                    range_error = ival < -32768 || ival > 32767;
+                    CS_SMALLINT i2 = (CS_SMALLINT)ival;
+                    buf.set_fixed(&i2, sizeof(i2));
+                    break;
+                }
+                case BH_INT: {
+                    range_error = ival < -2147483648LL || ival > 2147483647LL;
+                    CS_INT i4 = (CS_INT)ival;
+                    buf.set_fixed(&i4, sizeof(i4));
+                    break;
+                }
+                default:
+                    buf.set_fixed(&ival, sizeof(ival));
+                    break;
+            }
+            if (range_error) {
+                m_conn.do_exception(xsink, "TDS-BIND-ERROR", "value " QLLD " is out of range for bind type '%s'",
+                    ival, tname);
+                return CS_FAIL;
             }
+            return setparam(datafmt, buf);
+        }
 
-            case NT_FLOAT: {
-                CS_FLOAT fval = val.getAsFloat();
-                datafmt.datatype = CS_FLOAT_TYPE;
-                err = ct_param(m_cmd, &datafmt, &fval, sizeof(CS_FLOAT), 0);
-                break;
+        case BH_NUMERIC: {
+            QoreStringValueHelper vh(v);
+            int precision, scale;
+            if (get_numeric_precision(vh->c_str(), precision, scale)) {
+                m_conn.do_exception(xsink, "TDS-BIND-ERROR", "cannot bind value '%s' as type '%s'", vh->c_str(),
+                    tname);
+                return CS_FAIL;
             }
+            if (arg1 > 0)
+                precision = arg1;
+            if (arg2 >= 0)
+                scale = arg2;
+            return bind_converted(datafmt, CS_NUMERIC_TYPE, vh->c_str(), vh->strlen(), precision, scale, buf, xsink);
+        }
 
-            case NT_BINARY: {
-                const BinaryNode *b = val.get<const BinaryNode>();
-                datafmt.datatype = CS_BINARY_TYPE;
-                datafmt.maxlength = b->size();
-                datafmt.count = 1;
-                err = ct_param(m_cmd, &datafmt, (void *)b->getPtr(), b->size(), 0);
-                break;
+        case BH_MONEY:
+        case BH_SMALLMONEY: {
+            QoreStringValueHelper vh(v);
+            return bind_converted(datafmt, get_hint_datatype(hint), vh->c_str(), vh->strlen(), 0, 0, buf, xsink);
+        }
+
+        case BH_FLOAT: {
+            CS_FLOAT fval = v.getAsFloat();
+            datafmt.datatype = CS_FLOAT_TYPE;
+            buf.set_fixed(&fval, sizeof(CS_FLOAT));
+            return setparam(datafmt, buf);
+        }
+
+        default:
+            break;
+    }
+
+    if (hint == BH_BINARY || hint == BH_IMAGE) {
+        // binary data and the bytes of strings are bound in place
+        if (v.getType() == NT_BINARY) {
+            const BinaryNode* b = v.get<const BinaryNode>();
+            buf.set_ref(b, b->getPtr(), b->size());
+        } else if (v.getType() == NT_STRING) {
+            const QoreStringNode* str = v.get<const QoreStringNode>();
+            buf.set_ref(str, str->c_str(), str->size());
+        } else {
+            m_conn.do_exception(xsink, "TDS-BIND-ERROR", "expecting type 'binary' or 'string' for bind type '%s'; "
+                "got type '%s' instead", tname, v.getFullTypeName());
+            return CS_FAIL;
+        }
+        if (arg1 > 0 && buf.value_len > arg1) {
+            m_conn.do_exception(xsink, "TDS-BIND-ERROR", "value with a length of %d bytes exceeds the size of "
+                "bind type '%s'", (int)buf.value_len, tname);
+            return CS_FAIL;
+        }
+        datafmt.datatype = get_hint_datatype(hint);
+        datafmt.maxlength = arg1 > 0 ? arg1 : buf.value_len;
+        return setparam(datafmt, buf);
+    }
+
+    // all remaining types are date/time types
+    if (v.getType() != NT_DATE) {
+        m_conn.do_exception(xsink, "TDS-BIND-ERROR", "expecting type 'date' for bind type '%s'; "
+            "got type '%s' instead", tname, v.getFullTypeName());
+        return CS_FAIL;
+    }
+    const DateTimeNode* date = v.get<const DateTimeNode>();
+
+    switch (hint) {
+        case BH_DATETIME:
+        case BH_SMALLDATETIME: {
+            CS_DATETIME dt;
+            ss::Conversions conv;
+            if (conv.DateTime_to_DATETIME(date, dt, xsink))
+                return CS_FAIL;
+            if (hint == BH_DATETIME) {
+                datafmt.datatype = CS_DATETIME_TYPE;
+                buf.set_fixed(&dt, sizeof(dt));
+                return setparam(datafmt, buf);
             }
 
-            case NT_HASH: {
-                const QoreHashNode* h = val.get<const QoreHashNode>();
-                QoreValue t = h->getKeyValue("type");
-                QoreValue v = h->getKeyValue("value");
-                if (t && t.getType() == NT_STRING) {
-                    const QoreStringNode& str = *t.get<const QoreStringNode>();
-                    if (str == "date") {
-                        if (v.getType() != NT_DATE) {
-                            m_conn.do_exception(xsink, "TDS-BIND-ERROR", "expecting type 'date' for bind type '%s'; "
-                                "got type '%s' instead", str.c_str(), v.getFullTypeName());
-                            return;
-                        }
-                        // NOTE: cannot bind by CS_BIGDATETIME_TYPE
-                        // binding by CS_CHAR_TYPE works for BIGDATETIME / DATETIME2 columns, but will fail with a
-                        // DATETIME column
-                        const DateTimeNode* date = v.get<const DateTimeNode>();
-                        qore_tm info;
-                        date->getInfo(m_conn.getTZ(), info);
-                        QoreStringMaker str("%04d-%02d-%02dT%02d:%02d:%02d", info.year, info.month, info.day,
-                            info.hour, info.minute, info.second);
-                        if (info.us) {
-                            str.sprintf(".%06d", info.us);
-                        }
-                        datafmt.datatype = CS_CHAR_TYPE;
-                        datafmt.format = CS_FMT_UNUSED;
-                        int slen = str.strlen();
-                        datafmt.maxlength = slen;
-                        err = ct_param(m_cmd, &datafmt, (CS_VOID*)str.c_str(), slen, 0);
-                        return;
-                    }
-                    m_conn.do_exception(xsink, "TDS-BIND-ERROR", "unknown explicit bind type '%s'", str.c_str());
-                    return;
-                }
+            CS_DATAFMT srcfmt;
+            memset(&srcfmt, 0, sizeof(srcfmt));
+            srcfmt.datatype = CS_DATETIME_TYPE;
+            srcfmt.maxlength = sizeof(CS_DATETIME);
+            srcfmt.count = 1;
+            CS_DATAFMT dstfmt;
+            memset(&dstfmt, 0, sizeof(dstfmt));
+            dstfmt.datatype = CS_DATETIME4_TYPE;
+            dstfmt.maxlength = sizeof(CS_DATETIME4);
+            dstfmt.count = 1;
+            CS_DATETIME4 dt4;
+            CS_INT olen;
+            CS_RETCODE err = cs_convert(m_conn.getContext(), &srcfmt, &dt, &dstfmt, &dt4, &olen);
+            if (err != CS_SUCCEED) {
+                m_conn.do_exception(xsink, "TDS-BIND-ERROR", "cannot convert date value for bind type '%s'; "
+                    "cs_convert() failed with error %d", tname, (int)err);
+                return CS_FAIL;
             }
+            datafmt.datatype = CS_DATETIME4_TYPE;
+            buf.set_fixed(&dt4, sizeof(dt4));
+            return setparam(datafmt, buf);
+        }
 
-            default:
-                m_conn.do_exception(xsink, "TDS-BIND-ERROR",
-                                    "do not know how to bind values of type '%s'",
-                                    val.getTypeName());
-                return;
-        } // switch(ntype)
+#ifdef CS_DATE_TYPE
+        case BH_DATE: {
+            CS_DATE d;
+            if (ss::Conversions::DateTime_to_DATE(date, m_conn.getTZ(), d, xsink))
+                return CS_FAIL;
+            datafmt.datatype = CS_DATE_TYPE;
+            buf.set_fixed(&d, sizeof(d));
+            return setparam(datafmt, buf);
+        }
+#endif
 
-        if (err != CS_SUCCEED) {
-            m_conn.do_exception(xsink, "TDS-EXEC-ERROR",
-                                "ct_param() for binary parameter %u failed with error",
-                                i, (int)err);
+#ifdef CS_TIME_TYPE
+        case BH_TIME: {
+            CS_TIME t;
+            if (ss::Conversions::DateTime_to_TIME(date, m_conn.getTZ(), t, xsink))
+                return CS_FAIL;
+            datafmt.datatype = CS_TIME_TYPE;
+            buf.set_fixed(&t, sizeof(t));
+            return setparam(datafmt, buf);
+        }
+#else
+        case BH_TIME:
+            return bind_date_string(datafmt, date, buf, true);
+#endif
+
+#ifdef CS_BIGDATETIME_TYPE
+        case BH_BIGDATETIME: {
+            uint64_t bdt;
+            if (ss::Conversions::DateTime_to_BIGDATETIME(date, m_conn.getTZ(), bdt, xsink))
+                return CS_FAIL;
+            datafmt.datatype = CS_BIGDATETIME_TYPE;
+            buf.set_fixed(&bdt, sizeof(bdt));
+            return setparam(datafmt, buf);
         }
+#endif
+
+        default:
+            // date and time types without a native client library type are bound as strings in the server's time
+            // zone; binding by CS_CHAR_TYPE works for BIGDATETIME / DATETIME2 / DATE columns, but will fail with a
+            // DATETIME column
+            return bind_date_string(datafmt, date, buf);
     }
 }
 
+CS_RETCODE command::bind_unknown(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+        ExceptionSink* xsink) {
+    m_conn.do_exception(xsink, "TDS-BIND-ERROR",
+                        "do not know how to bind values of type '%s'",
+                        val.getTypeName());
+    return CS_FAIL;
+}
+
 int command::get_row_count() {
     return rowcount;
 }
@@ -343,10 +1021,21 @@ command::ResType command::read_next_result1(bool& disconnect, ExceptionSink* xsi
 
     CS_INT result_type;
     CS_RETCODE err = ct_results(m_cmd, &result_type);
+    results_read = true;
     //printf("command::read_next_result1 result: %d\n", err);
     switch (err) {
-        case CS_END_RESULTS:
+        case CS_END_RESULTS: {
+            // track the server's transaction state so that commits can be skipped when no transaction is open
+            // if the batch was aborted before the appended commit, the server reports the transaction as still
+            // open, and Qore's commit is sent as usual
+            CS_INT state;
+            if (ct_res_info(m_cmd, CS_TRANS_STATE, &state, CS_UNUSED, nullptr) == CS_SUCCEED) {
+                m_conn.setTransactionState(state);
+                if (commit_appended && state == CS_TRAN_COMPLETED)
+                    ++ss::transaction_stats.commits_in_batch;
+            }
             return RES_END;
+        }
         case CS_FAIL: {
             if (cancelIntern())
                 disconnect = true;
@@ -408,6 +1097,7 @@ command::ResType command::read_next_result1(bool& disconnect, ExceptionSink* xsi
         case CS_STATUS_RESULT:
             return RES_STATUS;
         case CS_ROW_RESULT:
+        case CS_CURSOR_RESULT:
             return RES_ROW;
     }
 
@@ -419,6 +1109,8 @@ QoreValue command::readOutput(connection& conn, command& cmd, bool list, bool& c
     ValueHolder qresult(xsink);
 
     ss::ResultFactory rf(xsink);
+    // the index of the first placeholder of the next parameter result
+    size_t ph_offset = 0;
 
     while (true) {
         ResType rt = conn.readNextResult(cmd, connection_reset, xsink);
@@ -432,31 +1124,62 @@ QoreValue command::readOutput(connection& conn, command& cmd, bool list, bool& c
             case RES_PARAM:
                 if (retr_colinfo(xsink))
                     return QoreValue();
-                qresult = read_rows(&query->placeholders, xsink);
+                if (query->rpc) {
+                    set_rpc_param_names();
+                    qresult = read_rows(&query->placeholders, xsink);
+                } else if (!ph_offset) {
+                    qresult = read_rows(&query->placeholders, xsink);
+                } else {
+                    // each parameter result of a language command returns the next placeholders in order, as
+                    // with several statements in a batch built by build_batch()
+                    Placeholders ph;
+                    if (ph_offset < query->placeholders.size())
+                        ph.assign(query->placeholders.begin() + ph_offset, query->placeholders.end());
+                    qresult = read_rows(&ph, xsink);
+                }
+                ph_offset += colinfo.count();
                 //add_rowcount(*qresult, 1, xsink);
                 rf.add_params(qresult);
                 break;
 
-            case RES_ROW:
+            case RES_ROW: {
                 qresult = read_rows(0, list, cols, xsink, single_row);
+                int64 count;
+                if (!*xsink && ss::ResultFactory::isBatchMarker(*qresult, count)) {
+                    rf.end_statement(count);
+                    break;
+                }
                 rf.add(qresult, list);
                 break;
+            }
 
             case RES_END:
-                return rf.res();
+                return query->rpc ? rf.res_rpc() : rf.res();
 
             case RES_DONE:
                 rf.done(rowcount);
                 continue;
 
-            case RES_STATUS:
+            case RES_STATUS: {
                 if (retr_colinfo(xsink))
                     return QoreValue();
 
-                qresult = read_rows(0, list, false, xsink);
-                // TODO: check status?
+                // the return status is returned as a single row with a single column
+                ReferenceHolder<QoreHashNode> h(fetch_row(xsink), xsink);
+                if (*xsink)
+                    return QoreValue();
+                if (h && !h->empty()) {
+                    ConstHashIterator hi(*h);
+                    hi.next();
+                    rf.set_status(hi.get().refSelf());
+                }
+                // discard any remaining rows
+                while (fetch_row_into_buffers(xsink)) {}
+                if (*xsink)
+                    return QoreValue();
                 colinfo.set_dirty();
                 continue;
+            }
 
             default:
                 m_conn.do_exception(xsink, "TDS-EXEC-ERROR", "command::readOutput(): ct_results() returned unknown result value %d", rt);
@@ -467,6 +1190,22 @@ QoreValue command::readOutput(connection& conn, command& cmd, bool list, bool& c
     }
 }
 
+void command::set_rpc_param_names() {
+    const Placeholders& ph = query->placeholders;
+    for (unsigned i = 0, n = colinfo.datafmt.size(); i < n; ++i) {
+        CS_DATAFMT_EX& datafmt = colinfo.datafmt[i];
+        if (i < ph.size() && !ph[i].empty()) {
+            snprintf(datafmt.name, sizeof(datafmt.name), "%s", ph[i].c_str());
+        } else if (datafmt.name[0] == '@') {
+            // remove the leading '@' from parameter names returned by the server
+            memmove(datafmt.name, datafmt.name + 1, strlen(datafmt.name));
+        } else {
+            continue;
+        }
+        datafmt.namelen = strlen(datafmt.name);
+    }
+}
+
 int command::retr_colinfo(ExceptionSink* xsink) {
     unsigned columns = get_column_count(xsink);
     if (*xsink)
@@ -953,12 +1692,20 @@ QoreValue command::get_value(const CS_DATAFMT_EX& datafmt, const output_value_bu
     } // switch
 }
 
-int command::bind_query(std::unique_ptr<sybase_query>& q, const QoreListNode* args, ExceptionSink* xsink) {
+int command::bind_query(std::unique_ptr<sybase_query>& q, const QoreListNode* args, ss::BindPlan& plan,
+        ExceptionSink* xsink) {
     query.reset(q.release());
 
-    initiate_language_command(query->buff(), xsink);
+    if (query->rpc) {
+        initiate_rpc_command(query->rpc_proc.c_str(), xsink);
+    } else if (isCursor()) {
+        initiate_cursor_command(query->buff(), xsink);
+    } else {
+        initiate_language_command(query->buff(), xsink);
+    }
 
-    if (args) set_params(*query, args, xsink);
+    // RPC commands may have output parameters without arguments
+    if (args || query->rpc) set_params(*query, args, plan, xsink);
 
     return 0;
 }
@@ -33,11 +33,16 @@
 
 #include "sybase_query.h"
 #include "row_output_buffers.h"
+#include "param_buffers.h"
 #include "conversions.h"
 #include "utils.h"
 
 class connection;
 
+namespace ss {
+class BindPlan;
+}
+
 struct CS_DATAFMT_EX : public CS_DATAFMT {
     int origin_datatype;
 };
@@ -68,6 +73,35 @@ public:
 
 class command {
 public:
+    // explicit bind types given with {type: ..., value: ...} hashes
+    enum bind_hint_t {
+        BH_CHAR,
+        BH_VARCHAR,
+        BH_NCHAR,
+        BH_NVARCHAR,
+        BH_TEXT,
+        BH_TINYINT,
+        BH_SMALLINT,
+        BH_INT,
+        BH_BIGINT,
+        BH_NUMERIC,
+        BH_MONEY,
+        BH_SMALLMONEY,
+        BH_FLOAT,
+        BH_DATETIME,
+        BH_SMALLDATETIME,
+        BH_DATE,
+        BH_BIGDATETIME,
+        BH_TIME,
+        BH_BINARY,
+        BH_IMAGE,
+    };
+
+    // binds a single parameter value into the given buffer; returns the ct_setparam() return code or CS_FAIL with
+    // an exception raised
+    typedef CS_RETCODE (command::*bind_func_t)(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf,
+        bool output, ExceptionSink* xsink);
+
     enum ResType {
         RES_NONE,
         RES_PARAM,
@@ -88,13 +122,35 @@ public:
         * RETRY - never gets here
         */
         while ((lastRes = read_next_result1(disconnect, xsink)) == RES_RETRY) {}
+        if (lastRes == RES_END)
+            set_pending(false);
         return lastRes;
     }
 
+    // called when a commit has been appended to the command
+    DLLLOCAL void setCommitAppended(bool c) {
+        commit_appended = c;
+    }
+
+    // sends the command as a Client-Library cursor with the given name instead of a language command; must be
+    // called before bind_query()
+    DLLLOCAL void setCursor(const char* name, bool updatable, int rows) {
+        cursor_name = name;
+        cursor_updatable = updatable;
+        cursor_rows = rows;
+    }
+
+    // returns true if the command is executed as a cursor
+    DLLLOCAL bool isCursor() const {
+        return !cursor_name.empty();
+    }
+
     DLLLOCAL void cancelDisconnect() {
         assert(m_cmd);
         //printd(5, "command::cancelIntern() %d this: %p m_cmd: %p\n", cancelIntern(), this, m_cmd);
         cancelIntern();
+        set_pending(false);
+        // the handle is not reused, as the connection is being closed
         ct_cmd_drop(m_cmd);
         m_cmd = 0;
     }
@@ -106,6 +162,7 @@ public:
             return 0;
 
         lastRes = RES_CANCELED;
+        set_pending(false);
         return cancelIntern();
     }
 
@@ -114,19 +171,59 @@ public:
     DLLLOCAL command(connection& conn, ExceptionSink* xsink);
     DLLLOCAL ~command();
 
+    // cancels or drains any pending results and returns the command handle and the query to the connection for
+    // reuse
     DLLLOCAL void clear();
 
+    // prepares a cleared command object for reuse
+    // returns 0=OK, -1=error (exception raised)
+    DLLLOCAL int reinit(ExceptionSink* xsink);
+
     DLLLOCAL CS_COMMAND* operator()() const { return m_cmd; }
     DLLLOCAL connection& getConnection() const { return m_conn; }
 
     DLLLOCAL void send(ExceptionSink* xsink);
     DLLLOCAL void initiate_language_command(const char *cmd_text, class ExceptionSink *xsink);
+    DLLLOCAL void initiate_rpc_command(const char *proc, class ExceptionSink *xsink);
+    // declares and opens a cursor for the query; the rows are fetched from the server in batches
+    DLLLOCAL void initiate_cursor_command(const char *cmd_text, class ExceptionSink *xsink);
     // returns true if data returned, false if not
     DLLLOCAL bool fetch_row_into_buffers(class ExceptionSink *xsink);
     // returns the number of columns in the result
     DLLLOCAL unsigned get_column_count(ExceptionSink *xsink);
-    // returns 0=OK, -1=error (exception raised)
-    DLLLOCAL void set_params(sybase_query &query, const QoreListNode *args, ExceptionSink *xsink);
+    // binds all parameters according to the given plan, which is rebuilt if it does not match the arguments
+    DLLLOCAL void set_params(sybase_query &query, const QoreListNode *args, ss::BindPlan& plan,
+            ExceptionSink *xsink);
+
+    // returns the bind function for arguments of the given type
+    DLLLOCAL static bind_func_t get_bind_func(qore_type_t t);
+
+    // parses a bind type like "varchar", "char(10)" or "numeric(10, 2)"; arguments not given are set to -1
+    // returns 0 = OK, -1 = unknown type or syntax error
+    DLLLOCAL static int parse_bind_hint(const char* str, bind_hint_t& hint, int& arg1, int& arg2);
+
+    DLLLOCAL CS_RETCODE bind_null(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+            ExceptionSink* xsink);
+    DLLLOCAL CS_RETCODE bind_output_null(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+            ExceptionSink* xsink);
+    DLLLOCAL CS_RETCODE bind_string(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+            ExceptionSink* xsink);
+    DLLLOCAL CS_RETCODE bind_number(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+            ExceptionSink* xsink);
+    DLLLOCAL CS_RETCODE bind_date(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+            ExceptionSink* xsink);
+    DLLLOCAL CS_RETCODE bind_int(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+            ExceptionSink* xsink);
+    DLLLOCAL CS_RETCODE bind_bool(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+            ExceptionSink* xsink);
+    DLLLOCAL CS_RETCODE bind_float(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+            ExceptionSink* xsink);
+    DLLLOCAL CS_RETCODE bind_binary(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+            ExceptionSink* xsink);
+    DLLLOCAL CS_RETCODE bind_hash(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+            ExceptionSink* xsink);
+    DLLLOCAL CS_RETCODE bind_unknown(CS_DATAFMT& datafmt, QoreValue val, input_value_buffer& buf, bool output,
+            ExceptionSink* xsink);
 
     DLLLOCAL QoreValue readOutput(connection& conn, command& cmd, bool list, bool& connection_reset, bool cols, ExceptionSink* xsink, bool single_row = false);
 
@@ -144,12 +241,18 @@ public:
     DLLLOCAL QoreValue read_rows(Placeholders *placeholder_list, bool list, bool cols, ExceptionSink* xsink, bool single_row = false);
     DLLLOCAL QoreValue read_rows(const Placeholders *placeholder_list, ExceptionSink* xsink, bool single_row = false);
 
+    // returns the name of the stored procedure for RPC commands, otherwise nullptr
+    DLLLOCAL const char* getRpcProc() {
+        return query.get() && query->rpc ? query->rpc_proc.c_str() : nullptr;
+    }
+
     DLLLOCAL void set_placeholders(const Placeholders &ph) {
         query->placeholders = ph;
     }
 
     DLLLOCAL int bind_query(std::unique_ptr<sybase_query> &query,
                             const QoreListNode *args,
+                            ss::BindPlan& plan,
                             ExceptionSink*);
 
 private:
@@ -157,11 +260,28 @@ private:
 
     connection& m_conn;
     CS_COMMAND* m_cmd;
+    // the connection handle that m_cmd belongs to
+    CS_CONNECTION* m_parent = nullptr;
     CS_INT rowcount;
     ResType lastRes;
+    // true from when the command is sent until all results have been read or the command has been canceled
+    bool pending = false;
+    // true once ct_results() has been called for the command
+    bool results_read = false;
+    // true if a commit has been appended to the command
+    bool commit_appended = false;
+    // the name of the cursor if the command is executed as a cursor
+    std::string cursor_name;
+    // true if the cursor is declared "for update", otherwise it's read-only
+    bool cursor_updatable = false;
+    // the number of rows fetched from the server in each batch
+    int cursor_rows = 0;
 
     Columns colinfo;
     row_output_buffers out_buffers;
+    // the input buffers for the parameters bound with ct_setparam(); the values are released after the command has
+    // been sent
+    param_buffers in_buffers;
 
     DLLLOCAL int retr_colinfo(ExceptionSink* xsink);
 
@@ -180,9 +300,22 @@ private:
     DLLLOCAL QoreHashNode* output_buffers_to_hash(const Placeholders* ph, ExceptionSink* xsink);
     DLLLOCAL QoreValue get_value(const CS_DATAFMT_EX& datafmt, const output_value_buffer& buffer, ExceptionSink* xsink);
 
+    // closes and deallocates the cursor on the server
+    // returns 0=OK, -1=error
+    DLLLOCAL int close_cursor();
+
     // call ct_result() once. Takes care of return value
     DLLLOCAL ResType read_next_result1(bool& disconnect, ExceptionSink* xsink);
 
+    // updates the pending state of the command and the connection's count of commands with pending results
+    DLLLOCAL void set_pending(bool p);
+
+    // tries to discard the remaining results by reading them instead of sending a cancel to the server; only
+    // done for single statements whose last result set has been read completely, as reading the results of any
+    // other command could wait for the server to execute further statements
+    // returns 0 if all results were read, -1 if the command must be canceled
+    DLLLOCAL int drain();
+
     // returns -1 if the cancel failed and the connection should be disconnected, 0 = OK
     DLLLOCAL int cancelIntern() {
         assert(m_cmd);
@@ -191,8 +324,36 @@ private:
 
     DLLLOCAL QoreValue getNumber(const char* str, size_t len);
 
+    DLLLOCAL CS_RETCODE setparam(CS_DATAFMT& datafmt, input_value_buffer& buf) {
+        return ct_setparam(m_cmd, &datafmt, buf.value, &buf.value_len, &buf.indicator);
+    }
+
+    DLLLOCAL CS_RETCODE bind_converted(CS_DATAFMT& datafmt, CS_INT datatype, const char* str, size_t len,
+            int precision, int scale, input_value_buffer& buf, ExceptionSink* xsink);
+
+    DLLLOCAL CS_RETCODE bind_date_string(CS_DATAFMT& datafmt, const DateTimeNode* date, input_value_buffer& buf,
+            bool time_only = false);
+
+    // binds a {type: ..., value: ...} hash with an already parsed explicit bind type
+    DLLLOCAL CS_RETCODE bind_hash_hint(CS_DATAFMT& datafmt, const QoreHashNode* h, bind_hint_t hint, int arg1,
+            int arg2, const char* tname, bool output, input_value_buffer& buf, ExceptionSink* xsink);
+
+    // binds a value with an explicit bind type
+    DLLLOCAL CS_RETCODE bind_hint(CS_DATAFMT& datafmt, bind_hint_t hint, int arg1, int arg2, QoreValue v,
+            const char* tname, bool output, input_value_buffer& buf, ExceptionSink* xsink);
+
+    // names RPC output parameter values after the placeholders in the call
+    DLLLOCAL void set_rpc_param_names();
+
     DLLLOCAL void setupColumns(QoreHashNode& h, const Placeholders *ph);
 };
 
 
+// returns commands to their connection for reuse instead of deleting them; the connection must outlive the command
+struct command_recycler {
+    DLLLOCAL void operator()(command* cmd) const;
+};
+
+typedef std::unique_ptr<command, command_recycler> command_ptr;
+
 #endif
@@ -24,7 +24,13 @@
 */
 
 #include <assert.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <chrono>
 #include <memory>
+#include <thread>
 
 #include <ctpublic.h>
 
@@ -38,19 +44,206 @@
 
 static QoreString ver_str("begin tran select @@version commit tran");
 
+ss::TransactionStats ss::transaction_stats;
+
+QoreHashNode* ss::TransactionStats::getHash() const {
+    ReferenceHolder<QoreHashNode> h(new QoreHashNode(bigIntTypeInfo), nullptr);
+    h->setKeyValue("commits", commits.load(), nullptr);
+    h->setKeyValue("rollbacks", rollbacks.load(), nullptr);
+    h->setKeyValue("commits_skipped", commits_skipped.load(), nullptr);
+    h->setKeyValue("rollbacks_skipped", rollbacks_skipped.load(), nullptr);
+    h->setKeyValue("commits_in_batch", commits_in_batch.load(), nullptr);
+    return h.release();
+}
+
+ss::DeadlockStats ss::deadlock_stats;
+
+QoreHashNode* ss::DeadlockStats::getHash() const {
+    ReferenceHolder<QoreHashNode> h(new QoreHashNode(bigIntTypeInfo), nullptr);
+    h->setKeyValue("deadlocks", deadlocks.load(), nullptr);
+    h->setKeyValue("retries", retries.load(), nullptr);
+    h->setKeyValue("recovered", recovered.load(), nullptr);
+    h->setKeyValue("exhausted", exhausted.load(), nullptr);
+    h->setKeyValue("not_retried", not_retried.load(), nullptr);
+    return h.release();
+}
+
+ss::ValidationStats ss::validation_stats;
+
+QoreHashNode* ss::ValidationStats::getHash() const {
+    ReferenceHolder<QoreHashNode> h(new QoreHashNode(bigIntTypeInfo), nullptr);
+    h->setKeyValue("validations", validations.load(), nullptr);
+    h->setKeyValue("failures", failures.load(), nullptr);
+    return h.release();
+}
+
 #ifdef SYBASE
 // to serialize calls to ct_init() and ct_exit()
 QoreThreadLock ct_lock;
 QoreThreadLock cs_lock;
 #endif
 
+QoreThreadLock context::ctx_lock;
+context* context::shared = nullptr;
+
+context::context(ExceptionSink *xsink) {
+    CS_RETCODE ret;
+
+#ifdef SYBASE
+    {
+        AutoLocker al(cs_lock);
+#endif
+        ret = cs_ctx_alloc(CS_VERSION_100, &m_context);
+#ifdef SYBASE
+    }
+#endif
+    if (ret != CS_SUCCEED) {
+        m_context = nullptr;
+        xsink->raiseException("TDS-CT-LIB-CANNOT-ALLOCATE-ERROR", "cs_ctx_alloc() failed with error %d", ret);
+        return;
+    }
+
+#ifdef SYBASE
+    {
+        AutoLocker al(ct_lock);
+#endif
+        ret = ct_init(m_context, CS_VERSION_100);
+#ifdef SYBASE
+    }
+#endif
+    if (ret != CS_SUCCEED) {
+        del();
+        xsink->raiseException("TDS-CT-LIB-INIT-FAILED", "ct_init() failed with error %d", ret);
+        return;
+    }
+
+    // Set default type of string representation of DATETIME to long (like Jan 1 1990 12:32:55:0000 PM)
+    // Without this some routines in conversions.cpp would fail.
+    CS_INT aux = CS_DATES_LONG;
+    ret = cs_dt_info(m_context, CS_SET, NULL, CS_DT_CONVFMT, CS_UNUSED, (CS_VOID*)&aux, sizeof(aux), 0);
+    if (ret != CS_SUCCEED) {
+        del();
+        xsink->raiseException("TDS-INIT-ERROR", "cs_dt_info(CS_DT_CONVFMT) failed with error %d", ret);
+        return;
+    }
+    //printd(5, "context::context() this=%p m_context=%p\n", this, m_context);
+}
+
+void context::del() {
+    //printd(5, "context::del() this=%p deleting %p\n", this, m_context);
+
+    CS_RETCODE ret;
+#ifdef SYBASE
+    {
+        AutoLocker al(ct_lock);
+#endif
+        ret = ct_exit(m_context, CS_UNUSED);
+#ifdef SYBASE
+    }
+#endif
+    if (ret != CS_SUCCEED) {
+#ifdef SYBASE
+        {
+            AutoLocker al(ct_lock);
+#endif
+            ret = ct_exit(m_context, CS_FORCE_EXIT);
+#ifdef SYBASE
+        }
+#endif
+        assert(ret == CS_SUCCEED);
+    }
+#ifdef SYBASE
+    AutoLocker al(cs_lock);
+#endif
+    ret = cs_ctx_drop(m_context);
+    assert(ret == CS_SUCCEED);
+    m_context = nullptr;
+}
+
+context* context::acquire(ExceptionSink* xsink) {
+    AutoLocker al(ctx_lock);
+    if (shared) {
+        ++shared->refs;
+        return shared;
+    }
+
+    context* ctx = new context(xsink);
+    if (*xsink || !ctx->m_context) {
+        delete ctx;
+        return nullptr;
+    }
+    shared = ctx;
+    return shared;
+}
+
+void context::release() {
+    {
+        AutoLocker al(ctx_lock);
+        assert(refs);
+        if (--refs)
+            return;
+        assert(shared == this);
+        shared = nullptr;
+    }
+    delete this;
+}
+
+#ifdef SYB_HAVE_LOCALE
+CS_LOCALE* context::get_locale(const char* charset, ExceptionSink* xsink) {
+    std::string key(charset ? charset : "");
+
+    AutoLocker al(loc_lock);
+    locale_map_t::iterator i = locales.lower_bound(key);
+    if (i != locales.end() && i->first == key)
+        return i->second;
+
+    CS_LOCALE* loc = nullptr;
+    CS_RETCODE ret = cs_loc_alloc(m_context, &loc);
+    if (ret != CS_SUCCEED) {
+        xsink->raiseException("TDS-EXEC-EXCEPTION", "cs_loc_alloc() returned error %d", (int)ret);
+        return nullptr;
+    }
+    ret = cs_locale(m_context, CS_SET, loc, CS_LC_ALL, 0, CS_NULLTERM, 0);
+    if (ret != CS_SUCCEED) {
+        cs_loc_drop(m_context, loc);
+        xsink->raiseException("TDS-EXEC-EXCEPTION", "cs_locale(CS_LC_ALL) returned error %d", (int)ret);
+        return nullptr;
+    }
+    ret = cs_locale(m_context, CS_SET, loc, CS_SYB_CHARSET, (CS_CHAR*)charset, CS_NULLTERM, 0);
+    if (ret != CS_SUCCEED) {
+        cs_loc_drop(m_context, loc);
+        xsink->raiseException("TDS-EXEC-EXCEPTION", "cs_locale(CS_SYB_CHARSET, '%s') failed with error %d",
+            charset, (int)ret);
+        return nullptr;
+    }
+
+    locales.insert(i, locale_map_t::value_type(key, loc));
+    return loc;
+}
+#endif
+
 connection::connection(Datasource *n_ds, ExceptionSink *xsink) :
         m_context(xsink),
         ds(n_ds) {
+    conn_id = ss::connection_registry.add(this);
 }
 
 connection::~connection() {
+    // make sure any background connection attempt has finished
+    if (async_pending) {
+        AutoLocker al(async_lock);
+        while (!async_done)
+            async_cond.wait(&async_lock);
+        async_xsink.clear();
+    }
+
+    discardStandby();
+
+    ss::connection_registry.remove(conn_id);
+
     invalidateStatement();
+    spare_cmd.reset();
+    dropCommandPool();
     CS_RETCODE ret = CS_SUCCEED;
 
     if (m_connection) {
@@ -69,14 +262,16 @@ connection::~connection() {
 // FIXME: check for auto-reconnect here if ct_command fails
 int connection::direct_execute(const char* sql_text, ExceptionSink* xsink) {
     assert(sql_text && sql_text[0]);
+    if (waitConnected(xsink))
+        return -1;
 
     CS_COMMAND* cmd = 0;
 
-    CS_RETCODE err = ct_cmd_alloc(m_connection, &cmd);
+    CS_RETCODE err = allocCommand(cmd);
     if (err != CS_SUCCEED)
         do_exception(xsink, "TDS-EXEC-ERROR", "ct_cmd_alloc() failed");
 
-    ON_BLOCK_EXIT(ct_cmd_drop, cmd);
+    ON_BLOCK_EXIT_OBJ(*this, &connection::releaseCommand, cmd);
     ScopeGuard canceller = MakeGuard(ct_cancel, (CS_CONNECTION*)0, cmd, CS_CANCEL_ALL);
 
     err = ct_command(cmd, CS_LANG_CMD, (CS_CHAR*)sql_text, strlen(sql_text), CS_END);
@@ -114,6 +309,62 @@ static inline bool wasInTransaction(Datasource *ds) {
 #endif
 }
 
+CS_RETCODE connection::allocCommand(CS_COMMAND*& cmd) {
+    if (!cmd_pool.empty()) {
+        cmd = cmd_pool.back();
+        cmd_pool.pop_back();
+        return CS_SUCCEED;
+    }
+    return ct_cmd_alloc(m_connection, &cmd);
+}
+
+void connection::releaseCommand(CS_COMMAND* cmd) {
+    if (cmd_pool.size() < SYBASE_COMMAND_POOL_SIZE)
+        cmd_pool.push_back(cmd);
+    else
+        ct_cmd_drop(cmd);
+}
+
+void connection::dropCommandPool() {
+    for (CS_COMMAND* cmd : cmd_pool)
+        ct_cmd_drop(cmd);
+    cmd_pool.clear();
+}
+
+sybase_query* connection::newQuery() {
+    if (spare_query) {
+        spare_query->reset();
+        return spare_query.release();
+    }
+    return new sybase_query;
+}
+
+void connection::recycleQuery(sybase_query* query) {
+    if (spare_query)
+        delete query;
+    else
+        spare_query.reset(query);
+}
+
+command* connection::newCommand(ExceptionSink* xsink) {
+    if (!spare_cmd)
+        return new command(*this, xsink);
+    command* cmd = spare_cmd.release();
+    cmd->reinit(xsink);
+    return cmd;
+}
+
+void connection::recycleCommand(command* cmd) {
+    if (spare_cmd) {
+        delete cmd;
+        return;
+    }
+    // the command is deleted if clearing it fails
+    std::unique_ptr<command> holder(cmd);
+    cmd->clear();
+    spare_cmd = std::move(holder);
+}
+
 bool connection::ping() const {
     // check if the connection is up
     CS_INT up;
@@ -123,23 +374,115 @@ bool connection::ping() const {
     return (rc == CS_SUCCEED) && (up == CS_CONSTAT_CONNECTED);
 }
 
+bool connection::validate() {
+    CS_COMMAND* cmd = nullptr;
+    if (allocCommand(cmd) != CS_SUCCEED)
+        return false;
+    ON_BLOCK_EXIT_OBJ(*this, &connection::releaseCommand, cmd);
+
+    static const char sql[] = "select 1";
+    bool ok = ct_command(cmd, CS_LANG_CMD, (CS_CHAR*)sql, sizeof(sql) - 1, CS_END) == CS_SUCCEED
+        && ct_send(cmd) == CS_SUCCEED;
+    if (ok) {
+        CS_INT result_type;
+        CS_RETCODE err;
+        while ((err = ct_results(cmd, &result_type)) == CS_SUCCEED) {
+            if (result_type == CS_ROW_RESULT)
+                ct_cancel(nullptr, cmd, CS_CANCEL_CURRENT);
+            else if (result_type == CS_CMD_FAIL)
+                ok = false;
+        }
+        if (err != CS_END_RESULTS)
+            ok = false;
+    }
+    if (!ok)
+        ct_cancel(nullptr, cmd, CS_CANCEL_ALL);
+
+    discard_messages();
+    if (ok)
+        last_activity = q_clock_getmillis();
+    printd(5, "connection::validate() this: %p ok: %d\n", this, ok);
+    return ok;
+}
+
+void connection::setKeepalive() {
+#ifdef CS_ENDPOINT
+    // the socket is only available after connecting
+    CS_INT fd = -1;
+    if (ct_con_props(m_connection, CS_GET, CS_ENDPOINT, &fd, CS_UNUSED, 0) != CS_SUCCEED || fd < 0) {
+        printd(5, "connection::setKeepalive() this: %p cannot get the socket\n", this);
+        return;
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    int secs = keepalive;
+#if defined(TCP_KEEPIDLE)
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &secs, sizeof(secs));
+#elif defined(TCP_KEEPALIVE)
+    // macOS
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPALIVE, &secs, sizeof(secs));
+#endif
+#ifdef TCP_KEEPINTVL
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &secs, sizeof(secs));
+#endif
+#endif
+}
+
 command* connection::setupCommand(const QoreString* cmd_text, const QoreListNode* args, bool raw,
-        ExceptionSink* xsink) {
+        ExceptionSink* xsink, ss::BindPlan* plan, bool cursor) {
+    if (waitConnected(xsink))
+        return nullptr;
+
+    // a connection that has been idle for a while is checked with a round trip first, so a dead connection is
+    // reestablished before the command is sent instead of after it fails
+    if (validate_idle && !pending_cmds && last_activity
+        && (q_clock_getmillis() - last_activity) >= validate_idle) {
+        ++ss::validation_stats.validations;
+        if (!validate()) {
+            ++ss::validation_stats.failures;
+            if (closeAndReconnectIntern(xsink, true))
+                return nullptr;
+        }
+    }
+
     while (true) {
-        std::unique_ptr<sybase_query> query(new sybase_query);
+        std::unique_ptr<sybase_query> query(newQuery());
         if (!raw) {
-            if (query->init(cmd_text, args, xsink))
+            // simple stored procedure calls are sent as RPC commands if possible
+            if ((!rpc_exec || !query->init_rpc(cmd_text)) && query->init(cmd_text, args, xsink))
                 return nullptr;
         } else {
             assert(!args);
             query->init(cmd_text);
         }
 
-        std::unique_ptr<command> cmd(new command(*this, xsink));
-        cmd->bind_query(query, args, xsink);
+        // output placeholders without values are bound with the types of the procedure's parameters
+        if (query->rpc)
+            setOutputTypes(*query);
+
+        // select statements are declared as cursors so that the rows are fetched from the server in batches
+        bool use_cursor = cursor && cursor_statements && query->isSelect();
+
+        // the commit that Qore sends after the command in autocommit mode is sent in the same batch; only single
+        // DML statements qualify, as a commit cannot follow DDL like "create procedure" in the same batch
+        bool commit_appended = false;
+        if (!raw && !use_cursor && commitInBatch() && query->isSingleDml()) {
+            query->m_cmd.concat("\ncommit");
+            commit_appended = true;
+        }
+
+        command_ptr cmd(newCommand(xsink));
+        cmd->setCommitAppended(commit_appended);
+        if (use_cursor) {
+            QoreString name;
+            name.sprintf("qore_csr_%u", ++cursor_seq);
+            cmd->setCursor(name.c_str(), cursor_updatable, cursor_rows);
+        }
+        cmd->bind_query(query, args, plan ? *plan : bind_plans.get(*query), xsink);
 
         try {
             cmd->send(xsink);
+            last_activity = q_clock_getmillis();
         } catch (const ss::Error& e) {
             // if the connection is down and we can reconnect transparently, then we do so
             if (!ping() && !closeAndReconnect(xsink, *cmd.get(), true))
@@ -150,43 +493,327 @@ command* connection::setupCommand(const QoreString* cmd_text, const QoreListNode
     }
 }
 
+void connection::setOutputTypes(sybase_query& query) {
+    const proc_param_list_t* pl = nullptr;
+    for (unsigned i = 0, n = query.rpc_params.size(); i < n; ++i) {
+        rpc_param& param = query.rpc_params[i];
+        if (!param.output || param.arg >= 0)
+            continue;
+        if (!pl)
+            pl = &getProcParams(query.rpc_proc);
+
+        // named parameters are matched by name, positional parameters by position
+        const proc_param* pp = nullptr;
+        if (param.name.empty()) {
+            if (i < pl->size())
+                pp = &(*pl)[i];
+        } else {
+            for (auto& j : *pl) {
+                if (!strcasecmp(j.name.c_str(), param.name.c_str())) {
+                    pp = &j;
+                    break;
+                }
+            }
+        }
+        if (pp) {
+            param.type = pp->type;
+            param.type_arg1 = pp->arg1;
+            param.type_arg2 = pp->arg2;
+        }
+    }
+}
+
+// returns the value of the key in the hash ignoring case, as the case of the column names returned by
+// sp_sproc_columns depends on the server
+static QoreValue get_key_ci(const QoreHashNode* h, const char* key) {
+    ConstHashIterator hi(h);
+    while (hi.next()) {
+        if (!strcasecmp(hi.getKey(), key))
+            return hi.get();
+    }
+    return QoreValue();
+}
+
+const connection::proc_param_list_t& connection::getProcParams(const std::string& proc) {
+    static const proc_param_list_t no_params;
+
+    std::map<std::string, proc_param_list_t>::iterator i = proc_params.find(proc);
+    if (i != proc_params.end())
+        return i->second;
+
+    // sp_sproc_columns takes the procedure name and owner separately; procedures in other databases are not looked up
+    std::string name = proc, owner;
+    size_t dot = proc.rfind('.');
+    if (dot != std::string::npos) {
+        name = proc.substr(dot + 1);
+        owner = proc.substr(0, dot);
+        if (owner.find('.') != std::string::npos)
+            return no_params;
+    }
+    if (name.empty() || name.find('\'') != std::string::npos || owner.find('\'') != std::string::npos)
+        return no_params;
+
+    proc_param_list_t pl;
+
+    QoreString sql;
+    sql.sprintf("exec sp_sproc_columns @procedure_name = '%s'", name.c_str());
+    if (!owner.empty())
+        sql.sprintf(", @procedure_owner = '%s'", owner.c_str());
+
+    // errors are ignored; output placeholders are then bound as strings
+    ExceptionSink xsink;
+    try {
+        std::unique_ptr<sybase_query> query(newQuery());
+        query->init(&sql);
+        command_ptr cmd(newCommand(&xsink));
+        if (cmd) {
+            ss::BindPlan plan;
+            cmd->bind_query(query, nullptr, plan, &xsink);
+            if (!xsink)
+                cmd->send(&xsink);
+        }
+        while (!xsink) {
+            // the connection is not reconnected here; the command itself will fail if it was lost
+            bool disconnect = false;
+            command::ResType rt = cmd->read_next_result(disconnect, &xsink);
+            if (xsink || disconnect || rt == command::RES_END)
+                break;
+            if (rt == command::RES_ROW) {
+                while (true) {
+                    ReferenceHolder<QoreHashNode> h(cmd->fetch_row(&xsink), &xsink);
+                    if (!h)
+                        break;
+                    QoreStringValueHelper pname(get_key_ci(*h, "column_name"));
+                    // the return value is not a parameter
+                    if (pname->empty() || !strcasecmp(pname->c_str(), "@RETURN_VALUE"))
+                        continue;
+                    QoreStringValueHelper tname(get_key_ci(*h, "type_name"));
+                    proc_param pp;
+                    pp.name = pname->c_str();
+                    pp.type = tname->c_str();
+                    pp.arg1 = (int)get_key_ci(*h, "precision").getAsBigInt();
+                    pp.arg2 = (int)get_key_ci(*h, "scale").getAsBigInt();
+                    pl.push_back(pp);
+                }
+            } else if (rt == command::RES_PARAM || rt == command::RES_STATUS) {
+                while (cmd->fetch_row_into_buffers(&xsink)) {}
+            } else if (rt != command::RES_DONE) {
+                break;
+            }
+        }
+    } catch (const ss::Error& e) {
+        e.raise(&xsink);
+    }
+    if (xsink) {
+        printd(5, "connection::getProcParams() cannot read the parameters of procedure %s\n", proc.c_str());
+        xsink.clear();
+        discard_messages();
+        return no_params;
+    }
+    // failures and procedures that do not exist (yet) are not cached, so the metadata is read again next time
+    if (pl.empty())
+        return no_params;
+    return proc_params[proc] = std::move(pl);
+}
+
+void connection::invalidateProcParams(command& cmd) {
+    const char* proc = cmd.getRpcProc();
+    if (proc)
+        proc_params.erase(proc);
+}
+
+bool connection::canRetryDeadlock(const QoreString* cmd_text) const {
+    // the server rolls back the victim's whole transaction, so replaying only this command in a user transaction
+    // would commit a partial transaction; a retry is only safe if the command is its own transaction
+    if (!ds->getAutoCommit() || explicit_tran || wasInTransaction(ds))
+        return false;
+    // in native autocommit mode, the statements of a batch before the victim have already been committed
+    std::string keyword;
+    return !native_autocommit || sybase_query::isSingleStatement(cmd_text->c_str(), keyword);
+}
+
 QoreValue connection::execReadOutput(QoreString* cmd_text, const QoreListNode* qore_args, bool need_list,
         bool doBinding, bool cols, ExceptionSink* xsink, bool single_row) {
-    // cancel any active statement
-    invalidateStatement();
+    if (!deadlock_retries)
+        return execReadOutputIntern(cmd_text, qore_args, need_list, doBinding, cols, xsink, single_row);
+
+    // determined before the command is executed, as the transaction state changes when it is executed
+    bool can_retry = canRetryDeadlock(cmd_text);
+    for (int retry = 0; ; ++retry) {
+        deadlock = false;
+        try {
+            ValueHolder rv(execReadOutputIntern(cmd_text, qore_args, need_list, doBinding, cols, xsink, single_row),
+                xsink);
+            if (!*xsink) {
+                if (retry)
+                    ++ss::deadlock_stats.recovered;
+                return rv.release();
+            }
+            if (!deadlock)
+                return QoreValue();
+        } catch (const ss::Error& e) {
+            if (!deadlock)
+                throw;
+            e.raise(xsink);
+        }
+
+        ++ss::deadlock_stats.deadlocks;
+        if (!can_retry || retry >= deadlock_retries) {
+            if (can_retry)
+                ++ss::deadlock_stats.exhausted;
+            else
+                ++ss::deadlock_stats.not_retried;
+            return QoreValue();
+        }
+
+        xsink->clear();
+        ++ss::deadlock_stats.retries;
+        int64 ms = ss::get_backoff(deadlock_backoff, SYBASE_MAX_DEADLOCK_BACKOFF, retry + 1);
+        printd(5, "connection::execReadOutput() this: %p deadlock victim; retry %d in " QLLD " ms\n", this,
+            retry + 1, ms);
+        if (ms)
+            std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+}
+
+QoreValue connection::execReadOutputIntern(QoreString* cmd_text, const QoreListNode* qore_args, bool need_list,
+        bool doBinding, bool cols, ExceptionSink* xsink, bool single_row) {
+    // buffer or cancel any active statement
+    releaseStatement();
 
-    std::unique_ptr<command> cmd(setupCommand(cmd_text, qore_args, !doBinding, xsink));
+    // cancels the command from the watchdog thread if it exceeds the command timeout
+    ss::CommandTimer timer(*this, command_timeout, xsink);
+    command_ptr cmd;
 
     bool connection_reset = false;
 
     ValueHolder result(xsink);
 
-    while (true) {
-        result = cmd->readOutput(*this, *cmd.get(), need_list, connection_reset, cols, xsink, single_row);
-        if (*xsink)
+    try {
+        cmd.reset(setupCommand(cmd_text, qore_args, !doBinding, xsink));
+        if (!cmd)
             return QoreValue();
 
-        if (connection_reset) {
-            connection_reset = false;
-            continue;
+        while (true) {
+            result = cmd->readOutput(*this, *cmd.get(), need_list, connection_reset, cols, xsink, single_row);
+            if (*xsink)
+                break;
+
+            if (connection_reset) {
+                connection_reset = false;
+                continue;
+            }
+
+            break;
         }
+    } catch (const ss::Error& e) {
+        if (!timer.stop())
+            throw;
+    }
 
-        break;
+    if (timer.stop()) {
+        handleCommandTimeout(cmd.get(), xsink);
+        return QoreValue();
     }
 
+    if (*xsink)
+        return QoreValue();
+
     return result.release();
 }
 
+void connection::releaseStatement() {
+    if (!stmt)
+        return;
+
+    // a statement with an open cursor does not block the connection
+    if (stmt->isValid() && stmt->isCursor()) {
+        cursor_stmts.insert(stmt);
+        stmt = nullptr;
+        return;
+    }
+
+    if (buffer_statements && stmt->isValid()) {
+        // errors reading the statement's rows are not raised here; the statement is invalidated instead
+        ExceptionSink xsink;
+        if (!stmt->buffer(this, statement_buffer_memory, &xsink)) {
+            // the statement no longer needs the connection
+            stmt = nullptr;
+            return;
+        }
+        xsink.clear();
+        // the statement may have been invalidated if the connection was lost
+        if (!stmt)
+            return;
+    }
+
+    invalidateStatement();
+}
+
+void connection::handleCommandTimeout(command* cmd, ExceptionSink* xsink) {
+    // discard the errors caused by the cancel
+    xsink->clear();
+
+    // the connection is closed and reopened so that no partial results remain
+    if (cmd && (*cmd)())
+        closeAndReconnect(xsink, *cmd, false);
+    else
+        closeAndReconnectIntern(xsink, false);
+
+    xsink->raiseException("TDS-COMMAND-TIMEOUT", "the command was canceled after exceeding the command timeout of "
+        "%d ms", command_timeout);
+}
+
+int connection::cancel() {
+    AutoLocker al(cancel_lock);
+    if (!m_connection || !connected)
+        return -1;
+    // CS_CANCEL_ATTN is the only cancel type that may be sent while another thread is using the connection
+    return ct_cancel(m_connection, nullptr, CS_CANCEL_ATTN) == CS_SUCCEED ? 0 : -1;
+}
+
+int connection::setLockTimeout(ExceptionSink* xsink) {
+    assert(lock_timeout >= 0);
+    QoreString sql;
+    if (sybase) {
+        // Sybase takes the lock wait time in seconds
+        sql.sprintf("set lock wait %d", (lock_timeout + 999) / 1000);
+    } else {
+        sql.sprintf("set lock_timeout %d", lock_timeout);
+    }
+    return direct_execute(sql.c_str(), xsink);
+}
+
 int connection::closeAndReconnect(ExceptionSink* xsink, command& cmd, bool try_reconnect) {
     // cancel the current command
     cmd.cancelDisconnect();
 
+    return closeAndReconnectIntern(xsink, try_reconnect);
+}
+
+int connection::closeAndReconnectIntern(ExceptionSink* xsink, bool try_reconnect) {
+    // a standby connection is not reconnected; it is discarded instead
+    if (is_standby) {
+        xsink->raiseException("TDS-CONNECTION-ERROR", "standby connection lost");
+        return -1;
+    }
+
     // cancel any current statement
     invalidateStatement();
 
+    // free command handles belong to the old connection handle
+    dropCommandPool();
+    // any transaction is lost with the connection
+    trans_open = false;
+    explicit_tran = false;
+
     // see if we need to reconnect and try again
-    ct_close(m_connection, CS_FORCE_CLOSE);
-    connected = false;
+    {
+        // the lock is held while the handle is closed so that cancel() cannot use the connection being closed
+        AutoLocker al(cancel_lock);
+        connected = false;
+        ct_close(m_connection, CS_FORCE_CLOSE);
+    }
 
     // discard all current messages
     discard_messages();
@@ -196,8 +823,11 @@ int connection::closeAndReconnect(ExceptionSink* xsink, command& cmd, bool try_r
             "transaction has been lost");
 
     // otherwise try to reconnect
-    ct_con_drop(m_connection);
-    m_connection = nullptr;
+    {
+        AutoLocker al(cancel_lock);
+        ct_con_drop(m_connection);
+        m_connection = nullptr;
+    }
 
     int port = ds->getPort();
 
@@ -205,8 +835,11 @@ int connection::closeAndReconnect(ExceptionSink* xsink, command& cmd, bool try_r
         ds->getUsername(), ds->getDBName(), wasInTransaction(ds), try_reconnect);
 
     // make the actual connection to the database
-    if (init(ds->getUsername(), ds->getPassword() ? ds->getPassword() : "", ds->getDBName(), ds->getDBEncoding(),
-        ds->getQoreEncoding(), ds->getHostName(), port, xsink)) {
+    if (failover.empty()
+        ? init(ds->getUsername(), ds->getPassword() ? ds->getPassword() : "", ds->getDBName(),
+            ds->getDBEncoding(), ds->getQoreEncoding(), ds->getHostName(), port, xsink)
+        : connectFailover(ds->getUsername(), ds->getPassword() ? ds->getPassword() : "", ds->getDBName(),
+            ds->getDBEncoding(), ds->getQoreEncoding(), ds->getHostName(), port, xsink)) {
         // make sure and mark Datasource as closed
         ds->connectionAborted();
         return -1;
@@ -238,7 +871,15 @@ command::ResType connection::readNextResult(command& cmd, bool& connection_reset
 
         bool disconnect = false;
 
-        command::ResType rc = cmd.read_next_result(disconnect, xsink);
+        command::ResType rc;
+        try {
+            rc = cmd.read_next_result(disconnect, xsink);
+        } catch (const ss::Error&) {
+            invalidateProcParams(cmd);
+            throw;
+        }
+        if (*xsink)
+            invalidateProcParams(cmd);
         if (!disconnect)
             return rc;
 
@@ -334,6 +975,64 @@ QoreValue connection::select(const QoreString *cmd, const QoreListNode* args, Ex
     return rv.release();
 }
 
+QoreValue connection::routeSelect(select_type_t type, const QoreString* cmd, const QoreListNode* args,
+        bool& routed, ExceptionSink* xsink) {
+    routed = false;
+    if (replicas.empty() || wasInTransaction(ds) || !ss::is_read_only_select(cmd))
+        return QoreValue();
+
+    ss::ReplicaEndpoint* ep = replicas.choose(ds);
+    if (!ep)
+        return QoreValue();
+
+    // errors connecting to the replica are not raised; the select is executed on the primary instead
+    ExceptionSink rxsink;
+    Datasource* rds = ep->acquire(ds, &rxsink);
+    if (!rds) {
+        printd(5, "connection::routeSelect() replica %s:%d not available; using the primary\n", ep->host.c_str(),
+            ep->port);
+        return QoreValue();
+    }
+
+    connection* rc = (connection*)rds->getPrivateData();
+    ValueHolder rv(&rxsink);
+    try {
+        switch (type) {
+            case SELECT:
+                rv = rc->select(cmd, args, &rxsink);
+                break;
+            case SELECT_ROWS:
+                rv = rc->exec_rows(cmd, args, &rxsink);
+                break;
+            case SELECT_ROW:
+                rv = rc->exec_row(cmd, args, &rxsink);
+                break;
+        }
+        // end the chained transaction started by the select on the replica
+        if (!rxsink)
+            rc->commit(&rxsink);
+    } catch (const ss::Error& e) {
+        e.raise(&rxsink);
+    }
+
+    if (rxsink) {
+        // if the replica connection was lost, the select is executed on the primary
+        bool lost = rds->wasConnectionAborted() || !rc->ping();
+        ep->release(rds, !lost);
+        if (lost) {
+            rxsink.clear();
+            return QoreValue();
+        }
+        routed = true;
+        xsink->assimilate(rxsink);
+        return QoreValue();
+    }
+
+    ep->release(rds, true);
+    routed = true;
+    return rv.release();
+}
+
 QoreValue connection::exec(const QoreString *cmd, const QoreListNode* args, ExceptionSink *xsink) {
     // copy the string here for intrusive editing, convert encoding too if necessary
     QoreString *query = cmd->convertEncoding(enc, xsink);
@@ -387,19 +1086,74 @@ QoreValue connection::exec_row(const QoreString *cmd, const QoreListNode *parame
 
 // returns 0=OK, -1=error (exception raised)
 int connection::commit(ExceptionSink *xsink) {
+    if (waitConnected(xsink))
+        return -1;
+    // skip the round trip if there is nothing to commit; in native autocommit mode, only explicit transactions
+    // need to be committed
+    if ((native_autocommit && !explicit_tran) || (!trans_open && !pending_cmds)) {
+        ++ss::transaction_stats.commits_skipped;
+        return 0;
+    }
     // first clear any pending results in case a statement was in progress (does not clear any actions already effected with exec())
-    ct_cancel(m_connection, 0, CS_CANCEL_ALL);
-    return direct_execute("commit", xsink);
+    cancelPending();
+    ++ss::transaction_stats.commits;
+    if (direct_execute("commit", xsink))
+        return -1;
+    trans_open = false;
+    explicit_tran = false;
+    return 0;
 }
 
 // returns 0=OK, -1=error (exception raised)
 int connection::rollback(ExceptionSink *xsink) {
+    if (waitConnected(xsink))
+        return -1;
+    // skip the round trip if there is nothing to roll back
+    if ((native_autocommit && !explicit_tran) || (!trans_open && !pending_cmds)) {
+        ++ss::transaction_stats.rollbacks_skipped;
+        return 0;
+    }
     // first clear any pending results in case a statement was in progress
-    ct_cancel(m_connection, 0, CS_CANCEL_ALL);
-    return direct_execute("rollback", xsink);
+    cancelPending();
+    ++ss::transaction_stats.rollbacks;
+    // the transaction is finished even if the rollback fails
+    explicit_tran = false;
+    if (direct_execute("rollback", xsink))
+        return -1;
+    trans_open = false;
+    return 0;
 }
 
-#define CHAR_ENC_SIZE 256
+// returns 0=OK, -1=error (exception raised)
+int connection::begin_transaction(ExceptionSink *xsink) {
+    // in chained mode, the server starts transactions implicitly
+    if (!native_autocommit || explicit_tran)
+        return 0;
+    if (waitConnected(xsink))
+        return -1;
+    if (direct_execute("begin tran", xsink))
+        return -1;
+    explicit_tran = true;
+    trans_open = true;
+    return 0;
+}
+
+bool connection::commitInBatch() const {
+    // only in autocommit mode, where Qore would otherwise send a commit after the command
+    return commit_in_batch && !native_autocommit && ds->getAutoCommit() && !wasInTransaction(ds);
+}
+
+void connection::cancelPending() {
+    // a cancel requires a round trip to the server, so it's only sent if there are unread results
+    if (!pending_cmds) {
+        ++ss::cancel_stats.skipped;
+        return;
+    }
+    ++ss::cancel_stats.canceled;
+    ct_cancel(m_connection, 0, CS_CANCEL_ALL);
+}
+
+#define CHAR_ENC_SIZE 256
 
 // Post-constructor initialization
 int connection::init(const char* username,
@@ -411,40 +1165,45 @@ int connection::init(const char* username,
                      int port,
                      ExceptionSink* xsink) {
     assert(!m_connection);
+    host_unreachable = false;
     printd(5, "connection::init() user: %s pass: %s dbname: %s, db_enc: %s\n", username,
         password ? password : "<n/a>", dbname, db_encoding ? db_encoding : "<n/a>");
 
     enc = n_enc;
 
-    /*
-    // add callbacks
-    ret = ct_callback(m_context, 0, CS_SET, CS_CLIENTMSG_CB, (CS_VOID*)clientmsg_callback);
+    CS_CONNECTION* conn = nullptr;
+    CS_RETCODE ret = ct_con_alloc(m_context.get_context(), &conn);
     if (ret != CS_SUCCEED) {
-        xsink->raiseException("TDS-CTLIB-SET-CALLBACK", "ct_callback(CS_CLIENTMSG_CB) failed with error %d", ret);
+        xsink->raiseException("TDS-CTLIB-CREATE-CONNECTION", "ct_con_alloc() failed with error %d", ret);
         return -1;
     }
-    ret = ct_callback(m_context, 0, CS_SET, CS_SERVERMSG_CB, (CS_VOID*)servermsg_callback);
+    {
+        // the connection handle is read by cancel() in other threads
+        AutoLocker al(cancel_lock);
+        m_connection = conn;
+    }
+
+    // messages are delivered by callbacks into the connection's message ring; the callbacks find the connection
+    // object with the user data pointer
+    connection* self = this;
+    ret = ct_con_props(m_connection, CS_SET, CS_USERDATA, &self, sizeof(self), 0);
     if (ret != CS_SUCCEED) {
-        xsink->raiseException("TDS-CTLIB-SET-CALLBACK", "ct_callback(CS_SERVERMSG_CB) failed with error %d", ret);
+        xsink->raiseException("TDS-CTLIB-SET-USERDATA", "ct_con_props(CS_USERDATA) failed with error %d", ret);
         return -1;
     }
-    */
-
-    CS_RETCODE ret = ct_con_alloc(m_context.get_context(), &m_connection);
+    ret = ct_callback(0, m_connection, CS_SET, CS_CLIENTMSG_CB, (CS_VOID*)clientmsg_callback);
     if (ret != CS_SUCCEED) {
-        xsink->raiseException("TDS-CTLIB-CREATE-CONNECTION", "ct_con_alloc() failed with error %d", ret);
+        xsink->raiseException("TDS-CTLIB-SET-CALLBACK", "ct_callback(CS_CLIENTMSG_CB) failed with error %d", ret);
         return -1;
     }
-
-    // set inline message handling
-    ret = ct_diag(m_connection, CS_INIT, CS_UNUSED, CS_UNUSED, 0);
+    ret = ct_callback(0, m_connection, CS_SET, CS_SERVERMSG_CB, (CS_VOID*)servermsg_callback);
     if (ret != CS_SUCCEED) {
-        xsink->raiseException("TDS-CTLIB-INIT-ERROR-HANDLING-ERROR", "ct_diag(CS_INIT) failed with error %d, unable to initialize inline error handling", ret);
+        xsink->raiseException("TDS-CTLIB-SET-CALLBACK", "ct_callback(CS_SERVERMSG_CB) failed with error %d", ret);
         return -1;
     }
 
-    // set login timeout to 60 seconds
-    CS_INT timeout = 60;
+    // set the login timeout
+    CS_INT timeout = connect_timeout;
     ret = ct_con_props(m_connection, CS_SET, CS_LOGIN_TIMEOUT, &timeout, CS_UNUSED, 0);
     if (ret != CS_SUCCEED) {
         xsink->raiseException("TDS-CTLIB-SET-LOGIN-TIMEOUT", "ct_con_props(CS_LOGIN_TIMEOUT) failed with error %d", ret);
@@ -477,27 +1236,22 @@ int connection::init(const char* username,
         }
     }
 
-#if defined(SYBASE) || defined(FREETDS_LOCALE)
-    CS_LOCALE* m_charset_locale = nullptr;
-
-    ret = cs_loc_alloc(m_context.get_context(), &m_charset_locale);
-    if (ret != CS_SUCCEED) {
-        xsink->raiseException("TDS-EXEC-EXCEPTION", "cs_loc_alloc() returned error %d", (int)ret);
-        return -1;
-    }
-    ON_BLOCK_EXIT(cs_loc_drop, m_context.get_context(), m_charset_locale);
-    ret = cs_locale(m_context.get_context(), CS_SET, m_charset_locale, CS_LC_ALL, 0, CS_NULLTERM, 0);
-    if (ret != CS_SUCCEED) {
-        xsink->raiseException("TDS-EXEC-EXCEPTION", "cs_locale(CS_LC_ALL) returned error %d", (int)ret);
-        return -1;
+    // request a larger TDS packet size; the server may negotiate a smaller value
+    if (packet_size) {
+        CS_INT size = packet_size;
+        ret = ct_con_props(m_connection, CS_SET, CS_PACKETSIZE, &size, CS_UNUSED, 0);
+        if (ret != CS_SUCCEED) {
+            xsink->raiseException("TDS-CTLIB-SET-PACKETSIZE", "ct_con_props(CS_PACKETSIZE, %d) failed with error %d",
+                packet_size, ret);
+            return -1;
+        }
     }
-    ret = cs_locale(m_context.get_context(), CS_SET, m_charset_locale, CS_SYB_CHARSET, (CS_CHAR*)db_encoding,
-        CS_NULLTERM, 0);
-    if (ret != CS_SUCCEED) {
-        xsink->raiseException("TDS-EXEC-EXCEPTION", "cs_locale(CS_SYB_CHARSET, '%s') failed with error %d",
-            db_encoding, (int)ret);
+
+#ifdef SYB_HAVE_LOCALE
+    // the locale is copied to the connection, so the cached locale for the character set can be shared
+    CS_LOCALE* m_charset_locale = m_context->get_locale(db_encoding, xsink);
+    if (!m_charset_locale)
         return -1;
-    }
     ret = ct_con_props(m_connection, CS_SET, CS_LOC_PROP, m_charset_locale, CS_UNUSED, 0);
     if (ret !=CS_SUCCEED) {
         xsink->raiseException("TDS-EXEC-EXCEPTION", "ct_con_props(CS_SET, CS_LOC_PROP) failed with error %d",
@@ -506,18 +1260,56 @@ int connection::init(const char* username,
     }
 #endif
 
+#ifdef CS_CON_KEEPALIVE
+    if (keepalive > 0) {
+        CS_BOOL cs_keepalive = CS_TRUE;
+        ret = ct_con_props(m_connection, CS_SET, CS_CON_KEEPALIVE, &cs_keepalive, CS_UNUSED, 0);
+        if (ret != CS_SUCCEED) {
+            xsink->raiseException("TDS-CTLIB-SET-KEEPALIVE", "ct_con_props(CS_CON_KEEPALIVE) failed with error %d",
+                ret);
+            return -1;
+        }
+    }
+#endif
+
+    server_replied = false;
     ret = ct_connect(m_connection, (CS_CHAR*)dbname, strlen(dbname));
     if (ret != CS_SUCCEED) {
+        // a login timeout or network error; the server has not sent a login error
+        host_unreachable = !server_replied;
         do_exception(xsink, "TDS-CTLIB-CONNECT-ERROR", "ct_connect() failed with error %d", ret);
     }
-    connected = true;
+    {
+        AutoLocker al(cancel_lock);
+        connected = true;
+    }
+    last_activity = q_clock_getmillis();
+
+    if (keepalive > 0)
+        setKeepalive();
+
+    // get the packet size actually negotiated with the server
+    {
+        CS_INT size = 0;
+        if (ct_con_props(m_connection, CS_GET, CS_PACKETSIZE, &size, CS_UNUSED, 0) == CS_SUCCEED && size > 0) {
+            packet_size_negotiated = size;
+            if (packet_size && size != packet_size) {
+                printd(5, "connection::init() requested packet size %d, server negotiated %d\n", packet_size,
+                    (int)size);
+            }
+        }
+    }
 
     // turn on chained transaction mode, this fits with Qore's transaction management approach
     // - in autocommit mode qore executes a commit after every request manually
+    // - in native autocommit mode, the server commits each statement and transactions are started explicitly
+    //   with "begin tran"
     CS_BOOL cs_bool = CS_TRUE;
-    ret = ct_options(m_connection, CS_SET, CS_OPT_CHAINXACTS, &cs_bool, CS_UNUSED, 0);
-    if (ret != CS_SUCCEED) {
-        do_exception(xsink, "TDS-INIT-ERROR", "ct_options(CS_OPT_CHAINXACTS) failed");
+    if (!native_autocommit) {
+        ret = ct_options(m_connection, CS_SET, CS_OPT_CHAINXACTS, &cs_bool, CS_UNUSED, 0);
+        if (ret != CS_SUCCEED) {
+            do_exception(xsink, "TDS-INIT-ERROR", "ct_options(CS_OPT_CHAINXACTS) failed");
+        }
     }
 
     // returns up to 1MB images or text values
@@ -527,14 +1319,6 @@ int connection::init(const char* username,
         do_exception(xsink, "TDS-INIT-ERROR", "ct_options(CS_OPT_TEXTSIZE) failed");
     }
 
-    // Set default type of string representation of DATETIME to long (like Jan 1 1990 12:32:55:0000 PM)
-    // Without this some routines in conversions.cpp would fail.
-    CS_INT aux = CS_DATES_LONG;
-    ret = cs_dt_info(m_context.get_context(), CS_SET, NULL, CS_DT_CONVFMT, CS_UNUSED, (CS_VOID*)&aux, sizeof(aux), 0);
-    if (ret != CS_SUCCEED) {
-        do_exception(xsink, "TDS-INIT-ERROR", "cs_dt_info(CS_DT_CONVFMT) failed");
-    }
-
     // issue #4710: determine DB character encoding
     cs_bool = CS_FALSE;
     ret = ct_con_props(m_connection, CS_SET, CS_CHARSETCNV, &cs_bool, CS_UNUSED, 0);
@@ -544,194 +1328,507 @@ int connection::init(const char* username,
 
     if (!cs_bool) {
         // issue #4710: determine DB character encoding
-        // see if we have Sybase or MS SQL
-        ValueHolder v(get_server_version(xsink), xsink);
-        if (!*xsink) {
-            if (v->getType() == NT_STRING) {
-                const QoreStringNode* str = v->get<const QoreStringNode>();
-                if (str->find("Adaptive Server") >= 0) {
-                    sybase = true;
+        // the server metadata is cached to avoid the round trips needed to determine it on every connect
+        std::string key = ss::ServerInfoCache::getKey(hostname, port, dbname);
+        if (ss::server_info_cache.get(key, server_info)) {
+            printd(5, "connection::init() using cached server info for %s\n", key.c_str());
+            have_server_info = true;
+            sybase = server_info.sybase;
+            if (server_info.enc)
+                enc = server_info.enc;
+        } else {
+            have_server_info = false;
+            server_info = ss::ServerInfo();
+            // see if we have Sybase or MS SQL
+            ValueHolder v(get_server_version(xsink), xsink);
+            if (!*xsink) {
+                if (v->getType() == NT_STRING) {
+                    const QoreStringNode* str = v->get<const QoreStringNode>();
+                    server_info.version = str->c_str();
+                    if (str->find("Adaptive Server") >= 0) {
+                        sybase = true;
+                    }
                 }
-            }
 
-            // issue #4710: determine DB character encoding
-            if (!sybase) {
-                QoreString sql("select convert(varchar, serverproperty('collation')) as 'coll'");
-                ValueHolder holder(exec_row(&sql, nullptr, xsink), xsink);
-                if (holder->getType() == NT_HASH) {
-                    const QoreStringNode* coll = holder->get<const QoreHashNode>()
-                        ->getKeyValue("coll")
-                        .get<const QoreStringNode>();
-                    assert(coll);
-                    printd(5, "MS SQL Server collation: '%s'\n", coll->c_str());
-                    QoreString c(coll);
-                    c.tolwr();
-                    if (c.find("utf8") >= 0) {
-                        // set character encoding to UTF-8
-                        enc = QCS_UTF8;
-                    } else {
-                        sql = "select cast(collationproperty(%v, 'CodePage') as varchar) as 'cp'";
-                        try {
-                            ReferenceHolder<QoreListNode> args(new QoreListNode(autoTypeInfo), xsink);
-                            args->push(coll->refSelf(), xsink);
-                            holder = exec_row(&sql, *args, xsink);
-                            if (*xsink) {
-                                purge_messages(xsink);
-                                xsink->clear();
-                            } else {
-                                if (holder->getType() == NT_HASH) {
-                                    QoreStringNode* cp = holder->get<const QoreHashNode>()
-                                        ->getKeyValue("cp")
-                                        .get<QoreStringNode>();
-                                    if (cp && isdigit((*cp)[0])) {
-                                        printd(5, "MS SQL Server code page: '%s'\n", cp->c_str());
-                                        cp->prepend("WINDOWS-");
-                                        enc = QEM.findCreate(cp->c_str());
-                                        printd(5, "set connection encoding to '%s'\n", cp->c_str());
+                // issue #4710: determine DB character encoding
+                if (!sybase) {
+                    QoreString sql("select convert(varchar, serverproperty('collation')) as 'coll'");
+                    ValueHolder holder(exec_row(&sql, nullptr, xsink), xsink);
+                    if (holder->getType() == NT_HASH) {
+                        const QoreStringNode* coll = holder->get<const QoreHashNode>()
+                            ->getKeyValue("coll")
+                            .get<const QoreStringNode>();
+                        assert(coll);
+                        printd(5, "MS SQL Server collation: '%s'\n", coll->c_str());
+                        QoreString c(coll);
+                        c.tolwr();
+                        if (c.find("utf8") >= 0) {
+                            // set character encoding to UTF-8
+                            enc = QCS_UTF8;
+                            server_info.enc = enc;
+                        } else {
+                            sql = "select cast(collationproperty(%v, 'CodePage') as varchar) as 'cp'";
+                            try {
+                                ReferenceHolder<QoreListNode> args(new QoreListNode(autoTypeInfo), xsink);
+                                args->push(coll->refSelf(), xsink);
+                                holder = exec_row(&sql, *args, xsink);
+                                if (*xsink) {
+                                    purge_messages(xsink);
+                                    xsink->clear();
+                                } else {
+                                    if (holder->getType() == NT_HASH) {
+                                        QoreStringNode* cp = holder->get<const QoreHashNode>()
+                                            ->getKeyValue("cp")
+                                            .get<QoreStringNode>();
+                                        if (cp && isdigit((*cp)[0])) {
+                                            printd(5, "MS SQL Server code page: '%s'\n", cp->c_str());
+                                            cp->prepend("WINDOWS-");
+                                            enc = QEM.findCreate(cp->c_str());
+                                            server_info.enc = enc;
+                                            printd(5, "set connection encoding to '%s'\n", cp->c_str());
+                                        }
                                     }
                                 }
-                            }
 
-                        } catch (const ss::Error& e) {
-                            printd(5, "ignoring error trying to determine server character encoding: %s: %s\n",
-                                e.getErr(), e.getDesc());
+                            } catch (const ss::Error& e) {
+                                printd(5, "ignoring error trying to determine server character encoding: %s: %s\n",
+                                    e.getErr(), e.getDesc());
+                            }
                         }
                     }
                 }
             }
+            if (!*xsink) {
+                server_info.sybase = sybase;
+                have_server_info = true;
+                ss::server_info_cache.set(key, server_info);
+            }
         }
     }
 
+    // the lock wait timeout must be restored when reconnecting
+    if (!*xsink && lock_timeout >= 0)
+        setLockTimeout(xsink);
+
+    // the commands executed while connecting do not leave a transaction open
+    trans_open = false;
+
     purge_messages(xsink);
     return *xsink ? -1 : 0;
 }
 
+int connection::setConnectOptions(const QoreHashNode* opts, ExceptionSink* xsink) {
+    if (!opts)
+        return 0;
+
+    // options that must be known before the connection is opened
+    static const char* connect_opts[] = {
+        SYBASE_OPT_ASYNC_CONNECT,
+        SYBASE_OPT_PACKET_SIZE,
+        SYBASE_OPT_CONNECT_TIMEOUT,
+        SYBASE_OPT_LOCK_TIMEOUT,
+        SYBASE_OPT_NATIVE_AUTOCOMMIT,
+        SYBASE_OPT_FAILOVER_HOSTS,
+        SYBASE_OPT_FAILOVER_ORDER,
+        SYBASE_OPT_FAILOVER_ATTEMPTS,
+        SYBASE_OPT_FAILOVER_BACKOFF,
+        SYBASE_OPT_FAILOVER_MAX_BACKOFF,
+        SYBASE_OPT_FAILOVER_STANDBY,
+        SYBASE_OPT_KEEPALIVE,
+    };
+
+    for (const char* opt : connect_opts) {
+        if (opts->existsKey(opt) && setOption(opt, opts->getKeyValue(opt), xsink))
+            return -1;
+    }
+    return 0;
+}
+
+int connection::connectFailover(const char* username,
+                                const char* password,
+                                const char* dbname,
+                                const char* db_encoding,
+                                const QoreEncoding* n_enc,
+                                const char* hostname,
+                                int port,
+                                ExceptionSink* xsink) {
+    assert(!m_connection);
+    enc = n_enc;
+
+    // a pre-warmed standby connection avoids the login and metadata queries on the critical path
+    {
+        std::unique_ptr<connection> sb(takeStandby());
+        if (sb) {
+            printd(5, "connection::connectFailover() this: %p using standby connection to %s\n", this,
+                standby_args.host.getKey().c_str());
+            adoptConnection(*sb);
+            cur_host = standby_args.host;
+            startStandby(username, password, dbname, db_encoding, n_enc);
+            return 0;
+        }
+    }
+
+    std::vector<ss::FailoverHost> hosts = failover.getCandidates(hostname, port);
+    // the exception from the last failed attempt
+    ExceptionSink last;
+    bool tried = false;
+    for (int pass = 0; pass < failover.attempts; ++pass) {
+        if (pass) {
+            int64 ms = failover.getBackoff(pass);
+            printd(5, "connection::connectFailover() this: %p waiting " QLLD " ms before pass %d\n", this, ms,
+                pass + 1);
+            std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+        }
+
+        for (auto& h : hosts) {
+            std::string key = h.getKey();
+            if (!ss::host_breakers.allow(key))
+                continue;
+            tried = true;
+
+            ExceptionSink xs;
+            int rc;
+            try {
+                rc = init(username, password, dbname, db_encoding, n_enc, h.host.empty() ? nullptr : h.host.c_str(),
+                    h.port, &xs);
+            } catch (const ss::Error& e) {
+                e.raise(&xs);
+                rc = -1;
+            }
+            if (!rc) {
+                ss::host_breakers.success(key);
+                cur_host = h;
+                printd(5, "connection::connectFailover() this: %p connected to %s\n", this, key.c_str());
+                startStandby(username, password, dbname, db_encoding, n_enc);
+                return 0;
+            }
+
+            printd(5, "connection::connectFailover() this: %p failed to connect to %s\n", this, key.c_str());
+            // errors like a wrong password or database are not caused by the host, and the breakers are shared
+            // by all connections to the host
+            if (host_unreachable)
+                ss::host_breakers.failure(key);
+            else
+                ss::host_breakers.success(key);
+            dropConnection();
+            discard_messages();
+            last.clear();
+            last.assimilate(xs);
+        }
+    }
+
+    if (!tried) {
+        xsink->raiseException("TDS-FAILOVER-ERROR", "cannot connect; all %d host(s) have been skipped after "
+            "repeated connection failures", (int)hosts.size());
+        return -1;
+    }
+    QoreStringValueHelper err(last.getExceptionErr());
+    QoreStringValueHelper desc(last.getExceptionDesc());
+    xsink->raiseException("TDS-FAILOVER-ERROR", "cannot connect to any of %d host(s) after %d attempt(s); last "
+        "error: %s: %s", (int)hosts.size(), failover.attempts, err->c_str(), desc->c_str());
+    last.clear();
+    return -1;
+}
+
+void connection::dropConnection() {
+    spare_cmd.reset();
+    dropCommandPool();
+    AutoLocker al(cancel_lock);
+    if (m_connection) {
+        if (connected)
+            ct_close(m_connection, CS_FORCE_CLOSE);
+        ct_con_drop(m_connection);
+        m_connection = nullptr;
+    }
+    connected = false;
+}
+
+void connection::startStandby(const char* username, const char* password, const char* dbname,
+        const char* db_encoding, const QoreEncoding* n_enc) {
+    if (!failover.standby || is_standby)
+        return;
+
+    AutoLocker al(standby_lock);
+    // a standby connection is already open or being opened
+    if (standby_pending)
+        return;
+
+    // use the first host after the current one that is not being skipped after failures
+    std::vector<ss::FailoverHost> hosts = failover.getCandidates(cur_host.host.empty() ? nullptr
+        : cur_host.host.c_str(), cur_host.port);
+    const ss::FailoverHost* next = nullptr;
+    for (auto& h : hosts) {
+        if (!(h == cur_host) && !ss::host_breakers.isOpen(h.getKey())) {
+            next = &h;
+            break;
+        }
+    }
+    if (!next)
+        return;
+
+    ExceptionSink xsink;
+    std::unique_ptr<connection> sb(new connection(ds, &xsink));
+    if (xsink) {
+        xsink.clear();
+        return;
+    }
+    // copy the options needed to connect
+    sb->is_standby = true;
+    sb->packet_size = packet_size;
+    sb->connect_timeout = connect_timeout;
+    sb->lock_timeout = lock_timeout;
+    sb->native_autocommit = native_autocommit;
+    sb->keepalive = keepalive;
+
+    standby_args.username = username;
+    standby_args.password = password ? password : "";
+    standby_args.dbname = dbname;
+    standby_args.db_encoding = db_encoding ? db_encoding : "";
+    standby_args.enc = n_enc;
+    standby_args.host = *next;
+
+    standby = std::move(sb);
+    standby_done = false;
+    standby_ok = false;
+    standby_pending = true;
+    if (q_start_thread(&xsink, standby_thread, this) < 0) {
+        xsink.clear();
+        standby.reset();
+        standby_pending = false;
+    }
+}
+
+void connection::standby_thread(ExceptionSink* xsink, void* arg) {
+    connection* c = (connection*)arg;
+    connection* sb = c->standby.get();
+    const standby_args_t& a = c->standby_args;
+    std::string key = a.host.getKey();
+
+    printd(5, "connection::standby_thread() %p opening standby connection to %s\n", c, key.c_str());
+    ExceptionSink xs;
+    int rc;
+    try {
+        rc = sb->init(a.username.c_str(), a.password.c_str(), a.dbname.c_str(),
+            a.db_encoding.empty() ? nullptr : a.db_encoding.c_str(), a.enc,
+            a.host.host.empty() ? nullptr : a.host.host.c_str(), a.host.port, &xs);
+    } catch (const ss::Error& e) {
+        e.raise(&xs);
+        rc = -1;
+    }
+    if (rc && sb->host_unreachable)
+        ss::host_breakers.failure(key);
+    else
+        ss::host_breakers.success(key);
+    xs.clear();
+
+    AutoLocker al(c->standby_lock);
+    c->standby_ok = !rc;
+    c->standby_done = true;
+    c->standby_cond.broadcast();
+}
+
+connection* connection::takeStandby() {
+    AutoLocker al(standby_lock);
+    // never wait for the standby login on the critical path
+    if (!standby_pending || !standby_done)
+        return nullptr;
+    standby_pending = false;
+    std::unique_ptr<connection> sb(std::move(standby));
+    if (!standby_ok || !sb->validate())
+        return nullptr;
+    return sb.release();
+}
+
+void connection::discardStandby() {
+    AutoLocker al(standby_lock);
+    if (!standby_pending)
+        return;
+    while (!standby_done)
+        standby_cond.wait(&standby_lock);
+    standby_pending = false;
+    standby.reset();
+}
+
+void connection::adoptConnection(connection& sb) {
+    // command handles belong to the standby's connection handle
+    sb.spare_cmd.reset();
+    sb.dropCommandPool();
+    {
+        AutoLocker al(cancel_lock);
+        m_connection = sb.m_connection;
+        connected = sb.connected;
+    }
+    {
+        AutoLocker al(sb.cancel_lock);
+        sb.m_connection = nullptr;
+        sb.connected = false;
+    }
+
+    // deliver messages to this object from now on
+    connection* self = this;
+    ct_con_props(m_connection, CS_SET, CS_USERDATA, &self, sizeof(self), 0);
+
+    sybase = sb.sybase;
+    enc = sb.enc;
+    server_info = sb.server_info;
+    have_server_info = sb.have_server_info;
+    packet_size_negotiated = sb.packet_size_negotiated;
+    trans_open = false;
+}
+
+int connection::initAsync(const char* username,
+                          const char* password,
+                          const char* dbname,
+                          const char* db_encoding,
+                          const QoreEncoding* n_enc,
+                          const char* hostname,
+                          int port,
+                          ExceptionSink* xsink) {
+    assert(!async_pending);
+    // copy the arguments so that the background thread does not access the Datasource
+    async_args.reset(new async_args_t);
+    async_args->username = username;
+    async_args->password = password;
+    async_args->dbname = dbname;
+    async_args->db_encoding = db_encoding ? db_encoding : "";
+    async_args->hostname = hostname ? hostname : "";
+    async_args->enc = n_enc;
+    async_args->port = port;
+
+    async_done = false;
+    async_pending = true;
+    if (q_start_thread(xsink, async_connect_thread, this) < 0) {
+        async_pending = false;
+        return -1;
+    }
+    return 0;
+}
+
+thread_local bool connection::in_async_connect = false;
+
+void connection::async_connect_thread(ExceptionSink* xsink, void* arg) {
+    connection* c = (connection*)arg;
+    async_args_t& a = *c->async_args;
+    in_async_connect = true;
+
+    printd(5, "connection::async_connect_thread() %p connecting to %s@%s\n", c, a.username.c_str(), a.dbname.c_str());
+    try {
+        if (c->failover.empty()) {
+            c->init(a.username.c_str(), a.password.c_str(), a.dbname.c_str(),
+                a.db_encoding.empty() ? nullptr : a.db_encoding.c_str(), a.enc,
+                a.hostname.empty() ? nullptr : a.hostname.c_str(), a.port, &c->async_xsink);
+        } else {
+            c->connectFailover(a.username.c_str(), a.password.c_str(), a.dbname.c_str(),
+                a.db_encoding.empty() ? nullptr : a.db_encoding.c_str(), a.enc,
+                a.hostname.empty() ? nullptr : a.hostname.c_str(), a.port, &c->async_xsink);
+        }
+    } catch (const ss::Error& e) {
+        e.raise(&c->async_xsink);
+    }
+    in_async_connect = false;
+
+    AutoLocker al(c->async_lock);
+    c->async_done = true;
+    c->async_cond.broadcast();
+}
+
+int connection::waitConnectedIntern(ExceptionSink* xsink) {
+    {
+        AutoLocker al(async_lock);
+        while (!async_done)
+            async_cond.wait(&async_lock);
+    }
+    async_pending = false;
+    async_args.reset();
+
+    if (async_xsink) {
+        xsink->assimilate(async_xsink);
+        // make sure and mark Datasource as closed
+        ds->connectionAborted();
+        return -1;
+    }
+    return 0;
+}
+
 void connection::discard_messages() {
-#ifdef DEBUG
-    CS_RETCODE ret =
-#endif
-        ct_diag(m_connection, CS_CLEAR, CS_ALLMSG_TYPE, CS_UNUSED, 0);
-    assert(ret == CS_SUCCEED);
+    messages.markChecked();
 }
 
-// purges all outstanding messages using ct_diag
+// checks the messages received since the last check and raises exceptions for any errors
 int connection::purge_messages(ExceptionSink *xsink) {
+    if (!messages.hasUnchecked())
+        return 0;
+
     int rc = 0;
     // make sure no messages have severity > 10
-    int num;
-#ifdef DEBUG
-    CS_RETCODE ret =
-#endif
-        ct_diag(m_connection, CS_STATUS, CS_CLIENTMSG_TYPE, CS_UNUSED, &num);
-    assert(ret == CS_SUCCEED);
-    CS_CLIENTMSG cmsg;
-    for (int i = 1; i <= num; ++i) {
+    messages.forEachUnchecked([&](const ss::Message& m) {
+        if (!m.server) {
+            if (m.severity > 10) {
+                QoreStringNode *desc = new QoreStringNode;
+                desc->sprintf("client message %d, severity %d: %s", m.number, m.severity, m.text);
+                if (m.os_text[0])
+                    desc->sprintf(" (%d): '%s'", m.osnumber, m.os_text);
+                xsink->raiseException("TDS-CLIENT-ERROR", desc);
+                rc = -1;
+            }
 #ifdef DEBUG
-        ret =
+            printd(1, "client: severity:%d, n:%d: %s\n", m.severity, m.number, m.text);
+            if (m.os_text[0])
+                printd(1, "Operating System Error: %s\n", m.os_text);
 #endif
-            ct_diag(m_connection, CS_GET, CS_CLIENTMSG_TYPE, i, &cmsg);
-        assert(ret == CS_SUCCEED);
-        if (CS_SEVERITY(cmsg.msgnumber) > 10) {
-            QoreStringNode *desc = new QoreStringNode;
-            desc->sprintf("client message %d, severity %d: %s", CS_NUMBER(cmsg.msgnumber), CS_SEVERITY(cmsg.msgnumber), cmsg.msgstring);
-            if (cmsg.osstringlen)
-                desc->sprintf(" (%d): '%s'", cmsg.osnumber, cmsg.osstring);
-            xsink->raiseException("TDS-CLIENT-ERROR", desc);
-            rc = -1;
+            return;
         }
-#ifdef DEBUG
-        printd(1, "client: severity:%d, n:%d: %s\n", CS_SEVERITY(cmsg.msgnumber), CS_NUMBER(cmsg.msgnumber), cmsg.msgstring);
-        if (cmsg.osstringlen > 0)
-            printd(1, "Operating System Error: %s\n", cmsg.osstring);
-#endif
-    }
-#ifdef DEBUG
-    ret =
-#endif
-        ct_diag(m_connection, CS_STATUS, CS_SERVERMSG_TYPE, CS_UNUSED, &num);
-    assert(ret == CS_SUCCEED);
-    CS_SERVERMSG smsg;
-    for (int i = 1; i <= num; ++i) {
-#ifdef DEBUG
-        ret =
-#endif
-            ct_diag(m_connection, CS_GET, CS_SERVERMSG_TYPE, i, &smsg);
-        assert(ret == CS_SUCCEED);
-        if (smsg.severity > 10) {
+        if (m.severity > 10) {
             QoreStringNode *desc = new QoreStringNode;
-            desc->sprintf("state %d, server message %d, ", smsg.state, smsg.msgnumber);
-            if (smsg.line)
-                desc->sprintf("line %d, ", smsg.line);
-            desc->sprintf("severity %ld: %s", smsg.severity, smsg.text);
+            desc->sprintf("state %d, server message %d, ", m.state, m.number);
+            if (m.line)
+                desc->sprintf("line %d, ", m.line);
+            desc->sprintf("severity %ld: %s", (long)m.severity, m.text);
             desc->trim_trailing('\n');
             xsink->raiseException("TDS-SERVER-ERROR", desc);
             rc = -1;
         }
-        printd(1, "server: line:%ld, severity:%ld, n:%d: %s", smsg.line, smsg.severity, smsg.msgnumber, smsg.text);
-    }
-#ifdef DEBUG
-    ret =
-#endif
-        ct_diag(m_connection, CS_CLEAR, CS_ALLMSG_TYPE, CS_UNUSED, 0);
-    assert(ret == CS_SUCCEED);
+        printd(1, "server: line:%ld, severity:%ld, n:%d: %s", (long)m.line, (long)m.severity, m.number, m.text);
+    });
+    messages.markChecked();
     return rc;
 }
 
-// if check = true, ignore server messages:
-// 3902: The COMMIT TRANSACTION request has no corresponding BEGIN TRANSACTION
-// 3903: The ROLLBACK TRANSACTION request has no corresponding BEGIN TRANSACTION
 void connection::do_check_exception(ExceptionSink *xsink, bool check, const char *err, QoreStringNode* estr) {
     int count = 0;
-    int num;
-    CS_RETCODE ret = ct_diag(m_connection, CS_STATUS, CS_CLIENTMSG_TYPE, CS_UNUSED, &num);
-    assert(ret == CS_SUCCEED);
-    CS_CLIENTMSG cmsg;
-    for (int i = 1; i <= num; ++i) {
-        ret = ct_diag(m_connection, CS_GET, CS_CLIENTMSG_TYPE, i, &cmsg);
-        if (ret != CS_SUCCEED)
-            continue;
-        int severity = CS_SEVERITY(cmsg.msgnumber);
-        if (severity <= 10)
-            continue;
-
-        if (count)
-            estr->concat(", ");
-        estr->sprintf("client message %d: severity %d: %s", CS_NUMBER(cmsg.msgnumber), severity, cmsg.msgstring);
-        estr->trim_trailing('.');
-        if (cmsg.osnumber && cmsg.osstringlen > 0)
-            estr->sprintf(", OS error %d: %s", cmsg.osnumber, cmsg.osstring);
-        count++;
-    }
-
-    ret = ct_diag(m_connection, CS_STATUS, CS_SERVERMSG_TYPE, CS_UNUSED, &num);
-    assert(ret == CS_SUCCEED);
-    CS_SERVERMSG smsg;
-
+    int num = 0;
     bool fnd_ignore = !check;
 
-    for (int i = 1; i <= num; ++i) {
-        ret = ct_diag(m_connection, CS_GET, CS_SERVERMSG_TYPE, i, &smsg);
-        if (!fnd_ignore && ret == CS_SUCCEED && (smsg.msgnumber == 3902 || smsg.msgnumber == 3903))
-        fnd_ignore = true;
-
-        if (ret != CS_SUCCEED || smsg.severity <= 10)
-            continue;
+    messages.forEachUnchecked([&](const ss::Message& m) {
+        if (m.server) {
+            ++num;
+            if (!fnd_ignore && (m.number == 3902 || m.number == 3903))
+                fnd_ignore = true;
+        }
+        if (m.severity <= 10)
+            return;
 
         if (count)
             estr->concat(", ");
-        if (smsg.svrnlen)
-            estr->sprintf("%s: ", smsg.svrname);
-        estr->sprintf("state %d, server message %d, ", smsg.state, smsg.msgnumber);
-        if (smsg.line)
-            estr->sprintf("line %d, ", smsg.line);
-        estr->sprintf("severity %d", smsg.severity);
-        if (smsg.textlen)
-            estr->sprintf(": %s", smsg.text);
-        estr->trim_trailing("\n.");
+        if (!m.server) {
+            estr->sprintf("client message %d: severity %d: %s", m.number, m.severity, m.text);
+            estr->trim_trailing('.');
+            if (m.osnumber && m.os_text[0])
+                estr->sprintf(", OS error %d: %s", m.osnumber, m.os_text);
+        } else {
+            if (m.server_name[0])
+                estr->sprintf("%s: ", m.server_name);
+            estr->sprintf("state %d, server message %d, ", m.state, m.number);
+            if (m.line)
+                estr->sprintf("line %d, ", m.line);
+            estr->sprintf("severity %d", m.severity);
+            if (m.text[0])
+                estr->sprintf(": %s", m.text);
+            estr->trim_trailing("\n.");
+        }
         ++count;
-    }
-    ret = ct_diag(m_connection, CS_CLEAR, CS_ALLMSG_TYPE, CS_UNUSED, 0);
-    assert(ret == CS_SUCCEED);
+    });
+    messages.markChecked();
     if (check && fnd_ignore && num == 1)
         return;
 
@@ -770,55 +1867,32 @@ void connection::do_exception(ExceptionSink *xsink, const char *err, const char
     do_check_exception(xsink, false, err, *estr);
 }
 
-/*
-  CS_RETCODE connection::clientmsg_callback(CS_CONTEXT* ctx, CS_CONNECTION* conn, CS_CLIENTMSG* errmsg)
-  {
-  #ifdef DEBUG
-  // This will print out description about an Sybase error. Most of the information
-  // can be ignored but if the application crashes the last error may be very informative.
-  // Comment it out if this output is not required.
-  if ((CS_NUMBER(errmsg->msgnumber) == 211) || (CS_NUMBER(errmsg->msgnumber) == 212)) { // acc. to the docs
-  return CS_SUCCEED;
-  }
-  fprintf(stderr, "-------------------------------------------------------------");
-  fprintf(stderr, "\nOpen Client Message:\n");
-  fprintf(stderr, "Message number: LAYER = (%d) ORIGIN = (%d) ",
-  (int)CS_LAYER(errmsg->msgnumber), (int)CS_ORIGIN(errmsg->msgnumber));
-  fprintf(stderr, "SEVERITY = (%d) NUMBER = (%d)\n",
-  (int)CS_SEVERITY(errmsg->msgnumber), (int)CS_NUMBER(errmsg->msgnumber));
-  fprintf(stderr, "Message String: %s\n", errmsg->msgstring);
-  if (errmsg->osstringlen > 0) {
-  fprintf(stderr, "Operating System Error: %s\n", errmsg->osstring);
-  }
-  fprintf(stderr, "--------------------------------------------------\n");
-  fflush(stderr);
-  #endif
-  return CS_SUCCEED;
-  }
-
-  CS_RETCODE connection::servermsg_callback(CS_CONTEXT* ctx, CS_CONNECTION* conn, CS_SERVERMSG* svrmsg)
-  {
-  #ifdef DEBUG
-  // This will print out description about an Sybase error. Most of the information
-  // can be ignored but if the application crashes the last error may be very informative.
-  // Comment it out if this output is not required.
-  fprintf(stderr, "-------------------------------------------------------------");
-  fprintf(stderr, "\nOpen Server Message:\n");
-  fprintf(stderr, "Message number = %d, severity = %d\n", (int)svrmsg->msgnumber, (int)svrmsg->severity);
-  fprintf(stderr, "State = %d, line = %d\n", (int)svrmsg->state, (int)svrmsg->line);
-  if (svrmsg->svrnlen) {
-  fprintf(stderr, "Server: %s\n", svrmsg->svrname);
-  }
-  if (svrmsg->proclen) {
-  fprintf(stderr, "Procedure: %s\n", svrmsg->proc);
-  }
-  fprintf(stderr, "Message string: %s\n", svrmsg->text);
-  fprintf(stderr, "--------------------------------------------------\n");
-  fflush(stderr);
-  #endif
-  return CS_SUCCEED;
-  }
-*/
+// returns the connection object for the given connection handle
+static connection* get_connection(CS_CONNECTION* conn) {
+    connection* c = nullptr;
+    if (!conn || ct_con_props(conn, CS_GET, CS_USERDATA, &c, sizeof(c), 0) != CS_SUCCEED)
+        return nullptr;
+    return c;
+}
+
+CS_RETCODE CS_PUBLIC connection::clientmsg_callback(CS_CONTEXT* ctx, CS_CONNECTION* conn, CS_CLIENTMSG* errmsg) {
+    connection* c = get_connection(conn);
+    if (c)
+        c->messages.addClient(*errmsg);
+    return CS_SUCCEED;
+}
+
+CS_RETCODE CS_PUBLIC connection::servermsg_callback(CS_CONTEXT* ctx, CS_CONNECTION* conn, CS_SERVERMSG* svrmsg) {
+    connection* c = get_connection(conn);
+    if (c) {
+        c->messages.addServer(*svrmsg);
+        c->server_replied = true;
+        // the command was chosen as a deadlock victim
+        if (svrmsg->msgnumber == 1205)
+            c->deadlock = true;
+    }
+    return CS_SUCCEED;
+}
 
 // get client version
 QoreStringNode *connection::get_client_version(ExceptionSink *xsink) {
@@ -826,6 +1900,13 @@ QoreStringNode *connection::get_client_version(ExceptionSink *xsink) {
 }
 
 QoreValue connection::get_server_version(ExceptionSink *xsink) {
+    if (waitConnected(xsink))
+        return QoreValue();
+
+    if (have_server_info && !server_info.version.empty()) {
+        return new QoreStringNode(server_info.version.c_str(), enc);
+    }
+
     QoreValue rv;
     {
         ValueHolder res(execReadOutput(&ver_str, 0, true, true, false, xsink), xsink);
@@ -877,6 +1958,184 @@ DLLLOCAL int connection::setOption(const char* opt, QoreValue val, ExceptionSink
         return 0;
     }
 
+    if (!strcasecmp(opt, SYBASE_OPT_RPC_EXEC)) {
+        rpc_exec = true;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_ASYNC_CONNECT)) {
+        // only has an effect when set before the connection is opened
+        async_connect = true;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_PACKET_SIZE)) {
+        // only has an effect when set before the connection is opened
+        int64 size = val.getAsBigInt();
+        if (size && (size < SYBASE_MIN_PACKET_SIZE || size > SYBASE_MAX_PACKET_SIZE)) {
+            xsink->raiseException("TDS-OPTION-ERROR", "invalid value for the '%s' option: " QLLD "; the value must "
+                "be between %d and %d or 0 for the client library default", SYBASE_OPT_PACKET_SIZE, size,
+                SYBASE_MIN_PACKET_SIZE, SYBASE_MAX_PACKET_SIZE);
+            return -1;
+        }
+        packet_size = (int)size;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_CONNECT_TIMEOUT)) {
+        int64 secs = val.getAsBigInt();
+        if (secs <= 0) {
+            xsink->raiseException("TDS-OPTION-ERROR", "invalid value for the '%s' option: " QLLD "; the value must "
+                "be a positive number of seconds", SYBASE_OPT_CONNECT_TIMEOUT, secs);
+            return -1;
+        }
+        connect_timeout = (int)secs;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_COMMAND_TIMEOUT)) {
+        int64 ms = val.getAsBigInt();
+        command_timeout = ms > 0 ? (int)ms : 0;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_LOCK_TIMEOUT)) {
+        int64 ms = val.getAsBigInt();
+        lock_timeout = ms >= 0 ? (int)ms : -1;
+        // set on the server immediately if already connected, otherwise it's set when connecting
+        if (connected && lock_timeout >= 0 && !async_pending)
+            return setLockTimeout(xsink);
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_COMMIT_IN_BATCH)) {
+        commit_in_batch = true;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_NATIVE_AUTOCOMMIT)) {
+        // the transaction mode is set when connecting
+        if (connected && !native_autocommit) {
+            xsink->raiseException("TDS-OPTION-ERROR", "the '%s' option must be set in the datasource options "
+                "before the connection is opened", SYBASE_OPT_NATIVE_AUTOCOMMIT);
+            return -1;
+        }
+        native_autocommit = true;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_CURSOR_STATEMENTS)) {
+        cursor_statements = true;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_CURSOR_ROWS)) {
+        int64 n = val.getAsBigInt();
+        if (n <= 0) {
+            xsink->raiseException("TDS-OPTION-ERROR", "invalid value for the '%s' option: " QLLD "; the value must "
+                "be a positive number of rows", SYBASE_OPT_CURSOR_ROWS, n);
+            return -1;
+        }
+        cursor_rows = (int)n;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_CURSOR_UPDATABLE)) {
+        cursor_updatable = true;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_READ_REPLICAS)) {
+        QoreStringValueHelper str(val);
+        return replicas.parse(str->c_str(), xsink);
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_FAILOVER_HOSTS)) {
+        QoreStringValueHelper str(val);
+        return failover.parse(str->c_str(), xsink);
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_FAILOVER_ORDER)) {
+        QoreStringValueHelper str(val);
+        return failover.setOrder(str->c_str(), xsink);
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_FAILOVER_ATTEMPTS)) {
+        int64 n = val.getAsBigInt();
+        if (n <= 0) {
+            xsink->raiseException("TDS-OPTION-ERROR", "invalid value for the '%s' option: " QLLD "; the value must "
+                "be a positive number of attempts", SYBASE_OPT_FAILOVER_ATTEMPTS, n);
+            return -1;
+        }
+        failover.attempts = (int)n;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_FAILOVER_BACKOFF)) {
+        int64 ms = val.getAsBigInt();
+        failover.backoff = ms > 0 ? (int)ms : 0;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_FAILOVER_MAX_BACKOFF)) {
+        int64 ms = val.getAsBigInt();
+        failover.max_backoff = ms > 0 ? (int)ms : 0;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_FAILOVER_STANDBY)) {
+        failover.standby = true;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_VALIDATE_IDLE)) {
+        int64 ms = val.getAsBigInt();
+        validate_idle = ms > 0 ? (int)ms : 0;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_KEEPALIVE)) {
+        int64 secs = val.getAsBigInt();
+        keepalive = secs > 0 ? (int)secs : 0;
+        // applies to the current connection immediately
+        if (keepalive && m_connection && connected)
+            setKeepalive();
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_DEADLOCK_RETRIES)) {
+        int64 n = val.getAsBigInt();
+        deadlock_retries = n > 0 ? (int)n : 0;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_DEADLOCK_BACKOFF)) {
+        int64 ms = val.getAsBigInt();
+        deadlock_backoff = ms > 0 ? (int)ms : 0;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_BUFFER_STATEMENTS)) {
+        buffer_statements = true;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_STATEMENT_BUFFER_MEMORY)) {
+        int64 bytes = val.getAsBigInt();
+        if (bytes < 0) {
+            xsink->raiseException("TDS-OPTION-ERROR", "invalid value for the '%s' option: " QLLD "; the value must "
+                "be zero or a positive number of bytes", SYBASE_OPT_STATEMENT_BUFFER_MEMORY, bytes);
+            return -1;
+        }
+        statement_buffer_memory = (size_t)bytes;
+        return 0;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_CONNECTION_ID)) {
+        xsink->raiseException("TDS-OPTION-ERROR", "the '%s' option is read-only", SYBASE_OPT_CONNECTION_ID);
+        return -1;
+    }
+
     assert(false);
     return 0;
 }
@@ -902,6 +2161,106 @@ DLLLOCAL QoreValue connection::getOption(const char* opt) {
         return optimized_date_binds;
     }
 
+    if (!strcasecmp(opt, SYBASE_OPT_RPC_EXEC)) {
+        return rpc_exec;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_ASYNC_CONNECT)) {
+        return async_connect;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_PACKET_SIZE)) {
+        return getPacketSize();
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_CONNECT_TIMEOUT)) {
+        return connect_timeout;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_COMMAND_TIMEOUT)) {
+        return command_timeout;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_LOCK_TIMEOUT)) {
+        return lock_timeout;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_COMMIT_IN_BATCH)) {
+        return commit_in_batch;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_NATIVE_AUTOCOMMIT)) {
+        return native_autocommit;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_CURSOR_STATEMENTS)) {
+        return cursor_statements;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_CURSOR_ROWS)) {
+        return cursor_rows;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_CURSOR_UPDATABLE)) {
+        return cursor_updatable;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_READ_REPLICAS)) {
+        return replicas.empty() ? QoreValue() : QoreValue(new QoreStringNode(replicas.getSpec()));
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_FAILOVER_HOSTS)) {
+        return failover.empty() ? QoreValue() : QoreValue(new QoreStringNode(failover.getSpec()));
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_FAILOVER_ORDER)) {
+        return new QoreStringNode(failover.getOrder());
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_FAILOVER_ATTEMPTS)) {
+        return failover.attempts;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_FAILOVER_BACKOFF)) {
+        return failover.backoff;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_FAILOVER_MAX_BACKOFF)) {
+        return failover.max_backoff;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_FAILOVER_STANDBY)) {
+        return failover.standby;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_VALIDATE_IDLE)) {
+        return validate_idle;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_KEEPALIVE)) {
+        return keepalive;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_DEADLOCK_RETRIES)) {
+        return deadlock_retries;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_DEADLOCK_BACKOFF)) {
+        return deadlock_backoff;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_BUFFER_STATEMENTS)) {
+        return buffer_statements;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_STATEMENT_BUFFER_MEMORY)) {
+        return (int64)statement_buffer_memory;
+    }
+
+    if (!strcasecmp(opt, SYBASE_OPT_CONNECTION_ID)) {
+        return conn_id;
+    }
+
     assert(false);
     return QoreValue();
 }
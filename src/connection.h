@@ -30,10 +30,23 @@
 #include <ctpublic.h>
 #include <stdarg.h>
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
 #include "qore/common.h"
 #include "qore/ExceptionSink.h"
 
 #include "command.h"
+#include "bind_plan.h"
+#include "server_info.h"
+#include "cancel.h"
+#include "messages.h"
+#include "replica.h"
+#include "failover.h"
 #include "dbmodulewrap.h"
 #include "statement.h"
 
@@ -47,60 +60,64 @@
 #define CLIENT_VER_LEN 240
 #endif
 
-#ifdef SYBASE
-extern QoreThreadLock ct_lock;
-extern QoreThreadLock cs_lock;
+// default login timeout in seconds
+#ifndef SYBASE_DEFAULT_CONNECT_TIMEOUT
+#define SYBASE_DEFAULT_CONNECT_TIMEOUT 60
 #endif
 
-class AbstractQoreZoneInfo;
-
-typedef ss::DBModuleWrap<ss::Statement>::ModuleWrap stmt_t;
+// maximum number of free command handles kept per connection
+#ifndef SYBASE_COMMAND_POOL_SIZE
+#define SYBASE_COMMAND_POOL_SIZE 4
+#endif
 
-class context {
-public:
-    DLLLOCAL context(ExceptionSink *xsink) {
-        CS_RETCODE ret;
+// default memory limit in bytes for rows buffered from a statement before a temporary file is used
+#ifndef SYBASE_DEFAULT_STATEMENT_BUFFER_MEMORY
+#define SYBASE_DEFAULT_STATEMENT_BUFFER_MEMORY (1024 * 1024)
+#endif
 
-#ifdef SYBASE
-        {
-            AutoLocker al(cs_lock);
+// default number of rows fetched from the server in each batch for cursor statements
+#ifndef SYBASE_DEFAULT_CURSOR_ROWS
+#define SYBASE_DEFAULT_CURSOR_ROWS 100
 #endif
-            ret = cs_ctx_alloc(CS_VERSION_100, &m_context);
-#ifdef SYBASE
-        }
+
+// default backoff in milliseconds before the first retry of a deadlock victim
+#ifndef SYBASE_DEFAULT_DEADLOCK_BACKOFF
+#define SYBASE_DEFAULT_DEADLOCK_BACKOFF 50
 #endif
-         if (ret != CS_SUCCEED) {
-            xsink->raiseException("TDS-CT-LIB-CANNOT-ALLOCATE-ERROR", "cs_ctx_alloc() failed with error %d", ret);
-            return;
-        }
 
-#ifdef SYBASE
-        {
-            AutoLocker al(ct_lock);
+// maximum backoff in milliseconds between retries of a deadlock victim
+#ifndef SYBASE_MAX_DEADLOCK_BACKOFF
+#define SYBASE_MAX_DEADLOCK_BACKOFF 2000
 #endif
-            ret = ct_init(m_context, CS_VERSION_100);
+
 #ifdef SYBASE
-        }
+extern QoreThreadLock ct_lock;
+extern QoreThreadLock cs_lock;
 #endif
-        if (ret != CS_SUCCEED) {
-            del();
-            xsink->raiseException("TDS-CT-LIB-INIT-FAILED", "ct_init() failed with error %d", ret);
-            return;
-        }
-        //printd(5, "context::context() this=%p m_context=%p\n", this, m_context);
-    }
 
-    DLLLOCAL ~context() {
-        if (m_context)
-            del();
-    }
+class AbstractQoreZoneInfo;
 
-    DLLLOCAL operator bool() const {
-        return (bool)m_context;
-    }
+typedef ss::DBModuleWrap<ss::Statement>::ModuleWrap stmt_t;
+
+// the ct-lib context shared by all connections; it is created when the first reference is acquired and
+// destroyed when the last reference is released
+class context {
+public:
+    // returns a new reference to the shared context, creating it if necessary
+    // returns nullptr on error (exception raised)
+    DLLLOCAL static context* acquire(ExceptionSink* xsink);
+
+    // releases a reference to the shared context
+    DLLLOCAL void release();
 
     DLLLOCAL CS_CONTEXT* get_context() { return m_context; }
 
+#ifdef SYB_HAVE_LOCALE
+    // returns a locale for the given server character set; locales are cached for the lifetime of the context
+    // returns nullptr on error (exception raised)
+    DLLLOCAL CS_LOCALE* get_locale(const char* charset, ExceptionSink* xsink);
+#endif
+
     DLLLOCAL QoreStringNode* get_client_version(ExceptionSink *xsink) {
         char *buf = (char *)malloc(sizeof(char) * CLIENT_VER_LEN);
         CS_INT olen = 0;
@@ -116,37 +133,68 @@ public:
     }
 
 private:
-    CS_CONTEXT* m_context;
+    CS_CONTEXT* m_context = nullptr;
+    // reference count, protected by ctx_lock
+    unsigned refs = 1;
+
+#ifdef SYB_HAVE_LOCALE
+    typedef std::map<std::string, CS_LOCALE*> locale_map_t;
+    // locales by character set
+    locale_map_t locales;
+    QoreThreadLock loc_lock;
+#endif
 
-    DLLLOCAL void del() {
-        //printd(5, "context::del() this=%p deleting %p\n", this, m_context);
+    // protects the shared context pointer and the reference count
+    DLLLOCAL static QoreThreadLock ctx_lock;
+    DLLLOCAL static context* shared;
 
-        CS_RETCODE ret;
-#ifdef SYBASE
-        {
-            AutoLocker al(ct_lock);
-#endif
-            ret = ct_exit(m_context, CS_UNUSED);
-#ifdef SYBASE
-        }
-#endif
-        if (ret != CS_SUCCEED) {
-#ifdef SYBASE
-            {
-                AutoLocker al(ct_lock);
-#endif
-                ret = ct_exit(m_context, CS_FORCE_EXIT);
-#ifdef SYBASE
-            }
-#endif
-            assert(ret == CS_SUCCEED);
+    DLLLOCAL context(ExceptionSink *xsink);
+
+    DLLLOCAL ~context() {
+#ifdef SYB_HAVE_LOCALE
+        for (auto& i : locales) {
+            cs_loc_drop(m_context, i.second);
         }
-#ifdef SYBASE
-        AutoLocker al(cs_lock);
 #endif
-        ret = cs_ctx_drop(m_context);
-        assert(ret == CS_SUCCEED);
+        if (m_context)
+            del();
     }
+
+    DLLLOCAL void del();
+};
+
+// holds a reference to the shared context
+class context_holder {
+public:
+    DLLLOCAL context_holder(ExceptionSink* xsink) : ctx(context::acquire(xsink)) {
+    }
+
+    DLLLOCAL ~context_holder() {
+        if (ctx)
+            ctx->release();
+    }
+
+    DLLLOCAL operator bool() const {
+        return (bool)ctx;
+    }
+
+    DLLLOCAL context* operator->() {
+        return ctx;
+    }
+
+    DLLLOCAL CS_CONTEXT* get_context() {
+        return ctx ? ctx->get_context() : nullptr;
+    }
+
+    DLLLOCAL QoreStringNode* get_client_version(ExceptionSink *xsink) {
+        return ctx->get_client_version(xsink);
+    }
+
+private:
+    context* ctx;
+
+    DLLLOCAL context_holder(const context_holder&) = delete;
+    DLLLOCAL context_holder& operator=(const context_holder&) = delete;
 };
 
 // Instantiated class is kept as private data of the Datasource
@@ -161,7 +209,10 @@ public:
     DLLLOCAL connection(Datasource *n_ds, ExceptionSink *xsink);
     DLLLOCAL ~connection();
 
-    DLLLOCAL command* setupCommand(const QoreString* cmd_text, const QoreListNode* args, bool raw, ExceptionSink* xsink);
+    // if no binder plan is given, the connection's cached plan for the command text is used
+    // if "cursor" is true and the "cursor-statements" option is set, select statements are executed as cursors
+    DLLLOCAL command* setupCommand(const QoreString* cmd_text, const QoreListNode* args, bool raw, ExceptionSink* xsink,
+            ss::BindPlan* plan = nullptr, bool cursor = false);
 
     // to be called after the object is constructed
     // returns 0=OK, -1=error (exception raised)
@@ -169,6 +220,38 @@ public:
             const char *db_encoding, const QoreEncoding *n_enc, const char *hostname,
             int port, ExceptionSink* xsink);
 
+    // connects to the first available server of the Datasource's server and the "failover-hosts" option, making
+    // several passes over the hosts with a backoff in between and skipping hosts with an open circuit breaker;
+    // a pre-warmed standby connection is used if available
+    // returns 0=OK, -1=error (exception raised)
+    DLLLOCAL int connectFailover(const char *username, const char *password, const char *dbname,
+            const char *db_encoding, const QoreEncoding *n_enc, const char *hostname,
+            int port, ExceptionSink* xsink);
+
+    // returns true if failover hosts are configured
+    DLLLOCAL bool hasFailover() const {
+        return !failover.empty();
+    }
+
+    // starts the connection in a background thread; the first operation that needs the server waits for it
+    // returns 0=OK, -1=error (exception raised)
+    DLLLOCAL int initAsync(const char *username, const char *password, const char *dbname,
+            const char *db_encoding, const QoreEncoding *n_enc, const char *hostname,
+            int port, ExceptionSink* xsink);
+
+    // waits for an asynchronous connection to be established
+    // returns 0=OK, -1=error (exception raised)
+    DLLLOCAL int waitConnected(ExceptionSink* xsink) {
+        // the background connection thread itself executes commands while connecting
+        if (!async_pending || in_async_connect)
+            return 0;
+        return waitConnectedIntern(xsink);
+    }
+
+    // applies options from the datasource that must be set before connecting
+    // returns 0=OK, -1=error (exception raised)
+    DLLLOCAL int setConnectOptions(const QoreHashNode* opts, ExceptionSink* xsink);
+
     // returns 0=OK, -1=error (exception raised)
     DLLLOCAL int purge_messages(ExceptionSink *xsink);
     // discard all messages
@@ -182,47 +265,78 @@ public:
     DLLLOCAL int commit(ExceptionSink *xsink);
     // returns 0=OK, -1=error (exception raised)
     DLLLOCAL int rollback(ExceptionSink *xsink);
+    // called when Qore starts a transaction; starts an explicit transaction in native autocommit mode
+    // returns 0=OK, -1=error (exception raised)
+    DLLLOCAL int begin_transaction(ExceptionSink *xsink);
 
+    // executes the command and reads the results; if the command is chosen as a deadlock victim and it is safe
+    // to do so, it is executed again according to the "deadlock-retries" option
     DLLLOCAL QoreValue execReadOutput(QoreString *cmd_text, const QoreListNode *qore_args, bool need_list, bool doBinding, bool cols, ExceptionSink* xsink, bool single_row = false);
     DLLLOCAL command::ResType readNextResult(command& cmd, bool& connection_reset, ExceptionSink* xsink);
 
     DLLLOCAL QoreValue select(const QoreString *cmd, const QoreListNode *parameters, ExceptionSink *xsink);
 
+    // the type of a select for routeSelect()
+    enum select_type_t {
+        SELECT,
+        SELECT_ROWS,
+        SELECT_ROW,
+    };
+
+    // executes a select on a read replica if replicas are configured, no transaction is in progress, and the
+    // command is a select; "routed" is set to false if the command must be executed on the primary connection
+    DLLLOCAL QoreValue routeSelect(select_type_t type, const QoreString* cmd, const QoreListNode* parameters,
+            bool& routed, ExceptionSink* xsink);
+
     DLLLOCAL QoreValue exec(const QoreString *cmd, const QoreListNode *parameters, ExceptionSink *xsink);
     DLLLOCAL QoreValue execRaw(const QoreString *cmd, ExceptionSink *xsink);
     DLLLOCAL QoreValue exec_rows(const QoreString *cmd, const QoreListNode *parameters, ExceptionSink *xsink);
     DLLLOCAL QoreValue exec_row(const QoreString *cmd, const QoreListNode *parameters, ExceptionSink *xsink);
 
-    // returns true if the server is still reachable on the connection, false if not
+    // returns true if the connection handle is still marked as connected; the server is not contacted
     DLLLOCAL bool ping() const;
 
+    // executes a minimal command on the server to check that the connection is still usable; no exceptions are
+    // raised and any messages are discarded
+    // returns true if the round trip succeeded
+    DLLLOCAL bool validate();
+
     // invalidate / close any open statement
     DLLLOCAL void invalidateStatement() {
         if (stmt) {
             stmt->invalidate();
             stmt = nullptr;
         }
+        // open cursors do not survive the connection
+        for (auto& i : cursor_stmts)
+            i->invalidate();
+        cursor_stmts.clear();
     }
 
     DLLLOCAL bool wasConnectionAborted() const {
         return ds->wasConnectionAborted();
     }
 
+    // buffers or invalidates any open statement so that the connection can be used for another command
+    DLLLOCAL void releaseStatement();
+
     DLLLOCAL void registerStatement(stmt_t* n_stmt) {
-        // invalidate any existing statement
-        if (stmt)
-            stmt->invalidate();
+        if (stmt == n_stmt)
+            return;
+        cursor_stmts.erase(n_stmt);
+        // release any existing statement
+        releaseStatement();
         stmt = n_stmt;
     }
 
-#ifdef DEBUG
     DLLLOCAL void deregisterStatement(stmt_t* n_stmt) {
-        assert(n_stmt == stmt);
-#else
-       DLLLOCAL void deregisterStatement() {
-#endif
-        assert(stmt);
-        stmt = 0;
+        if (n_stmt != stmt) {
+            // statements with an open cursor are kept separately
+            assert(cursor_stmts.find(n_stmt) != cursor_stmts.end());
+            cursor_stmts.erase(n_stmt);
+            return;
+        }
+        stmt = nullptr;
     }
 
     DLLLOCAL CS_CONNECTION* getConnection() const { return m_connection; }
@@ -243,8 +357,88 @@ public:
         return optimized_date_binds;
     }
 
+    DLLLOCAL bool rpcExec() const {
+        return rpc_exec;
+    }
+
+    DLLLOCAL bool asyncConnect() const {
+        return async_connect;
+    }
+
+    // sends an attention to the server to cancel the current command; may be called from any thread
+    // returns 0=OK, -1=error
+    DLLLOCAL int cancel();
+
+    DLLLOCAL int64 getId() const {
+        return conn_id;
+    }
+
+    // returns a free command handle or allocates a new one
+    DLLLOCAL CS_RETCODE allocCommand(CS_COMMAND*& cmd);
+
+    // returns a command handle with no pending results to the free list or drops it if the list is full
+    DLLLOCAL void releaseCommand(CS_COMMAND* cmd);
+
+    // returns a recycled or new query object
+    DLLLOCAL sybase_query* newQuery();
+
+    // keeps a query object for reuse or deletes it
+    DLLLOCAL void recycleQuery(sybase_query* query);
+
+    // returns a recycled or new command object; returns nullptr on error (exception raised)
+    DLLLOCAL command* newCommand(ExceptionSink* xsink);
+
+    // keeps a command object for reuse or deletes it
+    DLLLOCAL void recycleCommand(command* cmd);
+
+    // returns a list of the most recent client and server messages
+    DLLLOCAL QoreListNode* getMessages() const {
+        return messages.getList();
+    }
+
+    // called when a command is sent, as it may start a transaction
+    DLLLOCAL void setTransactionOpen() {
+        trans_open = true;
+    }
+
+    // updates the transaction state from the state reported by the server after a command has completed
+    DLLLOCAL void setTransactionState(CS_INT state) {
+        switch (state) {
+            case CS_TRAN_COMPLETED:
+                trans_open = false;
+                break;
+            case CS_TRAN_IN_PROGRESS:
+            case CS_TRAN_FAIL:
+            case CS_TRAN_STMT_FAIL:
+                trans_open = true;
+                break;
+            default:
+                // the state is unknown; the transaction is assumed to be open
+                break;
+        }
+    }
+
+    // returns true if a commit should be appended to the given language command
+    DLLLOCAL bool commitInBatch() const;
+
+    // called by commands when they are sent and when all their results have been read or canceled
+    DLLLOCAL void setCommandPending(bool pending) {
+        if (pending)
+            ++pending_cmds;
+        else {
+            assert(pending_cmds > 0);
+            --pending_cmds;
+        }
+        last_activity = q_clock_getmillis();
+    }
+
+    // returns the packet size negotiated with the server, or the requested size if not connected
+    DLLLOCAL int getPacketSize() const {
+        return packet_size_negotiated ? packet_size_negotiated : packet_size;
+    }
+
 private:
-    context m_context;
+    context_holder m_context;
     CS_CONNECTION* m_connection = nullptr;
     bool connected = false;
     bool sybase = false;
@@ -253,8 +447,157 @@ private:
     int numeric_support = OPT_NUM_OPTIMAL;
     const AbstractQoreZoneInfo* server_tz = nullptr;
     bool optimized_date_binds = false;
+    bool rpc_exec = false;
+    bool async_connect = false;
+    // requested TDS packet size; 0 = use the client library default
+    int packet_size = 0;
+    // TDS packet size reported by the client library after connecting
+    int packet_size_negotiated = 0;
+    // login timeout in seconds
+    int connect_timeout = SYBASE_DEFAULT_CONNECT_TIMEOUT;
+    // command timeout in milliseconds; 0 = no timeout
+    int command_timeout = 0;
+    // lock wait timeout in milliseconds; -1 = server default
+    int lock_timeout = -1;
+    // the number of commands with unread results
+    int pending_cmds = 0;
+    // the time in milliseconds of the last command sent or completed on the connection
+    int64 last_activity = 0;
+    // validate the connection with a round trip before a command if it has been idle for longer than this in
+    // milliseconds; 0 = no validation
+    int validate_idle = 0;
+    // the TCP keepalive idle time and probe interval in seconds; 0 = use the system settings
+    int keepalive = 0;
+    // the maximum number of times a deadlock victim is executed again; 0 = no retries
+    int deadlock_retries = 0;
+    // the backoff in milliseconds before the first deadlock retry; doubled for each further retry
+    int deadlock_backoff = SYBASE_DEFAULT_DEADLOCK_BACKOFF;
+    // set by the server message callback when the server reports that the command was chosen as a deadlock
+    // victim
+    bool deadlock = false;
+    // true if commands have been executed since the last commit or rollback that may have started a transaction
+    bool trans_open = false;
+    // append a commit to language commands in autocommit mode
+    bool commit_in_batch = false;
+    // use the server's autocommit mode instead of chained transactions
+    bool native_autocommit = false;
+    // execute select statements in SQLStatement objects as Client-Library cursors
+    bool cursor_statements = false;
+    // declare cursors "for update" instead of read-only
+    bool cursor_updatable = false;
+    // the number of rows fetched in each batch for cursors
+    int cursor_rows = SYBASE_DEFAULT_CURSOR_ROWS;
+    // read replicas for selects outside of transactions
+    ss::ReplicaSet replicas;
+    // failover hosts used when connecting and reconnecting
+    ss::FailoverConfig failover;
+    // the server currently connected to
+    ss::FailoverHost cur_host;
+    // set by the server message callback; used to tell whether the server responded while connecting
+    bool server_replied = false;
+    // true if the last call to init() failed because the server could not be reached; login errors and other
+    // errors reported by the server do not count against the host's circuit breaker
+    bool host_unreachable = false;
+    // true for a standby connection opened in the background for failover; it must not access the Datasource
+    bool is_standby = false;
+    // buffer the rows of the open statement instead of invalidating it when another command is executed
+    bool buffer_statements = false;
+    // memory limit in bytes for buffered statement rows
+    size_t statement_buffer_memory = SYBASE_DEFAULT_STATEMENT_BUFFER_MEMORY;
+    // true if an explicit transaction has been started in native autocommit mode
+    bool explicit_tran = false;
+    // client and server messages received by the message callbacks
+    ss::MessageRing messages;
+    // free command handles for the current connection handle
+    std::vector<CS_COMMAND*> cmd_pool;
+    // objects kept for reuse by the next command
+    std::unique_ptr<sybase_query> spare_query;
+    std::unique_ptr<command> spare_cmd;
+    // the id of the connection in ss::connection_registry
+    int64 conn_id = 0;
+    // protects m_connection and connected against cancel() calls from other threads
+    QoreThreadLock cancel_lock;
+
+    // asynchronous connection state
+    struct async_args_t {
+        std::string username, password, dbname, db_encoding, hostname;
+        const QoreEncoding* enc;
+        int port;
+    };
+    std::unique_ptr<async_args_t> async_args;
+    // true until the asynchronous connection has been waited for; only accessed with the Datasource lock held
+    bool async_pending = false;
+    // true when the background connection thread has finished; protected by async_lock
+    bool async_done = false;
+    // any exception raised while connecting in the background
+    ExceptionSink async_xsink;
+    QoreThreadLock async_lock;
+    QoreCondition async_cond;
+    // set in the background connection thread
+    DLLLOCAL static thread_local bool in_async_connect;
+
+    DLLLOCAL static void async_connect_thread(ExceptionSink* xsink, void* arg);
+    DLLLOCAL int waitConnectedIntern(ExceptionSink* xsink);
+
+    // pre-warmed standby connection state
+    struct standby_args_t {
+        std::string username, password, dbname, db_encoding;
+        const QoreEncoding* enc;
+        ss::FailoverHost host;
+    };
+    // the standby connection; only accessed by the background thread until standby_done is set
+    std::unique_ptr<connection> standby;
+    standby_args_t standby_args;
+    // true from the start of the standby connection until it is used or discarded; protected by standby_lock
+    bool standby_pending = false;
+    // true when the background thread has finished; protected by standby_lock
+    bool standby_done = false;
+    // true if the standby connection was opened successfully; protected by standby_lock
+    bool standby_ok = false;
+    QoreThreadLock standby_lock;
+    QoreCondition standby_cond;
+
+    DLLLOCAL static void standby_thread(ExceptionSink* xsink, void* arg);
+
+    // opens a standby connection to the next failover host in a background thread if configured
+    DLLLOCAL void startStandby(const char *username, const char *password, const char *dbname,
+            const char *db_encoding, const QoreEncoding *n_enc);
+
+    // returns an open standby connection or nullptr if none is ready; never waits for the background thread
+    DLLLOCAL connection* takeStandby();
+
+    // waits for any background standby connection to finish and closes it
+    DLLLOCAL void discardStandby();
+
+    // takes over the connection handle and server metadata of a standby connection
+    DLLLOCAL void adoptConnection(connection& sb);
+
+    // closes and frees the connection handle after a failed connection attempt
+    DLLLOCAL void dropConnection();
 
     stmt_t* stmt = nullptr;
+    // statements with an open cursor that can be fetched while other commands are executed on the connection
+    std::set<stmt_t*> cursor_stmts;
+    // used to create unique cursor names
+    unsigned cursor_seq = 0;
+
+    // binder plans for commands executed directly on the connection
+    ss::BindPlanCache bind_plans;
+
+    // a stored procedure parameter from the server's metadata
+    struct proc_param {
+        std::string name;
+        std::string type;
+        int arg1;
+        int arg2;
+    };
+    typedef std::vector<proc_param> proc_param_list_t;
+    // parameter metadata of stored procedures called with output placeholders without values by procedure name
+    std::map<std::string, proc_param_list_t> proc_params;
+
+    // server metadata, possibly from the process-wide cache
+    ss::ServerInfo server_info;
+    bool have_server_info = false;
 
     // returns -1 if an exception was thrown, 0 if all errors were ignored
     DLLLOCAL void do_check_exception(ExceptionSink *xsink, bool check, const char *err, const char *fmt, ...);
@@ -263,9 +606,126 @@ private:
 
     // returns 0 if reconnected without any errors, -1 if there were errors (transaction in progress, reconnect failed, etc)
     DLLLOCAL int closeAndReconnect(ExceptionSink* xsink, command& cmd, bool try_reconnect = true);
+    DLLLOCAL int closeAndReconnectIntern(ExceptionSink* xsink, bool try_reconnect);
+
+    // drops all free command handles; must be called before the connection handle is closed
+    DLLLOCAL void dropCommandPool();
+
+    // cancels any pending results before a commit or rollback
+    DLLLOCAL void cancelPending();
+
+    // sets the types of RPC output placeholders without values from the procedure's parameter metadata
+    DLLLOCAL void setOutputTypes(sybase_query& query);
+
+    // returns the parameter metadata for the stored procedure, which is read from the server on first use; only
+    // successful lookups are cached
+    DLLLOCAL const proc_param_list_t& getProcParams(const std::string& proc);
+
+    // drops the cached parameter metadata of the procedure called by a failed RPC command, as the error may be
+    // caused by a changed procedure definition
+    DLLLOCAL void invalidateProcParams(command& cmd);
+
+    DLLLOCAL QoreValue execReadOutputIntern(QoreString *cmd_text, const QoreListNode *qore_args, bool need_list,
+            bool doBinding, bool cols, ExceptionSink* xsink, bool single_row);
+
+    // returns true if a command chosen as a deadlock victim can be executed again, which is only the case if no
+    // user transaction is open, as the server rolls back the whole transaction
+    DLLLOCAL bool canRetryDeadlock(const QoreString* cmd_text) const;
+
+    // closes and reopens the connection after a command timeout and raises a timeout exception
+    DLLLOCAL void handleCommandTimeout(command* cmd, ExceptionSink* xsink);
+
+    // enables TCP keepalive on the connection's socket with the configured idle time and interval
+    DLLLOCAL void setKeepalive();
+
+    // sets the lock wait timeout on the server
+    // returns 0=OK, -1=error (exception raised)
+    DLLLOCAL int setLockTimeout(ExceptionSink* xsink);
+
+    // ct-lib message callbacks
+    DLLLOCAL static CS_RETCODE CS_PUBLIC clientmsg_callback(CS_CONTEXT* ctx, CS_CONNECTION* conn,
+            CS_CLIENTMSG* errmsg);
+    DLLLOCAL static CS_RETCODE CS_PUBLIC servermsg_callback(CS_CONTEXT* ctx, CS_CONNECTION* conn,
+            CS_SERVERMSG* svrmsg);
 };
 
 constexpr const char* SYBASE_OPT_OPTIMIZED_DATE_BINDS = "optimized-date-binds";
+constexpr const char* SYBASE_OPT_RPC_EXEC = "rpc-exec";
+constexpr const char* SYBASE_OPT_ASYNC_CONNECT = "async-connect";
+constexpr const char* SYBASE_OPT_PACKET_SIZE = "packet-size";
+constexpr const char* SYBASE_OPT_CONNECT_TIMEOUT = "connect-timeout";
+constexpr const char* SYBASE_OPT_COMMAND_TIMEOUT = "command-timeout";
+constexpr const char* SYBASE_OPT_LOCK_TIMEOUT = "lock-timeout";
+constexpr const char* SYBASE_OPT_CONNECTION_ID = "connection-id";
+constexpr const char* SYBASE_OPT_COMMIT_IN_BATCH = "commit-in-batch";
+constexpr const char* SYBASE_OPT_NATIVE_AUTOCOMMIT = "native-autocommit";
+constexpr const char* SYBASE_OPT_CURSOR_STATEMENTS = "cursor-statements";
+constexpr const char* SYBASE_OPT_CURSOR_ROWS = "cursor-rows";
+constexpr const char* SYBASE_OPT_CURSOR_UPDATABLE = "cursor-updatable";
+constexpr const char* SYBASE_OPT_READ_REPLICAS = "read-replicas";
+constexpr const char* SYBASE_OPT_FAILOVER_HOSTS = "failover-hosts";
+constexpr const char* SYBASE_OPT_FAILOVER_ORDER = "failover-order";
+constexpr const char* SYBASE_OPT_FAILOVER_ATTEMPTS = "failover-attempts";
+constexpr const char* SYBASE_OPT_FAILOVER_BACKOFF = "failover-backoff";
+constexpr const char* SYBASE_OPT_FAILOVER_MAX_BACKOFF = "failover-max-backoff";
+constexpr const char* SYBASE_OPT_FAILOVER_STANDBY = "failover-standby";
+constexpr const char* SYBASE_OPT_VALIDATE_IDLE = "validate-idle";
+constexpr const char* SYBASE_OPT_KEEPALIVE = "keepalive";
+constexpr const char* SYBASE_OPT_DEADLOCK_RETRIES = "deadlock-retries";
+constexpr const char* SYBASE_OPT_DEADLOCK_BACKOFF = "deadlock-backoff";
+constexpr const char* SYBASE_OPT_BUFFER_STATEMENTS = "buffer-statements";
+constexpr const char* SYBASE_OPT_STATEMENT_BUFFER_MEMORY = "statement-buffer-memory";
+
+namespace ss {
+// counts how commits and rollbacks were executed
+struct TransactionStats {
+    // commits and rollbacks sent to the server
+    std::atomic<int64> commits{0};
+    std::atomic<int64> rollbacks{0};
+    // commits and rollbacks skipped because no transaction was open
+    std::atomic<int64> commits_skipped{0};
+    std::atomic<int64> rollbacks_skipped{0};
+    // commits appended to language commands
+    std::atomic<int64> commits_in_batch{0};
+
+    DLLLOCAL QoreHashNode* getHash() const;
+};
+
+DLLLOCAL extern TransactionStats transaction_stats;
+
+// counts the round trips made to validate idle connections
+struct ValidationStats {
+    std::atomic<int64> validations{0};
+    // validations that found the connection unusable
+    std::atomic<int64> failures{0};
+
+    DLLLOCAL QoreHashNode* getHash() const;
+};
+
+DLLLOCAL extern ValidationStats validation_stats;
+
+// counts deadlocks and the retries of deadlock victims
+struct DeadlockStats {
+    // commands chosen as deadlock victims
+    std::atomic<int64> deadlocks{0};
+    // commands executed again after a deadlock
+    std::atomic<int64> retries{0};
+    // commands that succeeded after one or more retries
+    std::atomic<int64> recovered{0};
+    // deadlocks raised because the retries were used up
+    std::atomic<int64> exhausted{0};
+    // deadlocks raised because a retry was not safe
+    std::atomic<int64> not_retried{0};
+
+    DLLLOCAL QoreHashNode* getHash() const;
+};
+
+DLLLOCAL extern DeadlockStats deadlock_stats;
+} // namespace ss
+
+// valid range for the "packet-size" option
+constexpr int SYBASE_MIN_PACKET_SIZE = 512;
+constexpr int SYBASE_MAX_PACKET_SIZE = 65535;
 
 #endif
 
@@ -139,6 +139,65 @@ int Conversions::DateTime_to_DATETIME(const DateTime* dt, CS_DATETIME &out, Exce
     return 0;
 }
 
+// returns the number of days from 1970-01-01 to the given date in the proleptic Gregorian calendar
+static int64 days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int64 era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64)doe - 719468;
+}
+
+// gets the date and time of an absolute date in the given time zone
+static int get_local_info(const DateTime* dt, const AbstractQoreZoneInfo* tz, qore_tm& info, ExceptionSink* xsink) {
+    if (dt->isRelative()) {
+        xsink->raiseException("TDS-DATE-ERROR", "relative date passed for binding as absolute date");
+        return -1;
+    }
+    dt->getInfo(tz, info);
+    if (info.year < 1 || info.year > 9999) {
+        xsink->raiseException("TDS-DATE-ERROR", "year %d is out of range for binding; expecting a year from 1 to "
+            "9999", info.year);
+        return -1;
+    }
+    return 0;
+}
+
+int Conversions::DateTime_to_DATE(const DateTime* dt, const AbstractQoreZoneInfo* tz, CS_INT& out,
+        ExceptionSink* xsink) {
+    qore_tm info;
+    if (get_local_info(dt, tz, info, xsink))
+        return -1;
+    out = (CS_INT)(days_from_civil(info.year, info.month, info.day) + SYB_DAYS_TO_EPOCH);
+    return 0;
+}
+
+int Conversions::DateTime_to_TIME(const DateTime* dt, const AbstractQoreZoneInfo* tz, CS_INT& out,
+        ExceptionSink* xsink) {
+    qore_tm info;
+    if (get_local_info(dt, tz, info, xsink))
+        return -1;
+    // use floating point to get more accurate 1/3 s
+    int ts = (int)round((double)info.us / 3333.3333333);
+    out = (info.hour * 3600 + info.minute * 60 + info.second) * 300 + ts;
+    // values rounded up to midnight are stored as the last tick of the day
+    if (out >= 86400 * 300)
+        out = 86400 * 300 - 1;
+    return 0;
+}
+
+int Conversions::DateTime_to_BIGDATETIME(const DateTime* dt, const AbstractQoreZoneInfo* tz, uint64_t& out,
+        ExceptionSink* xsink) {
+    qore_tm info;
+    if (get_local_info(dt, tz, info, xsink))
+        return -1;
+    int64 secs = days_from_civil(info.year, info.month, info.day) * 86400LL + info.hour * 3600 + info.minute * 60
+        + info.second;
+    out = (uint64_t)(secs - YEAR_ZERO_SECS) * 1000000ULL + info.us;
+    return 0;
+}
+
 DateTimeNode * Conversions::DATETIME4_to_DateTime(CS_DATETIME4 &dt) {
     int64 secs = dt.minutes * 60LL + dt.days * 86400LL - SYB_SECS_TO_EPOCH;
     return new DateTimeNode(secs);
@@ -38,6 +38,19 @@ class Conversions {
 public:
     DLLLOCAL static int DateTime_to_DATETIME(const DateTime* dt, CS_DATETIME& out, ExceptionSink* xsink);
 
+    // the following conversions use the date and time of the value in the given time zone
+    // returns the number of days since 1900-01-01
+    DLLLOCAL static int DateTime_to_DATE(const DateTime* dt, const AbstractQoreZoneInfo* tz, CS_INT& out,
+            ExceptionSink* xsink);
+
+    // returns the time of day in 1/300 seconds
+    DLLLOCAL static int DateTime_to_TIME(const DateTime* dt, const AbstractQoreZoneInfo* tz, CS_INT& out,
+            ExceptionSink* xsink);
+
+    // returns the number of microseconds since 0000-01-01
+    DLLLOCAL static int DateTime_to_BIGDATETIME(const DateTime* dt, const AbstractQoreZoneInfo* tz, uint64_t& out,
+            ExceptionSink* xsink);
+
     DLLLOCAL static DateTimeNode *TIME_to_DateTime(CS_DATETIME &dt, const AbstractQoreZoneInfo *tz = nullptr);
 
     DLLLOCAL static DateTimeNode* DATETIME_to_DateTime(CS_DATETIME& dt, const AbstractQoreZoneInfo *tz = nullptr);
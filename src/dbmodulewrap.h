@@ -80,6 +80,21 @@ public:
             return m->isValid();
         }
 
+        DLLLOCAL bool isBuffered() const {
+            assert(m);
+            return m->isBuffered();
+        }
+
+        DLLLOCAL bool isCursor() const {
+            assert(m);
+            return m->isCursor();
+        }
+
+        DLLLOCAL int buffer(typename Module::Connection* conn, size_t mem_limit, ExceptionSink* xsink) {
+            assert(m);
+            return m->buffer(conn, mem_limit, xsink);
+        }
+
         static void Delete(ModuleWrap *mv, ExceptionSink* xsink) {
             if (!mv) return;
             mv->set_params(0, xsink);
@@ -165,13 +180,10 @@ public:
 
     static int close(SQLStatement* stmt, ExceptionSink* xsink) {
         ModuleWrap *m = module_wrap(stmt, false);
-        if (m->isValid()) {
+        // buffered statements are no longer registered with the connection
+        if (m->isValid() && !m->isBuffered()) {
            StatementHelper sh(stmt);
-#ifdef DEBUG
            sh.conn()->deregisterStatement(m);
-#else
-           sh.conn()->deregisterStatement();
-#endif
         }
         stmt->setPrivateData(0);
         ModuleWrap::Delete(m, xsink);
@@ -220,6 +232,9 @@ public:
             ModuleWrap *mv = module_wrap(stmt);
             StatementHelper sh(stmt);
             typename Module::Connection *conn = sh.conn();
+            // a buffered statement or a statement with an open cursor becomes the active statement again
+            if (mv->isValid() && (mv->isBuffered() || mv->isCursor()))
+                conn->registerStatement(mv);
             const QoreListNode *args = mv->get_params();
             const QoreString *query = mv->query.get();
             return module(stmt)->exec(conn, query, args, mv->raw, xsink);
@@ -0,0 +1,202 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    failover.cpp
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+
+#include "sybase.h"
+#include "failover.h"
+#include "connection.h"
+
+// the number of consecutive failures after which a host's circuit breaker opens
+static const int BREAKER_THRESHOLD = 3;
+// time in milliseconds that no connection is attempted to a host after its breaker has opened
+static const int64 BREAKER_COOLDOWN_MS = 30000;
+
+namespace ss {
+
+HostBreakers host_breakers;
+
+// returns a random number generator for the current thread
+static std::mt19937& get_rng() {
+    thread_local std::mt19937 rng(std::random_device{}());
+    return rng;
+}
+
+std::string FailoverHost::getKey() const {
+    if (host.empty())
+        return "<interfaces>";
+    std::string key = host;
+    key += ':';
+    key += std::to_string(port);
+    return key;
+}
+
+bool HostBreakers::allow(const std::string& key) {
+    AutoLocker al(lck);
+    state_t& s = hosts[key];
+    if (!s.open_until)
+        return true;
+    if (s.probing || q_clock_getmillis() < s.open_until)
+        return false;
+    // allow a single attempt after the cooldown
+    s.probing = true;
+    return true;
+}
+
+bool HostBreakers::isOpen(const std::string& key) {
+    AutoLocker al(lck);
+    auto i = hosts.find(key);
+    return i != hosts.end() && i->second.open_until && (i->second.probing
+        || q_clock_getmillis() < i->second.open_until);
+}
+
+void HostBreakers::success(const std::string& key) {
+    AutoLocker al(lck);
+    state_t& s = hosts[key];
+    s.failures = 0;
+    s.open_until = 0;
+    s.probing = false;
+}
+
+void HostBreakers::failure(const std::string& key) {
+    AutoLocker al(lck);
+    state_t& s = hosts[key];
+    ++s.total_failures;
+    s.probing = false;
+    // a failed attempt after the cooldown opens the breaker again immediately
+    if (++s.failures >= BREAKER_THRESHOLD || s.open_until)
+        s.open_until = q_clock_getmillis() + BREAKER_COOLDOWN_MS;
+}
+
+QoreListNode* HostBreakers::getList(ExceptionSink* xsink) {
+    ReferenceHolder<QoreListNode> rv(new QoreListNode(hashTypeInfo), xsink);
+    AutoLocker al(lck);
+    int64 now = q_clock_getmillis();
+    for (auto& i : hosts) {
+        ReferenceHolder<QoreHashNode> h(new QoreHashNode(autoTypeInfo), xsink);
+        h->setKeyValue("host", new QoreStringNode(i.first), xsink);
+        h->setKeyValue("open", i.second.open_until && (i.second.probing || now < i.second.open_until), xsink);
+        h->setKeyValue("failures", i.second.failures, xsink);
+        h->setKeyValue("total_failures", i.second.total_failures, xsink);
+        rv->push(h.release(), xsink);
+    }
+    return rv.release();
+}
+
+int parse_host_list(const char* spec, const char* opt, const char* what, std::vector<FailoverHost>& hosts,
+        ExceptionSink* xsink) {
+    std::vector<FailoverHost> hl;
+    const char* p = spec;
+    while (*p) {
+        while (isspace(*p) || *p == ',')
+            ++p;
+        if (!*p)
+            break;
+        const char* start = p;
+        while (*p && *p != ',' && !isspace(*p))
+            ++p;
+        std::string entry(start, p - start);
+        size_t colon = entry.rfind(':');
+        int port = colon != std::string::npos ? atoi(entry.c_str() + colon + 1) : 0;
+        if (!colon || colon == std::string::npos || port <= 0 || port > 65535) {
+            xsink->raiseException("TDS-OPTION-ERROR", "invalid %s '%s' in option '%s'; expecting \"host:port\"",
+                what, entry.c_str(), opt);
+            return -1;
+        }
+        FailoverHost h;
+        h.host = entry.substr(0, colon);
+        h.port = port;
+        hl.push_back(h);
+    }
+
+    hosts.swap(hl);
+    return 0;
+}
+
+int FailoverConfig::parse(const char* n_spec, ExceptionSink* xsink) {
+    std::vector<FailoverHost> hl;
+    if (parse_host_list(n_spec, SYBASE_OPT_FAILOVER_HOSTS, "host", hl, xsink))
+        return -1;
+
+    spec = n_spec;
+    hosts = hl;
+    return 0;
+}
+
+int FailoverConfig::setOrder(const char* order, ExceptionSink* xsink) {
+    if (!strcasecmp(order, "ordered")) {
+        random = false;
+        return 0;
+    }
+    if (!strcasecmp(order, "random")) {
+        random = true;
+        return 0;
+    }
+    xsink->raiseException("TDS-OPTION-ERROR", "invalid value for the '%s' option: '%s'; expecting \"ordered\" or "
+        "\"random\"", SYBASE_OPT_FAILOVER_ORDER, order);
+    return -1;
+}
+
+std::vector<FailoverHost> FailoverConfig::getCandidates(const char* host, int port) const {
+    std::vector<FailoverHost> rv;
+    FailoverHost primary;
+    if (host)
+        primary.host = host;
+    primary.port = port;
+    rv.push_back(primary);
+    for (auto& i : hosts) {
+        if (!(i == primary))
+            rv.push_back(i);
+    }
+    if (random)
+        std::shuffle(rv.begin(), rv.end(), get_rng());
+    return rv;
+}
+
+int64 FailoverConfig::getBackoff(int pass) const {
+    return get_backoff(backoff, max_backoff, pass);
+}
+
+int64 get_backoff(int64 base, int64 max, int retry) {
+    if (retry <= 0 || base <= 0)
+        return 0;
+    int64 ms = base;
+    for (int i = 1; i < retry && ms < max; ++i)
+        ms *= 2;
+    if (ms > max)
+        ms = max;
+    // jitter keeps clients that failed at the same time from retrying in lockstep
+    std::uniform_int_distribution<int64> dist(ms / 2, ms);
+    return dist(get_rng());
+}
+
+} // namespace ss
+
+// EOF
@@ -0,0 +1,155 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    failover.h
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SYBASE_FAILOVER_H_
+#define SYBASE_FAILOVER_H_
+
+#include "qore/Qore.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// default backoff in milliseconds before the second pass over the failover hosts
+#define SYBASE_DEFAULT_FAILOVER_BACKOFF 100
+// default maximum backoff in milliseconds between passes over the failover hosts
+#define SYBASE_DEFAULT_FAILOVER_MAX_BACKOFF 5000
+// default number of passes over the failover hosts
+#define SYBASE_DEFAULT_FAILOVER_ATTEMPTS 3
+
+namespace ss {
+
+// returns the time in milliseconds to wait before the given retry (starting with 1): "base" doubled for each
+// further retry up to "max", with random jitter between half and all of the value
+DLLLOCAL int64 get_backoff(int64 base, int64 max, int retry);
+
+// a server that a connection can be opened to; an empty host means the server from the interfaces file
+struct FailoverHost {
+    std::string host;
+    int port = 0;
+
+    DLLLOCAL bool operator==(const FailoverHost& other) const {
+        return port == other.port && host == other.host;
+    }
+
+    // returns the key of the host's circuit breaker
+    DLLLOCAL std::string getKey() const;
+};
+
+// parses a list of "host:port" servers separated by commas or spaces for the given option; "what" names an entry
+// in error messages
+// returns 0=OK, -1=error (exception raised)
+DLLLOCAL int parse_host_list(const char* spec, const char* opt, const char* what, std::vector<FailoverHost>& hosts,
+    ExceptionSink* xsink);
+
+// circuit breakers for the servers that connections are opened to; shared by all connections in the process so
+// that a failed server is skipped without waiting for the login timeout
+class HostBreakers {
+public:
+    // returns true if a connection to the host may be attempted; after the breaker has opened, a single attempt
+    // is allowed once the cooldown period has passed
+    DLLLOCAL bool allow(const std::string& key);
+
+    // returns true if the breaker for the host is open
+    DLLLOCAL bool isOpen(const std::string& key);
+
+    // records a successful connection and closes the breaker
+    DLLLOCAL void success(const std::string& key);
+
+    // records a failed connection; the breaker is opened after consecutive failures
+    DLLLOCAL void failure(const std::string& key);
+
+    // returns a list of hashes with the status of all hosts
+    DLLLOCAL QoreListNode* getList(ExceptionSink* xsink);
+
+private:
+    struct state_t {
+        // consecutive failures
+        int failures = 0;
+        // the time in milliseconds until which no connection is attempted; 0 = closed
+        int64 open_until = 0;
+        // true while the single attempt after the cooldown is in progress
+        bool probing = false;
+        int64 total_failures = 0;
+    };
+
+    QoreThreadLock lck;
+    std::map<std::string, state_t> hosts;
+};
+
+DLLLOCAL extern HostBreakers host_breakers;
+
+// the failover configuration of a connection
+class FailoverConfig {
+public:
+    // the number of passes over the hosts before giving up
+    int attempts = SYBASE_DEFAULT_FAILOVER_ATTEMPTS;
+    // the backoff in milliseconds before the second pass; doubled on each further pass
+    int backoff = SYBASE_DEFAULT_FAILOVER_BACKOFF;
+    // the maximum backoff in milliseconds
+    int max_backoff = SYBASE_DEFAULT_FAILOVER_MAX_BACKOFF;
+    // keep a connection to the next host open in the background
+    bool standby = false;
+
+    // parses a list of "host:port" servers separated by commas or spaces
+    // returns 0=OK, -1=error (exception raised)
+    DLLLOCAL int parse(const char* spec, ExceptionSink* xsink);
+
+    // sets the order in which hosts are tried: "ordered" or "random"
+    // returns 0=OK, -1=error (exception raised)
+    DLLLOCAL int setOrder(const char* order, ExceptionSink* xsink);
+
+    DLLLOCAL const char* getOrder() const {
+        return random ? "random" : "ordered";
+    }
+
+    DLLLOCAL bool empty() const {
+        return hosts.empty();
+    }
+
+    DLLLOCAL const std::string& getSpec() const {
+        return spec;
+    }
+
+    // returns the hosts in the order that they should be tried; the Datasource's server is the first host unless
+    // the order is random
+    DLLLOCAL std::vector<FailoverHost> getCandidates(const char* host, int port) const;
+
+    // returns the time in milliseconds to wait before the given pass over the hosts (starting with 1) with
+    // random jitter between half and all of the exponential backoff
+    DLLLOCAL int64 getBackoff(int pass) const;
+
+private:
+    std::string spec;
+    std::vector<FailoverHost> hosts;
+    bool random = false;
+};
+
+} // namespace ss
+
+#endif
+
+// EOF
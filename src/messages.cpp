@@ -0,0 +1,109 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    messages.cpp
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "sybase.h"
+#include "messages.h"
+
+#include <string.h>
+
+namespace ss {
+
+// copies a message string with the given length into a fixed-size buffer
+static void copy_msg_string(CS_CHAR* dst, size_t size, const CS_CHAR* src, CS_INT len) {
+    size_t l = len < 0 ? strlen(src) : (size_t)len;
+    if (l >= size)
+        l = size - 1;
+    memcpy(dst, src, l);
+    dst[l] = '\0';
+}
+
+void MessageRing::addClient(const CS_CLIENTMSG& msg) {
+    AutoLocker al(lck);
+    Message& m = next();
+    m.server = false;
+    m.number = CS_NUMBER(msg.msgnumber);
+    m.severity = CS_SEVERITY(msg.msgnumber);
+    m.state = 0;
+    m.line = 0;
+    m.osnumber = msg.osnumber;
+    copy_msg_string(m.text, sizeof(m.text), msg.msgstring, msg.msgstringlen);
+    m.server_name[0] = '\0';
+    if (msg.osstringlen > 0)
+        copy_msg_string(m.os_text, sizeof(m.os_text), msg.osstring, msg.osstringlen);
+    else
+        m.os_text[0] = '\0';
+    has_unchecked = true;
+}
+
+void MessageRing::addServer(const CS_SERVERMSG& msg) {
+    AutoLocker al(lck);
+    Message& m = next();
+    m.server = true;
+    m.number = msg.msgnumber;
+    m.severity = msg.severity;
+    m.state = msg.state;
+    m.line = msg.line;
+    m.osnumber = 0;
+    copy_msg_string(m.text, sizeof(m.text), msg.text, msg.textlen);
+    if (msg.svrnlen > 0)
+        copy_msg_string(m.server_name, sizeof(m.server_name), msg.svrname, msg.svrnlen);
+    else
+        m.server_name[0] = '\0';
+    m.os_text[0] = '\0';
+    has_unchecked = true;
+}
+
+QoreListNode* MessageRing::getList() const {
+    ReferenceHolder<QoreListNode> l(new QoreListNode(autoHashTypeInfo), nullptr);
+    AutoLocker al(lck);
+    uint64_t start = total > SIZE ? total - SIZE : 0;
+    for (uint64_t i = start; i < total; ++i) {
+        l->push(msgs[i % SIZE].getHash(), nullptr);
+    }
+    return l.release();
+}
+
+QoreHashNode* Message::getHash() const {
+    ReferenceHolder<QoreHashNode> h(new QoreHashNode(autoTypeInfo), nullptr);
+    h->setKeyValue("type", new QoreStringNode(server ? "server" : "client"), nullptr);
+    h->setKeyValue("number", number, nullptr);
+    h->setKeyValue("severity", severity, nullptr);
+    h->setKeyValue("text", new QoreStringNode(text), nullptr);
+    if (server) {
+        h->setKeyValue("state", state, nullptr);
+        h->setKeyValue("line", line, nullptr);
+        if (server_name[0])
+            h->setKeyValue("server", new QoreStringNode(server_name), nullptr);
+    } else if (os_text[0]) {
+        h->setKeyValue("os_number", osnumber, nullptr);
+        h->setKeyValue("os_text", new QoreStringNode(os_text), nullptr);
+    }
+    return h.release();
+}
+
+} // namespace ss
+
+// EOF
@@ -0,0 +1,125 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    messages.h
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SYBASE_MESSAGES_H_
+#define SYBASE_MESSAGES_H_
+
+#include "qore/Qore.h"
+
+#include <cstypes.h>
+#include <ctpublic.h>
+
+#include <atomic>
+#include <vector>
+
+// maximum length of operating system error strings kept for client messages
+#define SYBASE_MSG_OS_TEXT_LEN 256
+
+namespace ss {
+
+// a message from the client library or the server
+struct Message {
+    // true for server messages, false for client library messages
+    bool server;
+    CS_INT number;
+    CS_INT severity;
+    // server messages only
+    CS_INT state;
+    CS_INT line;
+    // client messages only
+    CS_INT osnumber;
+    CS_CHAR text[CS_MAX_MSG];
+    CS_CHAR server_name[CS_MAX_NAME];
+    CS_CHAR os_text[SYBASE_MSG_OS_TEXT_LEN];
+
+    // returns a hash describing the message
+    DLLLOCAL QoreHashNode* getHash() const;
+};
+
+// a fixed-size ring of the most recent messages for a connection, filled by the ct-lib message callbacks
+class MessageRing {
+public:
+    static const unsigned SIZE = 16;
+
+    DLLLOCAL void addClient(const CS_CLIENTMSG& msg);
+    DLLLOCAL void addServer(const CS_SERVERMSG& msg);
+
+    // returns true if there are messages that have not been checked yet
+    DLLLOCAL bool hasUnchecked() const {
+        return has_unchecked;
+    }
+
+    // calls the given function for each message that has not been checked yet; if more than SIZE messages were
+    // received since the last check, older informational messages may have been overwritten, but errors are kept
+    template <typename F>
+    DLLLOCAL void forEachUnchecked(F f) {
+        AutoLocker al(lck);
+        for (auto& i : overflow) {
+            f(i);
+        }
+        uint64_t start = total - checked > SIZE ? total - SIZE : checked;
+        for (uint64_t i = start; i < total; ++i) {
+            f(msgs[i % SIZE]);
+        }
+    }
+
+    // marks all messages as checked
+    DLLLOCAL void markChecked() {
+        AutoLocker al(lck);
+        checked = total;
+        overflow.clear();
+        has_unchecked = false;
+    }
+
+    // returns a list of the most recent messages, oldest first
+    DLLLOCAL QoreListNode* getList() const;
+
+private:
+    mutable QoreThreadLock lck;
+    Message msgs[SIZE];
+    // the number of messages received and checked
+    uint64_t total = 0;
+    uint64_t checked = 0;
+    std::atomic<bool> has_unchecked{false};
+    // unchecked errors that were pushed out of the ring, oldest first
+    std::vector<Message> overflow;
+
+    // returns the next message slot; must be called with the lock held
+    DLLLOCAL Message& next() {
+        Message& m = msgs[total % SIZE];
+        // an unchecked error must not be lost when the ring wraps
+        if (total - checked >= SIZE && m.severity > 10)
+            overflow.push_back(m);
+        ++total;
+        return m;
+    }
+};
+
+} // namespace ss
+
+#endif
+
+// EOF
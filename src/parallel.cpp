@@ -0,0 +1,1117 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    parallel.cpp
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <assert.h>
+
+#include <string.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sybase.h"
+#include "connection.h"
+#include "command.h"
+#include "parallel.h"
+
+// maximum number of rows buffered for each range before the worker thread waits for the consumer
+static const size_t PARALLEL_QUEUE_SIZE = 1000;
+// default number of ranges if no split points are given
+static const int64 PARALLEL_DEFAULT_PARTITIONS = 4;
+
+// returns a description of a parsed datasource as user@db(host:port) for error messages; the password is never
+// included
+static std::string get_datasource_desc(const QoreHashNode* h) {
+    std::string desc;
+    QoreValue v = h->getKeyValue("user");
+    if (v.getType() == NT_STRING)
+        desc = v.get<const QoreStringNode>()->c_str();
+    desc += '@';
+    v = h->getKeyValue("db");
+    if (v.getType() == NT_STRING)
+        desc += v.get<const QoreStringNode>()->c_str();
+    v = h->getKeyValue("host");
+    if (v.getType() == NT_STRING) {
+        desc += '(';
+        desc += v.get<const QoreStringNode>()->c_str();
+        v = h->getKeyValue("port");
+        if (!v.isNothing()) {
+            desc += ':';
+            desc += std::to_string(v.getAsBigInt());
+        }
+        desc += ')';
+    }
+    return desc;
+}
+
+Datasource* ss::open_datasource(const char* dsstr, ExceptionSink* xsink) {
+    ReferenceHolder<QoreHashNode> h(parseDatasource(dsstr, xsink), xsink);
+    if (!h)
+        return nullptr;
+
+    DBIDriver* driver = sybase_get_driver();
+
+    QoreValue v = h->getKeyValue("type");
+    if (v.getType() == NT_STRING && strcmp(v.get<const QoreStringNode>()->c_str(), driver->getName())) {
+        xsink->raiseException("TDS-DATASOURCE-ERROR", "datasource '%s' is for driver '%s'; expecting '%s'",
+            get_datasource_desc(*h).c_str(), v.get<const QoreStringNode>()->c_str(), driver->getName());
+        return nullptr;
+    }
+
+    std::unique_ptr<Datasource> ds(new Datasource(driver));
+    v = h->getKeyValue("user");
+    if (v.getType() == NT_STRING)
+        ds->setPendingUsername(v.get<const QoreStringNode>()->c_str());
+    v = h->getKeyValue("pass");
+    if (v.getType() == NT_STRING)
+        ds->setPendingPassword(v.get<const QoreStringNode>()->c_str());
+    v = h->getKeyValue("db");
+    if (v.getType() == NT_STRING)
+        ds->setPendingDBName(v.get<const QoreStringNode>()->c_str());
+    v = h->getKeyValue("charset");
+    if (v.getType() == NT_STRING)
+        ds->setPendingDBEncoding(v.get<const QoreStringNode>()->c_str());
+    v = h->getKeyValue("host");
+    if (v.getType() == NT_STRING)
+        ds->setPendingHostName(v.get<const QoreStringNode>()->c_str());
+    v = h->getKeyValue("port");
+    if (!v.isNothing())
+        ds->setPendingPort((int)v.getAsBigInt());
+
+    // options are set before the connection is opened so that connect-time options are applied
+    v = h->getKeyValue("options");
+    if (v.getType() == NT_HASH) {
+        ConstHashIterator hi(v.get<const QoreHashNode>());
+        while (hi.next()) {
+            if (ds->setOption(hi.getKey(), hi.get(), xsink))
+                return nullptr;
+        }
+    }
+
+    if (ds->open(xsink))
+        return nullptr;
+    return ds.release();
+}
+
+void ss::close_datasource(Datasource* ds) {
+    ds->close();
+    delete ds;
+}
+
+namespace {
+struct range_queue {
+    std::deque<QoreHashNode*> rows;
+    bool done = false;
+};
+
+class ParallelSelectState;
+
+struct parallel_range {
+    ParallelSelectState* state;
+    unsigned index;
+    // range bounds; NOTHING = unbounded
+    QoreValue lo, hi;
+};
+
+class ParallelSelectState {
+public:
+    std::string dsstr;
+    std::string columns = "*";
+    std::string table;
+    std::string key;
+    std::string where;
+    const QoreListNode* args = nullptr;
+    bool ordered = true;
+
+    std::vector<parallel_range> ranges;
+
+    DLLLOCAL ParallelSelectState() {
+    }
+
+    DLLLOCAL ~ParallelSelectState() {
+        ExceptionSink xsink;
+        for (auto& q : queues) {
+            for (auto* h : q.rows) {
+                h->deref(&xsink);
+            }
+        }
+        for (auto& r : ranges) {
+            r.lo.discard(&xsink);
+            r.hi.discard(&xsink);
+        }
+    }
+
+    // starts one thread per range; returns -1 if an error occurred (exception raised)
+    DLLLOCAL int start(ExceptionSink* xsink);
+
+    // returns the next row; nullptr = no more rows or an error occurred in a worker thread
+    DLLLOCAL QoreHashNode* pop();
+
+    // stops all workers and waits for them to terminate; any worker exceptions are moved to the given sink
+    DLLLOCAL void finish(ExceptionSink* xsink);
+
+    // called in the worker thread
+    DLLLOCAL void run(parallel_range& r);
+
+private:
+    QoreThreadLock l;
+    QoreCondition cond;
+    std::vector<range_queue> queues;
+    // number of worker threads running
+    unsigned running = 0;
+    // the current range when merging in order, or the next range to check when merging unordered
+    unsigned current = 0;
+    bool abort = false;
+    // exceptions raised in worker threads
+    ExceptionSink err;
+
+    // returns -1 if the operation has been aborted, in which case the row is not consumed
+    DLLLOCAL int push(unsigned i, ReferenceHolder<QoreHashNode>& h);
+
+    DLLLOCAL void runIntern(parallel_range& r, ExceptionSink* xsink);
+};
+}
+
+static void parallel_select_worker(ExceptionSink* xsink, void* arg) {
+    parallel_range* r = reinterpret_cast<parallel_range*>(arg);
+    r->state->run(*r);
+}
+
+int ParallelSelectState::start(ExceptionSink* xsink) {
+    queues.resize(ranges.size());
+    for (auto& r : ranges) {
+        {
+            AutoLocker al(l);
+            ++running;
+        }
+        if (q_start_thread(xsink, parallel_select_worker, &r) < 0) {
+            AutoLocker al(l);
+            --running;
+            queues[r.index].done = true;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int ParallelSelectState::push(unsigned i, ReferenceHolder<QoreHashNode>& h) {
+    AutoLocker al(l);
+    while (!abort && queues[i].rows.size() >= PARALLEL_QUEUE_SIZE) {
+        cond.wait(&l);
+    }
+    if (abort)
+        return -1;
+    queues[i].rows.push_back(h.release());
+    cond.broadcast();
+    return 0;
+}
+
+QoreHashNode* ParallelSelectState::pop() {
+    AutoLocker al(l);
+    while (true) {
+        if (abort)
+            return nullptr;
+
+        if (ordered) {
+            // ranges are disjoint and each one is sorted, so the merged stream is ordered if the ranges are
+            // consumed in sequence
+            while (current < queues.size()) {
+                range_queue& q = queues[current];
+                if (!q.rows.empty()) {
+                    QoreHashNode* rv = q.rows.front();
+                    q.rows.pop_front();
+                    cond.broadcast();
+                    return rv;
+                }
+                if (!q.done)
+                    break;
+                ++current;
+            }
+            if (current == queues.size())
+                return nullptr;
+        } else {
+            // take rows from the ranges in a round-robin fashion as they become available
+            for (unsigned j = 0, n = queues.size(); j < n; ++j) {
+                range_queue& q = queues[(current + j) % n];
+                if (!q.rows.empty()) {
+                    current = (current + j + 1) % n;
+                    QoreHashNode* rv = q.rows.front();
+                    q.rows.pop_front();
+                    cond.broadcast();
+                    return rv;
+                }
+            }
+            if (!running)
+                return nullptr;
+        }
+
+        cond.wait(&l);
+    }
+}
+
+void ParallelSelectState::finish(ExceptionSink* xsink) {
+    AutoLocker al(l);
+    abort = true;
+    cond.broadcast();
+    while (running) {
+        cond.wait(&l);
+    }
+    if (err)
+        xsink->assimilate(err);
+}
+
+void ParallelSelectState::run(parallel_range& r) {
+    ExceptionSink xsink;
+    try {
+        runIntern(r, &xsink);
+    } catch (const ss::Error& e) {
+        e.raise(&xsink);
+    }
+
+    AutoLocker al(l);
+    if (xsink) {
+        err.assimilate(xsink);
+        abort = true;
+    }
+    queues[r.index].done = true;
+    --running;
+    cond.broadcast();
+}
+
+void ParallelSelectState::runIntern(parallel_range& r, ExceptionSink* xsink) {
+    QoreString sql;
+    sql.sprintf("select %s from %s", columns.c_str(), table.c_str());
+    bool has_where = false;
+    if (!where.empty()) {
+        sql.sprintf(" where (%s)", where.c_str());
+        has_where = true;
+    }
+
+    ReferenceHolder<QoreListNode> qargs(args ? args->copy() : new QoreListNode(autoTypeInfo), xsink);
+    if (!r.lo.isNothing()) {
+        sql.sprintf(" %s %s >= %%v", has_where ? "and" : "where", key.c_str());
+        has_where = true;
+        qargs->push(r.lo.refSelf(), xsink);
+    }
+    if (!r.hi.isNothing()) {
+        // rows with a NULL key are returned with the first range, where they also sort first
+        if (r.lo.isNothing())
+            sql.sprintf(" %s (%s < %%v or %s is null)", has_where ? "and" : "where", key.c_str(), key.c_str());
+        else
+            sql.sprintf(" %s %s < %%v", has_where ? "and" : "where", key.c_str());
+        qargs->push(r.hi.refSelf(), xsink);
+    }
+    if (ordered)
+        sql.sprintf(" order by %s", key.c_str());
+
+    printd(5, "ParallelSelectState::runIntern() range %u: %s\n", r.index, sql.c_str());
+
+    Datasource* ds = ss::open_datasource(dsstr.c_str(), xsink);
+    if (!ds)
+        return;
+    ON_BLOCK_EXIT(ss::close_datasource, ds);
+
+    connection* conn = (connection*)ds->getPrivateData();
+    std::unique_ptr<QoreString> query(sql.convertEncoding(conn->getEncoding(), xsink));
+    if (!query)
+        return;
+
+    command_ptr cmd(conn->setupCommand(query.get(), *qargs, false, xsink));
+    if (*xsink)
+        return;
+
+    bool connection_reset = false;
+    while (true) {
+        command::ResType rt = conn->readNextResult(*cmd, connection_reset, xsink);
+        if (*xsink)
+            return;
+        if (rt == command::RES_END)
+            break;
+        if (rt == command::RES_DONE)
+            continue;
+        if (rt != command::RES_ROW) {
+            cmd->cancel();
+            break;
+        }
+
+        while (true) {
+            ReferenceHolder<QoreHashNode> h(cmd->fetch_row(xsink), xsink);
+            if (*xsink)
+                return;
+            if (!h)
+                break;
+            if (push(r.index, h)) {
+                cmd->cancel();
+                return;
+            }
+        }
+    }
+
+    conn->purge_messages(xsink);
+    // end the chained transaction started by the select
+    conn->commit(xsink);
+}
+
+// samples split points from the table by interpolating between the minimum and maximum key values
+// returns -1 if an error occurred (exception raised)
+static int parallel_sample_splits(ParallelSelectState& state, int64 partitions, std::vector<int64>& splits,
+        ExceptionSink* xsink) {
+    Datasource* ds = ss::open_datasource(state.dsstr.c_str(), xsink);
+    if (!ds)
+        return -1;
+    ON_BLOCK_EXIT(ss::close_datasource, ds);
+    connection* conn = (connection*)ds->getPrivateData();
+
+    QoreStringMaker sql("select min(%s) as lo, max(%s) as hi from %s", state.key.c_str(), state.key.c_str(),
+        state.table.c_str());
+    if (!state.where.empty())
+        sql.sprintf(" where (%s)", state.where.c_str());
+
+    ValueHolder res(conn->exec_row(&sql, state.args, xsink), xsink);
+    if (*xsink)
+        return -1;
+    conn->commit(xsink);
+    if (*xsink)
+        return -1;
+
+    if (res->getType() != NT_HASH)
+        return 0;
+    QoreValue lo = res->get<const QoreHashNode>()->getKeyValue("lo");
+    QoreValue hi = res->get<const QoreHashNode>()->getKeyValue("hi");
+    // empty table: read everything in a single range
+    if (lo.isNullOrNothing() || hi.isNullOrNothing())
+        return 0;
+
+    if (lo.getType() != NT_INT || hi.getType() != NT_INT) {
+        xsink->raiseException("PARALLEL-SELECT-ERROR", "cannot sample split points for key column '%s' with type "
+            "'%s'; only integer keys can be sampled; use the 'splits' option to provide split points for other types",
+            state.key.c_str(), lo.getTypeName());
+        return -1;
+    }
+
+    int64 ilo = lo.getAsBigInt();
+    int64 ihi = hi.getAsBigInt();
+    long double width = ((long double)ihi - (long double)ilo + 1) / partitions;
+    for (int64 i = 1; i < partitions; ++i) {
+        int64 s = ilo + (int64)(width * i);
+        if (s <= ilo || s > ihi || (!splits.empty() && s <= splits.back()))
+            continue;
+        splits.push_back(s);
+    }
+    return 0;
+}
+
+QoreValue ss::parallel_select(const QoreStringNode* dsstr, const QoreStringNode* table, const QoreStringNode* key,
+        const QoreHashNode* opts, const ResolvedCallReferenceNode* callback, ExceptionSink* xsink) {
+    ParallelSelectState state;
+    state.dsstr = dsstr->c_str();
+    state.table = table->c_str();
+    state.key = key->c_str();
+
+    int64 partitions = PARALLEL_DEFAULT_PARTITIONS;
+    const QoreListNode* splits = nullptr;
+    if (opts) {
+        QoreValue v = opts->getKeyValue("columns");
+        if (v.getType() == NT_STRING)
+            state.columns = v.get<const QoreStringNode>()->c_str();
+        v = opts->getKeyValue("where");
+        if (v.getType() == NT_STRING)
+            state.where = v.get<const QoreStringNode>()->c_str();
+        v = opts->getKeyValue("args");
+        if (v.getType() == NT_LIST)
+            state.args = v.get<const QoreListNode>();
+        v = opts->getKeyValue("ordered");
+        if (!v.isNothing())
+            state.ordered = v.getAsBool();
+        v = opts->getKeyValue("splits");
+        if (v.getType() == NT_LIST)
+            splits = v.get<const QoreListNode>();
+        v = opts->getKeyValue("partitions");
+        if (!v.isNothing()) {
+            partitions = v.getAsBigInt();
+            if (partitions < 1) {
+                xsink->raiseException("PARALLEL-SELECT-ERROR", "the 'partitions' option must be at least 1; got "
+                    QLLD, partitions);
+                return QoreValue();
+            }
+        }
+    }
+
+    // setup the ranges: (-inf, s1), [s1, s2), ..., [sN, +inf)
+    if (splits) {
+        unsigned n = splits->size();
+        state.ranges.resize(n + 1);
+        for (unsigned i = 0; i <= n; ++i) {
+            parallel_range& r = state.ranges[i];
+            if (i)
+                r.lo = splits->retrieveEntry(i - 1).refSelf();
+            if (i < n)
+                r.hi = splits->retrieveEntry(i).refSelf();
+        }
+    } else {
+        std::vector<int64> sv;
+        if (partitions > 1 && parallel_sample_splits(state, partitions, sv, xsink))
+            return QoreValue();
+        state.ranges.resize(sv.size() + 1);
+        for (unsigned i = 0, n = sv.size(); i <= n; ++i) {
+            parallel_range& r = state.ranges[i];
+            if (i)
+                r.lo = sv[i - 1];
+            if (i < n)
+                r.hi = sv[i];
+        }
+    }
+    for (unsigned i = 0, n = state.ranges.size(); i < n; ++i) {
+        state.ranges[i].state = &state;
+        state.ranges[i].index = i;
+    }
+
+    printd(5, "ss::parallel_select() table: %s key: %s ranges: %d ordered: %d\n", state.table.c_str(),
+        state.key.c_str(), (int)state.ranges.size(), state.ordered);
+
+    ReferenceHolder<QoreListNode> rv(callback ? nullptr : new QoreListNode(autoTypeInfo), xsink);
+    int64 count = 0;
+
+    if (!state.start(xsink)) {
+        while (true) {
+            ReferenceHolder<QoreHashNode> h(state.pop(), xsink);
+            if (!h)
+                break;
+            ++count;
+            if (callback) {
+                ReferenceHolder<QoreListNode> cargs(new QoreListNode(autoTypeInfo), xsink);
+                cargs->push(h.release(), xsink);
+                ValueHolder cbrv(callback->execValue(*cargs, xsink), xsink);
+                if (*xsink)
+                    break;
+            } else {
+                rv->push(h.release(), xsink);
+            }
+        }
+    }
+
+    // wait for all workers to terminate in all cases
+    state.finish(xsink);
+    if (*xsink)
+        return QoreValue();
+
+    if (callback)
+        return count;
+    return rv.release();
+}
+
+namespace {
+enum sg_mode_t {
+    SG_CONCAT,
+    SG_MERGE,
+    SG_AGGREGATE,
+};
+
+struct shard_state {
+    std::string dsstr;
+    std::deque<QoreHashNode*> rows;
+    bool done = false;
+    // number of rows received from the shard
+    int64 count = 0;
+    int64 start_ms = 0;
+    int64 end_ms = 0;
+    // the error raised by the shard, if any
+    ExceptionSink err;
+};
+
+class ScatterGatherState;
+
+struct shard_arg {
+    ScatterGatherState* state;
+    unsigned index;
+};
+
+class ScatterGatherState {
+public:
+    const QoreString* sql = nullptr;
+    const QoreListNode* args = nullptr;
+    sg_mode_t mode = SG_CONCAT;
+    // the key column for merging
+    std::string key;
+    // compare string keys case-insensitively
+    bool nocase = false;
+
+    std::vector<std::unique_ptr<shard_state>> shards;
+
+    DLLLOCAL ~ScatterGatherState() {
+        ExceptionSink xsink;
+        for (auto& s : shards) {
+            for (auto* h : s->rows) {
+                h->deref(&xsink);
+            }
+            s->err.clear();
+        }
+    }
+
+    // starts one thread per shard; returns -1 if an error occurred (exception raised)
+    DLLLOCAL int start(ExceptionSink* xsink);
+
+    // returns the next row; nullptr = no more rows
+    DLLLOCAL QoreHashNode* pop();
+
+    // stops all workers and waits for them to terminate
+    DLLLOCAL void finish();
+
+    // returns a list of hashes describing the result of each shard
+    DLLLOCAL QoreListNode* getShardInfo(ExceptionSink* xsink);
+
+    // called in the worker thread
+    DLLLOCAL void run(unsigned i);
+
+private:
+    QoreThreadLock l;
+    QoreCondition cond;
+    std::vector<shard_arg> thread_args;
+    // number of worker threads running
+    unsigned running = 0;
+    // the next shard to check when concatenating
+    unsigned current = 0;
+    bool abort = false;
+
+    // returns -1 if the operation has been aborted, in which case the row is not consumed
+    DLLLOCAL int push(unsigned i, ReferenceHolder<QoreHashNode>& h);
+
+    DLLLOCAL void runIntern(shard_state& s, unsigned i, ExceptionSink* xsink);
+};
+
+static bool sg_is_numeric(qore_type_t t) {
+    return t == NT_INT || t == NT_NUMBER || t == NT_FLOAT;
+}
+
+// returns the value as an arbitrary-precision number
+static QoreNumberNode* sg_get_number(QoreValue v) {
+    switch (v.getType()) {
+        case NT_NUMBER:
+            return v.get<const QoreNumberNode>()->numberRefSelf();
+        case NT_INT:
+            return new QoreNumberNode(v.getAsBigInt());
+        case NT_FLOAT:
+            return new QoreNumberNode(v.getAsFloat());
+        default: {
+            QoreStringValueHelper str(v);
+            return new QoreNumberNode(str->c_str());
+        }
+    }
+}
+
+// compares two column values for merging; NULL values sort first; numbers and dates are compared by value, and
+// strings byte-wise like the server's default binary sort order unless "nocase" is set
+static int sg_compare(QoreValue a, QoreValue b, bool nocase) {
+    bool an = a.isNullOrNothing();
+    bool bn = b.isNullOrNothing();
+    if (an || bn)
+        return an == bn ? 0 : (an ? -1 : 1);
+
+    qore_type_t at = a.getType();
+    qore_type_t bt = b.getType();
+    if (at == NT_INT && bt == NT_INT) {
+        int64 x = a.getAsBigInt();
+        int64 y = b.getAsBigInt();
+        return x < y ? -1 : (x > y ? 1 : 0);
+    }
+    if (sg_is_numeric(at) && sg_is_numeric(bt)) {
+        if (at == NT_FLOAT && bt == NT_FLOAT) {
+            double x = a.getAsFloat();
+            double y = b.getAsFloat();
+            return x < y ? -1 : (x > y ? 1 : 0);
+        }
+        // numeric and money values are compared without loss of precision
+        SimpleRefHolder<QoreNumberNode> x(sg_get_number(a));
+        SimpleRefHolder<QoreNumberNode> y(sg_get_number(b));
+        return x->compare(**y);
+    }
+    if (at == NT_DATE && bt == NT_DATE)
+        return DateTime::compareDates(a.get<const DateTimeNode>(), b.get<const DateTimeNode>());
+
+    QoreStringValueHelper x(a);
+    QoreStringValueHelper y(b);
+    return nocase ? strcasecmp(x->c_str(), y->c_str()) : strcmp(x->c_str(), y->c_str());
+}
+
+// adds two values for the "sum" aggregate: integers are added as integers and promoted to numbers on overflow,
+// values with floating-point types are added as floats, and all other values as arbitrary-precision numbers
+static QoreValue sg_add(QoreValue a, QoreValue b) {
+    qore_type_t at = a.getType();
+    qore_type_t bt = b.getType();
+    if (at == NT_INT && bt == NT_INT) {
+        int64 rv;
+        if (!__builtin_add_overflow(a.getAsBigInt(), b.getAsBigInt(), &rv))
+            return rv;
+    } else if ((at == NT_FLOAT || bt == NT_FLOAT) && at != NT_NUMBER && bt != NT_NUMBER) {
+        return a.getAsFloat() + b.getAsFloat();
+    }
+    SimpleRefHolder<QoreNumberNode> x(sg_get_number(a));
+    SimpleRefHolder<QoreNumberNode> y(sg_get_number(b));
+    return x->doPlus(**y);
+}
+
+enum sg_agg_op_t {
+    SG_SUM,
+    SG_MIN,
+    SG_MAX,
+    SG_COUNT,
+};
+
+// groups rows by column values and aggregates other columns
+class ScatterGatherAggregator {
+public:
+    // compare strings case-insensitively for "min" and "max"
+    bool nocase = false;
+
+    // returns -1 if the options are invalid (exception raised)
+    DLLLOCAL int init(const QoreHashNode* opts, ExceptionSink* xsink);
+
+    DLLLOCAL void add(QoreHashNode* row, ExceptionSink* xsink);
+
+    // returns the aggregated rows in the order each group was first seen
+    DLLLOCAL QoreListNode* getRows(ExceptionSink* xsink);
+
+    DLLLOCAL ~ScatterGatherAggregator() {
+        ExceptionSink xsink;
+        for (auto* h : groups) {
+            h->deref(&xsink);
+        }
+    }
+
+private:
+    std::vector<std::string> group_by;
+    std::vector<std::pair<std::string, sg_agg_op_t>> aggs;
+    std::map<std::string, size_t> index;
+    std::vector<QoreHashNode*> groups;
+};
+
+int ScatterGatherAggregator::init(const QoreHashNode* opts, ExceptionSink* xsink) {
+    QoreValue v = opts ? opts->getKeyValue("group_by") : QoreValue();
+    if (v.getType() == NT_STRING) {
+        group_by.push_back(v.get<const QoreStringNode>()->c_str());
+    } else if (v.getType() == NT_LIST) {
+        ConstListIterator li(v.get<const QoreListNode>());
+        while (li.next()) {
+            QoreStringValueHelper str(li.getValue());
+            group_by.push_back(str->c_str());
+        }
+    }
+
+    v = opts ? opts->getKeyValue("aggregates") : QoreValue();
+    if (v.getType() != NT_HASH) {
+        xsink->raiseException("SCATTER-GATHER-ERROR", "the 'aggregates' option must be a hash of column names to "
+            "aggregate operations when the 'mode' option is \"aggregate\"");
+        return -1;
+    }
+    ConstHashIterator hi(v.get<const QoreHashNode>());
+    while (hi.next()) {
+        QoreStringValueHelper op(hi.get());
+        sg_agg_op_t o;
+        if (!strcasecmp(op->c_str(), "sum"))
+            o = SG_SUM;
+        else if (!strcasecmp(op->c_str(), "min"))
+            o = SG_MIN;
+        else if (!strcasecmp(op->c_str(), "max"))
+            o = SG_MAX;
+        else if (!strcasecmp(op->c_str(), "count"))
+            o = SG_COUNT;
+        else {
+            xsink->raiseException("SCATTER-GATHER-ERROR", "unknown aggregate operation '%s' for column '%s'; "
+                "expecting one of \"sum\", \"min\", \"max\", or \"count\"", op->c_str(), hi.getKey());
+            return -1;
+        }
+        aggs.push_back(std::make_pair(std::string(hi.getKey()), o));
+    }
+    return 0;
+}
+
+void ScatterGatherAggregator::add(QoreHashNode* row, ExceptionSink* xsink) {
+    std::string gkey;
+    for (auto& c : group_by) {
+        QoreValue v = row->getKeyValue(c.c_str());
+        if (v.isNullOrNothing()) {
+            gkey += '\x1e';
+        } else {
+            QoreStringValueHelper str(v);
+            gkey.append(str->c_str(), str->size());
+        }
+        gkey += '\x1f';
+    }
+
+    std::map<std::string, size_t>::iterator i = index.find(gkey);
+    if (i == index.end()) {
+        ReferenceHolder<QoreHashNode> h(new QoreHashNode(autoTypeInfo), xsink);
+        for (auto& c : group_by) {
+            h->setKeyValue(c.c_str(), row->getKeyValue(c.c_str()).refSelf(), xsink);
+        }
+        for (auto& a : aggs) {
+            if (a.second == SG_COUNT)
+                h->setKeyValue(a.first.c_str(), 1, xsink);
+            else
+                h->setKeyValue(a.first.c_str(), row->getKeyValue(a.first.c_str()).refSelf(), xsink);
+        }
+        index[gkey] = groups.size();
+        groups.push_back(h.release());
+        return;
+    }
+
+    QoreHashNode* h = groups[i->second];
+    for (auto& a : aggs) {
+        const char* col = a.first.c_str();
+        QoreValue cur = h->getKeyValue(col);
+        if (a.second == SG_COUNT) {
+            h->setKeyValue(col, cur.getAsBigInt() + 1, xsink);
+            continue;
+        }
+        QoreValue v = row->getKeyValue(col);
+        if (v.isNullOrNothing())
+            continue;
+        if (cur.isNullOrNothing()) {
+            h->setKeyValue(col, v.refSelf(), xsink);
+            continue;
+        }
+        switch (a.second) {
+            case SG_SUM:
+                h->setKeyValue(col, sg_add(cur, v), xsink);
+                break;
+            case SG_MIN:
+                if (sg_compare(v, cur, nocase) < 0)
+                    h->setKeyValue(col, v.refSelf(), xsink);
+                break;
+            case SG_MAX:
+                if (sg_compare(v, cur, nocase) > 0)
+                    h->setKeyValue(col, v.refSelf(), xsink);
+                break;
+            default:
+                assert(false);
+        }
+    }
+}
+
+QoreListNode* ScatterGatherAggregator::getRows(ExceptionSink* xsink) {
+    ReferenceHolder<QoreListNode> rv(new QoreListNode(autoTypeInfo), xsink);
+    for (auto* h : groups) {
+        rv->push(h, xsink);
+    }
+    groups.clear();
+    return rv.release();
+}
+}
+
+static void scatter_gather_worker(ExceptionSink* xsink, void* arg) {
+    shard_arg* a = reinterpret_cast<shard_arg*>(arg);
+    a->state->run(a->index);
+}
+
+int ScatterGatherState::start(ExceptionSink* xsink) {
+    thread_args.resize(shards.size());
+    for (unsigned i = 0, n = shards.size(); i < n; ++i) {
+        thread_args[i].state = this;
+        thread_args[i].index = i;
+        {
+            AutoLocker al(l);
+            ++running;
+        }
+        if (q_start_thread(xsink, scatter_gather_worker, &thread_args[i]) < 0) {
+            AutoLocker al(l);
+            --running;
+            shards[i]->done = true;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int ScatterGatherState::push(unsigned i, ReferenceHolder<QoreHashNode>& h) {
+    AutoLocker al(l);
+    while (!abort && shards[i]->rows.size() >= PARALLEL_QUEUE_SIZE) {
+        cond.wait(&l);
+    }
+    if (abort)
+        return -1;
+    shards[i]->rows.push_back(h.release());
+    ++shards[i]->count;
+    cond.broadcast();
+    return 0;
+}
+
+QoreHashNode* ScatterGatherState::pop() {
+    AutoLocker al(l);
+    while (true) {
+        if (abort)
+            return nullptr;
+
+        if (mode == SG_MERGE) {
+            // each shard returns its rows ordered by the key, so the smallest head row is the next row; a row can
+            // only be selected once every shard has either returned a row or finished
+            int best = -1;
+            bool wait = false;
+            for (unsigned i = 0, n = shards.size(); i < n; ++i) {
+                shard_state& s = *shards[i];
+                if (s.rows.empty()) {
+                    if (!s.done) {
+                        wait = true;
+                        break;
+                    }
+                    continue;
+                }
+                if (best < 0 || sg_compare(s.rows.front()->getKeyValue(key.c_str()),
+                        shards[best]->rows.front()->getKeyValue(key.c_str()), nocase) < 0)
+                    best = i;
+            }
+            if (!wait) {
+                if (best < 0)
+                    return nullptr;
+                QoreHashNode* rv = shards[best]->rows.front();
+                shards[best]->rows.pop_front();
+                cond.broadcast();
+                return rv;
+            }
+        } else {
+            // take rows from the shards in a round-robin fashion as they become available
+            bool all_done = true;
+            for (unsigned j = 0, n = shards.size(); j < n; ++j) {
+                shard_state& s = *shards[(current + j) % n];
+                if (!s.rows.empty()) {
+                    current = (current + j + 1) % n;
+                    QoreHashNode* rv = s.rows.front();
+                    s.rows.pop_front();
+                    cond.broadcast();
+                    return rv;
+                }
+                if (!s.done)
+                    all_done = false;
+            }
+            if (all_done)
+                return nullptr;
+        }
+
+        cond.wait(&l);
+    }
+}
+
+void ScatterGatherState::finish() {
+    AutoLocker al(l);
+    abort = true;
+    cond.broadcast();
+    while (running) {
+        cond.wait(&l);
+    }
+}
+
+QoreListNode* ScatterGatherState::getShardInfo(ExceptionSink* xsink) {
+    ReferenceHolder<QoreListNode> rv(new QoreListNode(hashTypeInfo), xsink);
+    for (unsigned i = 0, n = shards.size(); i < n; ++i) {
+        shard_state& s = *shards[i];
+        ReferenceHolder<QoreHashNode> h(new QoreHashNode(autoTypeInfo), xsink);
+        h->setKeyValue("index", (int64)i, xsink);
+        h->setKeyValue("rows", s.count, xsink);
+        h->setKeyValue("time_ms", s.end_ms > s.start_ms ? s.end_ms - s.start_ms : 0, xsink);
+        if (s.err) {
+            h->setKeyValue("error", s.err.getExceptionErr().refSelf(), xsink);
+            h->setKeyValue("desc", s.err.getExceptionDesc().refSelf(), xsink);
+        }
+        rv->push(h.release(), xsink);
+    }
+    return rv.release();
+}
+
+void ScatterGatherState::run(unsigned i) {
+    shard_state& s = *shards[i];
+    ExceptionSink xsink;
+    {
+        AutoLocker al(l);
+        s.start_ms = q_clock_getmillis();
+    }
+    try {
+        runIntern(s, i, &xsink);
+    } catch (const ss::Error& e) {
+        e.raise(&xsink);
+    }
+
+    AutoLocker al(l);
+    s.end_ms = q_clock_getmillis();
+    // errors are reported per shard and do not stop the other shards
+    if (xsink)
+        s.err.assimilate(xsink);
+    s.done = true;
+    --running;
+    cond.broadcast();
+}
+
+void ScatterGatherState::runIntern(shard_state& s, unsigned i, ExceptionSink* xsink) {
+    Datasource* ds = ss::open_datasource(s.dsstr.c_str(), xsink);
+    if (!ds)
+        return;
+    ON_BLOCK_EXIT(ss::close_datasource, ds);
+
+    connection* conn = (connection*)ds->getPrivateData();
+    std::unique_ptr<QoreString> query(sql->convertEncoding(conn->getEncoding(), xsink));
+    if (!query)
+        return;
+
+    command_ptr cmd(conn->setupCommand(query.get(), args, false, xsink));
+    if (*xsink)
+        return;
+
+    bool connection_reset = false;
+    while (true) {
+        command::ResType rt = conn->readNextResult(*cmd, connection_reset, xsink);
+        if (*xsink)
+            return;
+        if (rt == command::RES_END)
+            break;
+        if (rt == command::RES_DONE)
+            continue;
+        if (rt != command::RES_ROW) {
+            cmd->cancel();
+            break;
+        }
+
+        while (true) {
+            ReferenceHolder<QoreHashNode> h(cmd->fetch_row(xsink), xsink);
+            if (*xsink)
+                return;
+            if (!h)
+                break;
+            if (push(i, h)) {
+                cmd->cancel();
+                return;
+            }
+        }
+    }
+
+    conn->purge_messages(xsink);
+    // end the chained transaction started by the query
+    conn->commit(xsink);
+}
+
+QoreHashNode* ss::scatter_gather(const QoreListNode* dslist, const QoreStringNode* sql, const QoreListNode* args,
+        const QoreHashNode* opts, const ResolvedCallReferenceNode* callback, ExceptionSink* xsink) {
+    ScatterGatherState state;
+    state.sql = sql;
+    state.args = args;
+
+    ScatterGatherAggregator agg;
+    // string keys are compared like the server's sort order
+    QoreValue v = opts ? opts->getKeyValue("nocase") : QoreValue();
+    state.nocase = agg.nocase = v.getAsBool();
+
+    v = opts ? opts->getKeyValue("mode") : QoreValue();
+    if (!v.isNothing()) {
+        QoreStringValueHelper mode(v);
+        if (!strcasecmp(mode->c_str(), "merge")) {
+            state.mode = SG_MERGE;
+            v = opts->getKeyValue("key");
+            if (v.getType() != NT_STRING) {
+                xsink->raiseException("SCATTER-GATHER-ERROR", "the 'key' option must be set to the name of the key "
+                    "column when the 'mode' option is \"merge\"");
+                return nullptr;
+            }
+            state.key = v.get<const QoreStringNode>()->c_str();
+        } else if (!strcasecmp(mode->c_str(), "aggregate")) {
+            state.mode = SG_AGGREGATE;
+            if (agg.init(opts, xsink))
+                return nullptr;
+        } else if (strcasecmp(mode->c_str(), "concat")) {
+            xsink->raiseException("SCATTER-GATHER-ERROR", "unknown mode '%s'; expecting one of \"concat\", "
+                "\"merge\", or \"aggregate\"", mode->c_str());
+            return nullptr;
+        }
+    }
+
+    ConstListIterator li(dslist);
+    while (li.next()) {
+        QoreStringValueHelper str(li.getValue());
+        std::unique_ptr<shard_state> s(new shard_state);
+        s->dsstr = str->c_str();
+        state.shards.push_back(std::move(s));
+    }
+
+    printd(5, "ss::scatter_gather() shards: %d mode: %d sql: %s\n", (int)state.shards.size(), (int)state.mode,
+        sql->c_str());
+
+    bool stream = callback && state.mode != SG_AGGREGATE;
+    ReferenceHolder<QoreListNode> rows(stream ? nullptr : new QoreListNode(autoTypeInfo), xsink);
+    int64 count = 0;
+
+    if (!state.start(xsink)) {
+        while (true) {
+            ReferenceHolder<QoreHashNode> h(state.pop(), xsink);
+            if (!h)
+                break;
+            if (state.mode == SG_AGGREGATE) {
+                agg.add(*h, xsink);
+                if (*xsink)
+                    break;
+                continue;
+            }
+            ++count;
+            if (stream) {
+                ReferenceHolder<QoreListNode> cargs(new QoreListNode(autoTypeInfo), xsink);
+                cargs->push(h.release(), xsink);
+                ValueHolder cbrv(callback->execValue(*cargs, xsink), xsink);
+                if (*xsink)
+                    break;
+            } else {
+                rows->push(h.release(), xsink);
+            }
+        }
+    }
+
+    // wait for all workers to terminate in all cases
+    state.finish();
+    if (*xsink)
+        return nullptr;
+
+    if (state.mode == SG_AGGREGATE) {
+        rows = agg.getRows(xsink);
+        count = rows->size();
+        // aggregated rows are passed to the callback after all shards have completed
+        if (callback) {
+            ConstListIterator ri(*rows);
+            while (ri.next()) {
+                ReferenceHolder<QoreListNode> cargs(new QoreListNode(autoTypeInfo), xsink);
+                cargs->push(ri.getReferencedValue(), xsink);
+                ValueHolder cbrv(callback->execValue(*cargs, xsink), xsink);
+                if (*xsink)
+                    return nullptr;
+            }
+            rows = nullptr;
+        }
+    }
+
+    ReferenceHolder<QoreHashNode> rv(new QoreHashNode(autoTypeInfo), xsink);
+    if (rows)
+        rv->setKeyValue("rows", rows.release(), xsink);
+    rv->setKeyValue("count", count, xsink);
+    rv->setKeyValue("shards", state.getShardInfo(xsink), xsink);
+    return rv.release();
+}
+
+// EOF
@@ -0,0 +1,61 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    parallel.h
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SYBASE_PARALLEL_H_
+#define SYBASE_PARALLEL_H_
+
+#include "qore/Qore.h"
+
+namespace ss {
+
+// opens a new private Datasource for this driver from a datasource string like
+// "freetds:user/pass@db(utf8)%host:1433{options}"; the caller owns the result and must close and delete it
+// returns nullptr on error (exception raised)
+DLLLOCAL Datasource* open_datasource(const char* dsstr, ExceptionSink* xsink);
+
+// closes and deletes a Datasource returned by open_datasource()
+DLLLOCAL void close_datasource(Datasource* ds);
+
+// runs a select on a key column split into ranges; each range is executed concurrently on its own connection
+// and the rows are merged into a single stream
+// if "callback" is set, it is called with each row hash and the number of rows is returned, otherwise a list of
+// row hashes is returned
+DLLLOCAL QoreValue parallel_select(const QoreStringNode* dsstr, const QoreStringNode* table,
+        const QoreStringNode* key, const QoreHashNode* opts, const ResolvedCallReferenceNode* callback,
+        ExceptionSink* xsink);
+
+// executes the same query concurrently on a connection for each datasource string and combines the rows by
+// concatenating them, merging them ordered on a key column, or aggregating them; errors are reported per shard
+// if "callback" is set, it is called with each row hash, otherwise the rows are returned in the "rows" key
+DLLLOCAL QoreHashNode* scatter_gather(const QoreListNode* dslist, const QoreStringNode* sql,
+        const QoreListNode* args, const QoreHashNode* opts, const ResolvedCallReferenceNode* callback,
+        ExceptionSink* xsink);
+
+} // namespace ss
+
+#endif
+
+// EOF
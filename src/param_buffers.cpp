@@ -0,0 +1,131 @@
+/*
+  param_buffers.cpp
+
+  Sybase DB layer for QORE
+  uses Sybase OpenClient C library
+
+  Qore Programming language
+
+  Copyright (C) 2023 Qore Technologies, s.r.o.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+
+#include "sybase.h"
+#include "param_buffers.h"
+#include "utils.h"
+
+input_value_buffer::~input_value_buffer() {
+    release();
+}
+
+void input_value_buffer::release() {
+    if (node) {
+        const_cast<SimpleValueQoreNode*>(node)->deref();
+        node = 0;
+    }
+    if (owned) {
+        free(owned);
+        owned = 0;
+    }
+}
+
+void input_value_buffer::set_null() {
+    release();
+    value = 0;
+    value_len = 0;
+    indicator = -1;
+}
+
+void input_value_buffer::set_ref(const SimpleValueQoreNode* n, const void* data, CS_INT len) {
+    // take the new reference before releasing the old one in case the same value is rebound
+    n->ref();
+    release();
+    node = n;
+    value = (CS_VOID*)data;
+    value_len = len;
+    indicator = 0;
+}
+
+void input_value_buffer::set_owned(char* buf, CS_INT len) {
+    release();
+    owned = buf;
+    value = buf;
+    value_len = len;
+    indicator = 0;
+}
+
+void input_value_buffer::set_string(const char* s, size_t len) {
+    release();
+    str.assign(s, len);
+    value = (CS_VOID*)str.data();
+    value_len = len;
+    indicator = 0;
+}
+
+void input_value_buffer::set_fixed(const void* data, CS_INT len) {
+    assert((size_t)len <= sizeof(fixed));
+    release();
+    memcpy(&fixed, data, len);
+    value = &fixed;
+    value_len = len;
+    indicator = 0;
+}
+
+void input_value_buffer::clear() {
+    release();
+    // the storage of copied strings is freed as well
+    std::string().swap(str);
+    value = 0;
+    value_len = 0;
+    indicator = 0;
+}
+
+param_buffers::~param_buffers() {
+    reset();
+}
+
+void param_buffers::reset() {
+    ss::delete_container(m_buffers);
+    m_buffers.clear();
+}
+
+void param_buffers::clear() {
+    for (auto* i : m_buffers) {
+        i->clear();
+    }
+}
+
+void param_buffers::resize(size_t n) {
+    while (m_buffers.size() > n) {
+        delete m_buffers.back();
+        m_buffers.pop_back();
+    }
+    m_buffers.reserve(n);
+    while (m_buffers.size() < n) {
+        insert();
+    }
+}
+
+input_value_buffer* param_buffers::insert() {
+    std::unique_ptr<input_value_buffer> in(new input_value_buffer);
+    m_buffers.push_back(in.get());
+    return in.release();
+}
@@ -0,0 +1,116 @@
+/*
+  param_buffers.h
+
+  Sybase DB layer for QORE
+  uses Sybase OpenClient C library
+
+  Qore Programming language
+
+  Copyright (C) 2023 Qore Technologies, s.r.o.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SYBASE_PARAM_BUFFERS_H_
+#define SYBASE_PARAM_BUFFERS_H_
+
+#include <cstypes.h>
+
+#include "qore/Qore.h"
+
+#include <string>
+#include <vector>
+
+// buffer for a single input parameter value bound with ct_setparam(); ct-lib keeps pointers to the data, length
+// and indicator until the command is sent (or resent), so the buffer must not move. Noncopyable, nonassignable.
+class input_value_buffer
+{
+   private:
+      input_value_buffer(const input_value_buffer&);       // not implemented
+      input_value_buffer& operator=(input_value_buffer&);  // not implemented
+
+   public:
+      input_value_buffer() : indicator(0), value_len(0), value(0), node(0), owned(0) {}
+      ~input_value_buffer();
+
+      // releases the current value and sets the buffer to null
+      void set_null();
+
+      // binds the data of a string or binary value in place; a reference to the value is held while bound
+      void set_ref(const SimpleValueQoreNode* n, const void* data, CS_INT len);
+
+      // takes ownership of a malloc()ed buffer
+      void set_owned(char* buf, CS_INT len);
+
+      // copies a string value into the buffer
+      void set_string(const char* str, size_t len);
+
+      // copies a fixed-length value into the buffer
+      void set_fixed(const void* data, CS_INT len);
+
+      // releases the bound value and any copied data; called after the command has been sent, so that large values
+      // are not kept alive by buffers that are kept for reuse
+      void clear();
+
+      CS_SMALLINT indicator;
+      CS_INT value_len;
+      CS_VOID* value;          // not owned, points to the storage below or to the bound value
+
+   private:
+      union {
+         int64 i8;
+         CS_INT i4;
+         CS_FLOAT f8;
+         CS_DATETIME dt;
+         CS_NUMERIC num;
+      } fixed;
+      std::string str;
+      const SimpleValueQoreNode* node;
+      char* owned;
+
+      void release();
+};
+
+// holds the input buffers for all parameters of a command; the buffer objects are reused by the next command, but
+// their values are released once the command has been sent
+class param_buffers
+{
+   private:
+      param_buffers(const param_buffers&);             // not implemented
+      param_buffers& operator=(const param_buffers&);  // not implemented
+
+   public:
+      param_buffers() {}
+      ~param_buffers();
+      void reset();
+      // releases the values of all buffers but keeps the buffers
+      void clear();
+      // keeps the first "n" buffers and adds new ones as needed; buffers do not move while they are kept
+      void resize(size_t n);
+      input_value_buffer* insert();
+      input_value_buffer* operator[](size_t i) {
+        return m_buffers.at(i);
+      }
+      size_t size() const {
+        return m_buffers.size();
+      }
+
+  private:
+      std::vector<input_value_buffer*> m_buffers;
+};
+
+#endif
+
+// EOF
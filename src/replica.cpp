@@ -0,0 +1,273 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    replica.cpp
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <ctype.h>
+#include <string.h>
+
+#include <memory>
+
+#include "sybase.h"
+#include "replica.h"
+#include "connection.h"
+#include "parallel.h"
+#include "sybase_query.h"
+
+// time in milliseconds that a replica is not used after a failure
+static const int64 REPLICA_RETRY_MS = 30000;
+// idle connections unused for longer than this are checked before being used
+static const int64 REPLICA_VALIDATE_MS = 30000;
+// maximum number of idle connections kept for each replica
+static const size_t REPLICA_MAX_IDLE = 8;
+
+namespace ss {
+
+ReplicaRegistry replica_registry;
+
+// options that are not used for replica connections
+static const char* primary_only_opts[] = {
+    SYBASE_OPT_READ_REPLICAS,
+    SYBASE_OPT_ASYNC_CONNECT,
+    SYBASE_OPT_NATIVE_AUTOCOMMIT,
+    SYBASE_OPT_CONNECTION_ID,
+    SYBASE_OPT_FAILOVER_HOSTS,
+    SYBASE_OPT_FAILOVER_ORDER,
+    SYBASE_OPT_FAILOVER_ATTEMPTS,
+    SYBASE_OPT_FAILOVER_BACKOFF,
+    SYBASE_OPT_FAILOVER_MAX_BACKOFF,
+    SYBASE_OPT_FAILOVER_STANDBY,
+};
+
+static bool primary_only_option(const char* key) {
+    for (const char* opt : primary_only_opts) {
+        if (!strcasecmp(key, opt))
+            return true;
+    }
+    return false;
+}
+
+ReplicaEndpoint::~ReplicaEndpoint() {
+    for (auto& i : idle) {
+        close_datasource(i.ds);
+    }
+}
+
+bool ReplicaEndpoint::available(int64 now) {
+    AutoLocker al(lck);
+    return !retry_at || now >= retry_at;
+}
+
+int ReplicaEndpoint::outstanding() {
+    AutoLocker al(lck);
+    return active;
+}
+
+Datasource* ReplicaEndpoint::acquire(Datasource* primary, ExceptionSink* xsink) {
+    int64 now = q_clock_getmillis();
+    while (true) {
+        idle_ds i;
+        {
+            AutoLocker al(lck);
+            if (idle.empty())
+                break;
+            i = idle.back();
+            idle.pop_back();
+            ++active;
+            ++requests;
+        }
+        // connections that have been idle for a while are checked first
+        if (now - i.last_used < REPLICA_VALIDATE_MS || ((connection*)i.ds->getPrivateData())->validate())
+            return i.ds;
+        close_datasource(i.ds);
+        AutoLocker al(lck);
+        --active;
+        --requests;
+    }
+
+    {
+        AutoLocker al(lck);
+        ++active;
+        ++requests;
+    }
+    Datasource* ds = open(primary, xsink);
+    if (!ds) {
+        AutoLocker al(lck);
+        --active;
+        ++failures;
+        retry_at = q_clock_getmillis() + REPLICA_RETRY_MS;
+    }
+    return ds;
+}
+
+void ReplicaEndpoint::release(Datasource* ds, bool ok) {
+    {
+        AutoLocker al(lck);
+        --active;
+        if (ok) {
+            retry_at = 0;
+            if (idle.size() < REPLICA_MAX_IDLE) {
+                idle.push_back({ds, q_clock_getmillis()});
+                return;
+            }
+        } else {
+            ++failures;
+            retry_at = q_clock_getmillis() + REPLICA_RETRY_MS;
+        }
+    }
+    close_datasource(ds);
+}
+
+Datasource* ReplicaEndpoint::open(Datasource* primary, ExceptionSink* xsink) {
+    printd(5, "ReplicaEndpoint::open() opening a connection to replica %s:%d\n", host.c_str(), port);
+    std::unique_ptr<Datasource> ds(new Datasource(sybase_get_driver()));
+    ds->setPendingUsername(primary->getUsername());
+    if (primary->getPassword())
+        ds->setPendingPassword(primary->getPassword());
+    ds->setPendingDBName(primary->getDBName());
+    if (primary->getDBEncoding())
+        ds->setPendingDBEncoding(primary->getDBEncoding());
+    ds->setPendingHostName(host.c_str());
+    ds->setPendingPort(port);
+
+    // the replica uses the same options as the primary except for options that only apply to the primary; options
+    // are set before the connection is opened so that connect-time options are applied to the replica login
+    ReferenceHolder<QoreHashNode> opts(primary->getConnectOptions(), xsink);
+    if (opts) {
+        ConstHashIterator hi(*opts);
+        while (hi.next()) {
+            const char* key = hi.getKey();
+            if (primary_only_option(key))
+                continue;
+            if (ds->setOption(key, hi.get(), xsink))
+                return nullptr;
+        }
+    }
+
+    if (ds->open(xsink))
+        return nullptr;
+    return ds.release();
+}
+
+QoreHashNode* ReplicaEndpoint::getHash(ExceptionSink* xsink) {
+    ReferenceHolder<QoreHashNode> h(new QoreHashNode(autoTypeInfo), xsink);
+    h->setKeyValue("host", new QoreStringNode(host), xsink);
+    h->setKeyValue("port", port, xsink);
+    AutoLocker al(lck);
+    h->setKeyValue("healthy", !retry_at || q_clock_getmillis() >= retry_at, xsink);
+    h->setKeyValue("outstanding", active, xsink);
+    h->setKeyValue("idle", (int64)idle.size(), xsink);
+    h->setKeyValue("requests", requests, xsink);
+    h->setKeyValue("failures", failures, xsink);
+    return h.release();
+}
+
+ReplicaEndpoint* ReplicaRegistry::get(Datasource* primary, const std::string& host, int port) {
+    // connections can only be shared if the credentials and options are the same
+    QoreString key;
+    key.sprintf("%s/%s@%s(%s)%%%s:%d", primary->getUsername(), primary->getPassword() ? primary->getPassword() : "",
+        primary->getDBName(), primary->getDBEncoding() ? primary->getDBEncoding() : "", host.c_str(), port);
+    {
+        ExceptionSink xsink;
+        ReferenceHolder<QoreHashNode> opts(primary->getConnectOptions(), &xsink);
+        if (opts) {
+            ConstHashIterator hi(*opts);
+            while (hi.next()) {
+                if (primary_only_option(hi.getKey()))
+                    continue;
+                QoreStringValueHelper str(hi.get());
+                key.sprintf("{%s=%s}", hi.getKey(), str->c_str());
+            }
+        }
+    }
+
+    AutoLocker al(lck);
+    ep_map_t::iterator i = endpoints.find(key.c_str());
+    if (i != endpoints.end())
+        return i->second;
+    ReplicaEndpoint* ep = new ReplicaEndpoint(host, port);
+    endpoints[key.c_str()] = ep;
+    return ep;
+}
+
+QoreListNode* ReplicaRegistry::getList(ExceptionSink* xsink) {
+    ReferenceHolder<QoreListNode> rv(new QoreListNode(hashTypeInfo), xsink);
+    AutoLocker al(lck);
+    for (auto& i : endpoints) {
+        rv->push(i.second->getHash(xsink), xsink);
+    }
+    return rv.release();
+}
+
+void ReplicaRegistry::shutdown() {
+    AutoLocker al(lck);
+    for (auto& i : endpoints) {
+        delete i.second;
+    }
+    endpoints.clear();
+}
+
+int ReplicaSet::parse(const char* n_spec, ExceptionSink* xsink) {
+    std::vector<FailoverHost> rl;
+    if (parse_host_list(n_spec, SYBASE_OPT_READ_REPLICAS, "replica", rl, xsink))
+        return -1;
+
+    spec = n_spec;
+    replicas = rl;
+    endpoints.clear();
+    return 0;
+}
+
+ReplicaEndpoint* ReplicaSet::choose(Datasource* primary) {
+    if (endpoints.empty()) {
+        for (auto& i : replicas) {
+            endpoints.push_back(replica_registry.get(primary, i.host, i.port));
+        }
+    }
+
+    // use the healthy replica with the fewest outstanding requests in the process
+    int64 now = q_clock_getmillis();
+    ReplicaEndpoint* rv = nullptr;
+    int min = 0;
+    for (auto* ep : endpoints) {
+        if (!ep->available(now))
+            continue;
+        int n = ep->outstanding();
+        if (!rv || n < min) {
+            rv = ep;
+            min = n;
+        }
+    }
+    return rv;
+}
+
+bool is_read_only_select(const QoreString* sql) {
+    // batches may contain other statements, whether separated by semicolons or only by whitespace, and
+    // "select ... into" creates a table
+    return sybase_query::isSingleSelect(sql->c_str());
+}
+
+} // namespace ss
+
+// EOF
@@ -0,0 +1,140 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    replica.h
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SYBASE_REPLICA_H_
+#define SYBASE_REPLICA_H_
+
+#include "qore/Qore.h"
+
+#include "failover.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ss {
+
+// a read replica server with the connections to it for one set of credentials and options; endpoints are shared
+// by all connections in the process so that requests can be balanced on the number of outstanding requests
+class ReplicaEndpoint {
+public:
+    std::string host;
+    int port;
+
+    DLLLOCAL ReplicaEndpoint(const std::string& host, int port) : host(host), port(port) {
+    }
+
+    DLLLOCAL ~ReplicaEndpoint();
+
+    // returns true if the replica is not marked as failed
+    DLLLOCAL bool available(int64 now);
+
+    // returns the number of requests currently executing on the replica
+    DLLLOCAL int outstanding();
+
+    // returns an idle connection to the replica or opens a new one with the primary's credentials and options
+    // returns nullptr on error (exception raised)
+    DLLLOCAL Datasource* acquire(Datasource* primary, ExceptionSink* xsink);
+
+    // returns a connection after a request; if "ok" is false the connection is closed and the replica is marked
+    // as failed
+    DLLLOCAL void release(Datasource* ds, bool ok);
+
+    // returns a hash with the replica's status
+    DLLLOCAL QoreHashNode* getHash(ExceptionSink* xsink);
+
+private:
+    struct idle_ds {
+        Datasource* ds;
+        // the time the connection was last used in milliseconds
+        int64 last_used;
+    };
+
+    QoreThreadLock lck;
+    std::vector<idle_ds> idle;
+    int active = 0;
+    // the time in milliseconds until which the replica is not used after a failure; 0 = healthy
+    int64 retry_at = 0;
+    int64 requests = 0;
+    int64 failures = 0;
+
+    DLLLOCAL Datasource* open(Datasource* primary, ExceptionSink* xsink);
+};
+
+// the process-wide registry of replica endpoints
+class ReplicaRegistry {
+public:
+    // returns the shared endpoint for the replica and the primary datasource's credentials and options
+    DLLLOCAL ReplicaEndpoint* get(Datasource* primary, const std::string& host, int port);
+
+    // returns a list of hashes with the status of all replicas
+    DLLLOCAL QoreListNode* getList(ExceptionSink* xsink);
+
+    // closes all connections; called when the module is deleted
+    DLLLOCAL void shutdown();
+
+private:
+    typedef std::map<std::string, ReplicaEndpoint*> ep_map_t;
+
+    QoreThreadLock lck;
+    ep_map_t endpoints;
+};
+
+DLLLOCAL extern ReplicaRegistry replica_registry;
+
+// the read replicas configured for a connection
+class ReplicaSet {
+public:
+    // parses a list of "host:port" replicas separated by commas or spaces
+    // returns 0=OK, -1=error (exception raised)
+    DLLLOCAL int parse(const char* spec, ExceptionSink* xsink);
+
+    DLLLOCAL bool empty() const {
+        return replicas.empty();
+    }
+
+    // returns the available replica with the fewest outstanding requests or nullptr if none is available
+    DLLLOCAL ReplicaEndpoint* choose(Datasource* primary);
+
+    DLLLOCAL const std::string& getSpec() const {
+        return spec;
+    }
+
+private:
+    std::string spec;
+    std::vector<FailoverHost> replicas;
+    // endpoints resolved on first use
+    std::vector<ReplicaEndpoint*> endpoints;
+};
+
+// returns true if the SQL is a select statement that does not write any data
+DLLLOCAL bool is_read_only_select(const QoreString* sql);
+
+} // namespace ss
+
+#endif
+
+// EOF
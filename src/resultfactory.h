@@ -1,10 +1,18 @@
 #ifndef SYBASE_SRC_RESULTFACTORY_H
 #define SYBASE_SRC_RESULTFACTORY_H
 
+#include <string.h>
+
 #include <sstream>
 
 #include "qore/Qore.h"
 
+// the prefix of the column name of the row that marks the end of a statement in a batch built by build_batch()
+#define SYBASE_BATCH_MARKER "qore_batch_end_"
+// the suffix appended with the statement index to the :name placeholders of each statement in a batch built by
+// build_batch()
+#define SYBASE_BATCH_PH_SUFFIX "_qb"
+
 namespace ss {
 
 class ResultFactory {
@@ -26,6 +34,101 @@ public:
         lasttype(NONE)
     { }
 
+    ~ResultFactory() {
+        status.discard(xsink);
+        if (batch)
+            batch->deref(xsink);
+    }
+
+    // returns true if the result is the row that marks the end of a statement in a batch built by build_batch();
+    // in this case "count" is set to the row count of the statement
+    static bool isBatchMarker(const QoreValue& v, int64& count) {
+        const QoreHashNode* h;
+        if (v.getType() == NT_LIST) {
+            const QoreListNode* l = v.get<const QoreListNode>();
+            if (l->size() != 1)
+                return false;
+            QoreValue e = l->retrieveEntry(0);
+            if (e.getType() != NT_HASH)
+                return false;
+            h = e.get<const QoreHashNode>();
+        } else if (v.getType() == NT_HASH) {
+            h = v.get<const QoreHashNode>();
+        } else {
+            return false;
+        }
+        if (h->size() != 1)
+            return false;
+        ConstHashIterator hi(h);
+        hi.next();
+        if (strncmp(hi.getKey(), SYBASE_BATCH_MARKER, sizeof(SYBASE_BATCH_MARKER) - 1))
+            return false;
+        QoreValue c = hi.get();
+        // column results contain a list with the single value
+        if (c.getType() == NT_LIST) {
+            const QoreListNode* l = c.get<const QoreListNode>();
+            c = l->empty() ? QoreValue() : l->retrieveEntry(0);
+        }
+        count = c.getAsBigInt();
+        return true;
+    }
+
+    // call when the end of a statement in a batch is read; the results since the last statement are moved to a
+    // hash for the statement
+    void end_statement(int64 count) {
+        if (!batch)
+            batch = new QoreListNode(autoHashTypeInfo);
+
+        ReferenceHolder<QoreHashNode> h(new QoreHashNode(autoTypeInfo), xsink);
+        h->setKeyValue("count", count, xsink);
+        // row counts are reported in the "count" key
+        ReferenceHolder<QoreListNode> results(new QoreListNode(autoTypeInfo), xsink);
+        for (auto& i : reslist) {
+            if (i.getType() == NT_INT)
+                continue;
+            results->push(i, xsink);
+            i = QoreValue();
+        }
+        reslist.clear();
+        h->setKeyValue("results", results.release(), xsink);
+        if (!params.empty()) {
+            ReferenceHolder<QoreListNode> l(params.release_to_list(), xsink);
+            h->setKeyValue("params", batch_params(*l, batch->size()), xsink);
+        }
+        batch->push(h.release(), xsink);
+
+        // the row count of the marker row itself is not a result
+        marker = true;
+        lasttype = NONE;
+    }
+
+    // returns the output parameters of statement "i" of a batch with the placeholder names mapped back to the names
+    // used in the statement
+    QoreListNode* batch_params(const QoreListNode& l, unsigned i) {
+        QoreStringMaker suffix(SYBASE_BATCH_PH_SUFFIX "%u", i);
+        size_t slen = suffix.strlen();
+
+        ReferenceHolder<QoreListNode> rv(new QoreListNode(autoTypeInfo), xsink);
+        ConstListIterator li(l);
+        while (li.next()) {
+            QoreValue v = li.getValue();
+            if (v.getType() != NT_HASH) {
+                rv->push(v.refSelf(), xsink);
+                continue;
+            }
+            ReferenceHolder<QoreHashNode> ph(new QoreHashNode(autoTypeInfo), xsink);
+            ConstHashIterator hi(v.get<const QoreHashNode>());
+            while (hi.next()) {
+                std::string key = hi.getKey();
+                if (key.size() > slen && !key.compare(key.size() - slen, slen, suffix.c_str()))
+                    key.resize(key.size() - slen);
+                ph->setKeyValue(key, hi.getReferencedValue(), xsink);
+            }
+            rv->push(ph.release(), xsink);
+        }
+        return rv.release();
+    }
+
     void add(ValueHolder& rh, bool list = true) {
         add(rh.release(), list);
     }
@@ -48,6 +151,11 @@ public:
 
     // call on CS_CMD_DONE
     void done(int rowcount) {
+        if (marker) {
+            marker = false;
+            last = QoreValue();
+            return;
+        }
         if (rowcount <= 0) {
             last = QoreValue();
             return;
@@ -61,7 +169,36 @@ public:
         last = QoreValue();
     }
 
+    // call on CS_STATUS_RESULT
+    void set_status(QoreValue st) {
+        status.discard(xsink);
+        status = st;
+    }
+
+    // returns the result of an RPC command: a hash with the return status and any output parameters and results
+    QoreValue res_rpc() {
+        ReferenceHolder<QoreHashNode> rv(xsink);
+        rv = new QoreHashNode(autoTypeInfo);
+
+        rv->setKeyValue("status", status, xsink);
+        status = QoreValue();
+        if (!params.empty()) {
+            rv->setKeyValue("params", params.release_smart(keygen), xsink);
+        }
+        if (!reslist.empty()) {
+            rv->setKeyValue("query", reslist.release_smart(keygen), xsink);
+        }
+        return rv.release();
+    }
+
     QoreValue res() {
+        // batches return one hash per statement
+        if (batch) {
+            QoreListNode* rv = batch;
+            batch = nullptr;
+            return rv;
+        }
+
         if (params.empty()) {
             return reslist.release_smart(keygen);
         }
@@ -83,8 +220,14 @@ private:
     RefHolderVector reslist;
     // true if some resuld was added before DONE
     QoreValue last;
+    // the return status of a stored procedure
+    QoreValue status;
     ExceptionSink *xsink;
     LastType lasttype;
+    // the results of each statement of a batch built by build_batch()
+    QoreListNode* batch = nullptr;
+    // true after the end of a statement in a batch until the marker row's CS_CMD_DONE
+    bool marker = false;
 };
 
 } // nemespace ss
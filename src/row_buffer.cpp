@@ -0,0 +1,256 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    row_buffer.cpp
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "sybase.h"
+#include "row_buffer.h"
+
+#include <errno.h>
+#include <string.h>
+
+namespace ss {
+
+// serialized value types; rows are only buffered within the process, so encoding and time zone pointers can be
+// stored directly
+enum buffer_value_t : unsigned char {
+    BV_NOTHING,
+    BV_NULL,
+    BV_INT,
+    BV_FLOAT,
+    BV_NUMBER,
+    BV_STRING,
+    BV_DATE,
+    BV_BINARY,
+    BV_BOOL,
+};
+
+template <typename T>
+static void write_val(std::string& buf, T v) {
+    buf.append((const char*)&v, sizeof(v));
+}
+
+static void write_bytes(std::string& buf, const void* p, size_t len) {
+    write_val<uint64_t>(buf, len);
+    buf.append((const char*)p, len);
+}
+
+template <typename T>
+static T read_val(const char*& p) {
+    T v;
+    memcpy(&v, p, sizeof(v));
+    p += sizeof(v);
+    return v;
+}
+
+static void serialize_value(std::string& buf, QoreValue v) {
+    switch (v.getType()) {
+        case NT_NOTHING:
+            write_val<unsigned char>(buf, BV_NOTHING);
+            return;
+        case NT_NULL:
+            write_val<unsigned char>(buf, BV_NULL);
+            return;
+        case NT_INT:
+            write_val<unsigned char>(buf, BV_INT);
+            write_val<int64>(buf, v.getAsBigInt());
+            return;
+        case NT_FLOAT:
+            write_val<unsigned char>(buf, BV_FLOAT);
+            write_val<double>(buf, v.getAsFloat());
+            return;
+        case NT_BOOLEAN:
+            write_val<unsigned char>(buf, BV_BOOL);
+            write_val<unsigned char>(buf, v.getAsBool() ? 1 : 0);
+            return;
+        case NT_NUMBER: {
+            QoreStringValueHelper str(v);
+            write_val<unsigned char>(buf, BV_NUMBER);
+            write_bytes(buf, str->c_str(), str->size());
+            return;
+        }
+        case NT_STRING: {
+            const QoreStringNode* str = v.get<const QoreStringNode>();
+            write_val<unsigned char>(buf, BV_STRING);
+            write_val<const QoreEncoding*>(buf, str->getEncoding());
+            write_bytes(buf, str->c_str(), str->size());
+            return;
+        }
+        case NT_DATE: {
+            const DateTimeNode* d = v.get<const DateTimeNode>();
+            if (d->isAbsolute()) {
+                write_val<unsigned char>(buf, BV_DATE);
+                write_val<int64>(buf, d->getEpochSecondsUTC());
+                write_val<int>(buf, d->getMicrosecond());
+                write_val<const AbstractQoreZoneInfo*>(buf, d->getZone());
+                return;
+            }
+            break;
+        }
+        case NT_BINARY: {
+            const BinaryNode* b = v.get<const BinaryNode>();
+            write_val<unsigned char>(buf, BV_BINARY);
+            write_bytes(buf, b->getPtr(), b->size());
+            return;
+        }
+        default:
+            break;
+    }
+
+    // other values are not returned in rows; they are buffered as strings
+    QoreStringValueHelper str(v);
+    write_val<unsigned char>(buf, BV_STRING);
+    write_val<const QoreEncoding*>(buf, str->getEncoding());
+    write_bytes(buf, str->c_str(), str->size());
+}
+
+static QoreValue deserialize_value(const char*& p) {
+    switch (read_val<unsigned char>(p)) {
+        case BV_NOTHING:
+            return QoreValue();
+        case BV_NULL:
+            return &Null;
+        case BV_INT:
+            return read_val<int64>(p);
+        case BV_FLOAT:
+            return read_val<double>(p);
+        case BV_BOOL:
+            return (bool)read_val<unsigned char>(p);
+        case BV_NUMBER: {
+            size_t len = read_val<uint64_t>(p);
+            std::string str(p, len);
+            p += len;
+            return new QoreNumberNode(str.c_str());
+        }
+        case BV_STRING: {
+            const QoreEncoding* enc = read_val<const QoreEncoding*>(p);
+            size_t len = read_val<uint64_t>(p);
+            QoreStringNode* str = new QoreStringNode(p, len, enc);
+            p += len;
+            return str;
+        }
+        case BV_DATE: {
+            int64 secs = read_val<int64>(p);
+            int us = read_val<int>(p);
+            const AbstractQoreZoneInfo* zone = read_val<const AbstractQoreZoneInfo*>(p);
+            return DateTimeNode::makeAbsolute(zone, secs, us);
+        }
+        case BV_BINARY: {
+            size_t len = read_val<uint64_t>(p);
+            BinaryNode* b = new BinaryNode;
+            b->append(p, len);
+            p += len;
+            return b;
+        }
+    }
+    assert(false);
+    return QoreValue();
+}
+
+int RowBuffer::add(const QoreHashNode& row, ExceptionSink* xsink) {
+    assert(!reading);
+
+    std::string buf;
+    write_val<uint32_t>(buf, (uint32_t)row.size());
+    ConstHashIterator hi(row);
+    while (hi.next()) {
+        const char* key = hi.getKey();
+        write_bytes(buf, key, strlen(key));
+        serialize_value(buf, hi.get());
+    }
+
+    if (!file && mem.size() + buf.size() <= mem_limit) {
+        mem.append(buf);
+    } else {
+        if (!file) {
+            file = tmpfile();
+            if (!file) {
+                xsink->raiseErrnoException("TDS-STATEMENT-BUFFER-ERROR", errno, "failed to create a temporary file "
+                    "to buffer statement rows");
+                return -1;
+            }
+            printd(5, "RowBuffer::add() %p memory limit of %lu bytes reached; buffering rows in a temporary file\n",
+                this, mem_limit);
+        }
+        uint64_t len = buf.size();
+        if (fwrite(&len, sizeof(len), 1, file) != 1 || fwrite(buf.data(), buf.size(), 1, file) != 1) {
+            xsink->raiseErrnoException("TDS-STATEMENT-BUFFER-ERROR", errno, "failed to write statement rows to a "
+                "temporary file");
+            return -1;
+        }
+    }
+    ++count;
+    return 0;
+}
+
+QoreHashNode* RowBuffer::next(ExceptionSink* xsink) {
+    if (!count)
+        return nullptr;
+
+    if (!reading) {
+        reading = true;
+        if (file)
+            rewind(file);
+    }
+
+    std::string fbuf;
+    const char* p;
+    if (mem_pos < mem.size()) {
+        p = mem.data() + mem_pos;
+    } else {
+        assert(file);
+        uint64_t len;
+        if (fread(&len, sizeof(len), 1, file) != 1) {
+            xsink->raiseErrnoException("TDS-STATEMENT-BUFFER-ERROR", errno, "failed to read statement rows from a "
+                "temporary file");
+            return nullptr;
+        }
+        fbuf.resize(len);
+        if (len && fread(&fbuf[0], len, 1, file) != 1) {
+            xsink->raiseErrnoException("TDS-STATEMENT-BUFFER-ERROR", errno, "failed to read statement rows from a "
+                "temporary file");
+            return nullptr;
+        }
+        p = fbuf.data();
+    }
+    const char* start = p;
+
+    ReferenceHolder<QoreHashNode> h(new QoreHashNode(autoTypeInfo), xsink);
+    uint32_t cols = read_val<uint32_t>(p);
+    for (uint32_t i = 0; i < cols; ++i) {
+        size_t len = read_val<uint64_t>(p);
+        std::string key(p, len);
+        p += len;
+        h->setKeyValue(key.c_str(), deserialize_value(p), xsink);
+    }
+
+    if (fbuf.empty())
+        mem_pos += p - start;
+    --count;
+    return h.release();
+}
+
+} // namespace ss
+
+// EOF
@@ -0,0 +1,85 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    row_buffer.h
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SYBASE_ROW_BUFFER_H_
+#define SYBASE_ROW_BUFFER_H_
+
+#include "qore/Qore.h"
+
+#include <stdio.h>
+
+#include <string>
+
+namespace ss {
+
+// a FIFO buffer of row hashes serialized in memory up to a limit and then in a temporary file; all rows must be
+// added before the first row is read
+class RowBuffer {
+public:
+    DLLLOCAL RowBuffer(size_t mem_limit) : mem_limit(mem_limit) {
+    }
+
+    DLLLOCAL ~RowBuffer() {
+        if (file)
+            fclose(file);
+    }
+
+    // adds a row to the end of the buffer
+    // returns 0=OK, -1=error (exception raised)
+    DLLLOCAL int add(const QoreHashNode& row, ExceptionSink* xsink);
+
+    // returns the next row or nullptr if there are no more rows
+    DLLLOCAL QoreHashNode* next(ExceptionSink* xsink);
+
+    // returns the number of rows remaining in the buffer
+    DLLLOCAL size_t size() const {
+        return count;
+    }
+
+    // returns true if rows have been written to the temporary file
+    DLLLOCAL bool spilled() const {
+        return file;
+    }
+
+private:
+    size_t mem_limit;
+    // serialized rows kept in memory
+    std::string mem;
+    size_t mem_pos = 0;
+    // serialized rows written after the memory limit was reached
+    FILE* file = nullptr;
+    bool reading = false;
+    size_t count = 0;
+
+    DLLLOCAL RowBuffer(const RowBuffer&) = delete;
+    DLLLOCAL RowBuffer& operator=(const RowBuffer&) = delete;
+};
+
+} // namespace ss
+
+#endif
+
+// EOF
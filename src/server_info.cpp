@@ -0,0 +1,93 @@
+/* -*- indent-tabs-mode: nil -*- */
+/*
+    server_info.cpp
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "sybase.h"
+#include "server_info.h"
+
+namespace ss {
+
+ServerInfoCache server_info_cache;
+
+std::string ServerInfoCache::getKey(const char* host, int port, const char* db) {
+    QoreStringMaker key("%s:%d/%s", host ? host : "", port, db ? db : "");
+    return key.c_str();
+}
+
+bool ServerInfoCache::get(const std::string& key, ServerInfo& info) {
+    AutoLocker al(lck);
+    cache_t::iterator i = cache.find(key);
+    if (i == cache.end())
+        return false;
+    if (i->second.expires <= q_clock_getmillis()) {
+        cache.erase(i);
+        return false;
+    }
+    info = i->second.info;
+    return true;
+}
+
+void ServerInfoCache::set(const std::string& key, const ServerInfo& info) {
+    AutoLocker al(lck);
+    if (!ttl)
+        return;
+    entry& e = cache[key];
+    e.info = info;
+    e.expires = q_clock_getmillis() + ttl * 1000;
+}
+
+int64 ServerInfoCache::invalidate(const char* host) {
+    AutoLocker al(lck);
+    if (!host) {
+        int64 rc = cache.size();
+        cache.clear();
+        return rc;
+    }
+
+    // keys start with "host:"
+    std::string prefix(host);
+    prefix += ':';
+    int64 rc = 0;
+    for (cache_t::iterator i = cache.lower_bound(prefix); i != cache.end()
+        && !i->first.compare(0, prefix.size(), prefix);) {
+        cache.erase(i++);
+        ++rc;
+    }
+    return rc;
+}
+
+void ServerInfoCache::setTtl(int64 secs) {
+    AutoLocker al(lck);
+    ttl = secs < 0 ? 0 : secs;
+    if (!ttl)
+        cache.clear();
+}
+
+int64 ServerInfoCache::getTtl() {
+    AutoLocker al(lck);
+    return ttl;
+}
+
+} // namespace ss
@@ -0,0 +1,88 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+    server_info.h
+
+    Sybase DB layer for QORE
+    uses Sybase OpenClient C library
+
+    Qore Programming language
+
+    Copyright (C) 2023 Qore Technologies, s.r.o.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SYBASE_SERVER_INFO_H_
+#define SYBASE_SERVER_INFO_H_
+
+#include "qore/Qore.h"
+
+#include <map>
+#include <string>
+
+namespace ss {
+
+// server identity and encoding metadata determined when connecting
+struct ServerInfo {
+    // the value of @@version
+    std::string version;
+    // true if the server is a Sybase (SAP) Adaptive Server
+    bool sybase = false;
+    // the character encoding detected for MS SQL Server or nullptr if not detected
+    const QoreEncoding* enc = nullptr;
+};
+
+// process-wide registry of server metadata by host, port, and database
+class ServerInfoCache {
+public:
+    // default time to live for cache entries in seconds
+    static const int64 DEFAULT_TTL = 600;
+
+    // returns true if a valid entry was found
+    DLLLOCAL bool get(const std::string& key, ServerInfo& info);
+
+    DLLLOCAL void set(const std::string& key, const ServerInfo& info);
+
+    // removes all entries for the given host, or all entries if host is nullptr; returns the number of entries
+    // removed
+    DLLLOCAL int64 invalidate(const char* host = nullptr);
+
+    // sets the time to live in seconds; 0 disables caching
+    DLLLOCAL void setTtl(int64 secs);
+
+    DLLLOCAL int64 getTtl();
+
+    DLLLOCAL static std::string getKey(const char* host, int port, const char* db);
+
+private:
+    struct entry {
+        ServerInfo info;
+        // expiry time in milliseconds
+        int64 expires;
+    };
+    typedef std::map<std::string, entry> cache_t;
+
+    QoreThreadLock lck;
+    cache_t cache;
+    int64 ttl = DEFAULT_TTL;
+};
+
+DLLLOCAL extern ServerInfoCache server_info_cache;
+
+} // namespace ss
+
+#endif
+
+// EOF
@@ -6,3 +6,13 @@
 #include "row_output_buffers.cpp"
 #include "sybase.cpp"
 #include "statement.cpp"
+#include "parallel.cpp"
+#include "param_buffers.cpp"
+#include "bind_plan.cpp"
+#include "server_info.cpp"
+#include "cancel.cpp"
+#include "messages.cpp"
+#include "row_buffer.cpp"
+#include "async_query.cpp"
+#include "replica.cpp"
+#include "failover.cpp"
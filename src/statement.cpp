@@ -5,6 +5,8 @@
 int ss::Statement::affected_rows(SQLStatement* stmt, ExceptionSink* xsink) {
    if (checkValid(xsink))
       return 0;
+   if (rows)
+      return buffered_row_count;
    return context->get_row_count();
 }
 
@@ -13,10 +15,14 @@ int ss::Statement::exec(connection *conn, const QoreString *query, const QoreLis
       return -1;
    if (context.get())
       context->cancel();
+   rows.reset();
+   cursor = false;
+   set_res(0, xsink);
 
-   context.reset(conn->setupCommand(query, args, raw, xsink));
+   context.reset(conn->setupCommand(query, args, raw, xsink, &plan, true));
    if (*xsink)
       return -1;
+   cursor = context->isCursor();
 
    bool connection_reset = false;
    // not sure what to do with the return value here
@@ -24,25 +30,117 @@ int ss::Statement::exec(connection *conn, const QoreString *query, const QoreLis
    return *xsink ? -1 : 0;
 }
 
+QoreHashNode* ss::Statement::read_row(connection* conn, ExceptionSink* xsink) {
+   bool connection_reset = false;
+   command::ResType res = conn->readNextResult(*context.get(), connection_reset, xsink);
+   if (*xsink)
+      return 0;
+   assert(!connection_reset);
+
+   //command::ResType res = context->read_next_result(xsink);
+   if (expect_row(res))
+      return context->fetch_row(xsink);
+   return 0;
+}
+
 bool ss::Statement::next(SQLStatement* stmt, ExceptionSink* xsink) {
    if (checkValid(xsink))
       return false;
-   connection* conn = (connection*)stmt->getDatasource()->getPrivateData();
 
+   if (!has_res()) {
+      if (rows)
+         set_res(rows->next(xsink), xsink);
+      else
+         set_res(read_row((connection*)stmt->getDatasource()->getPrivateData(), xsink), xsink);
+   }
+
+   return has_res();
+}
+
+int ss::Statement::buffer(connection* conn, size_t mem_limit, ExceptionSink* xsink) {
+   assert(valid && !rows);
+
+   // output parameters are not buffered; they are only returned by get_output() from the server
+   if (!placeholders.empty())
+      return -1;
+
+   // returns the current result without reading another one while its rows are pending
    bool connection_reset = false;
    command::ResType res = conn->readNextResult(*context.get(), connection_reset, xsink);
    if (*xsink)
-      return false;
-   assert(!connection_reset);
+      return -1;
+   if (res == command::RES_PARAM)
+      return -1;
 
-   //command::ResType res = context->read_next_result(xsink);
-   if (expect_row(res)) {
-      if (!has_res()) {
-         set_res(context->fetch_row(xsink), xsink);
+   // any row already fetched by next() stays in the result
+   std::unique_ptr<RowBuffer> buf(new RowBuffer(mem_limit));
+   if (res == command::RES_ROW) {
+      while (true) {
+         ReferenceHolder<QoreHashNode> h(context->fetch_row(xsink), xsink);
+         if (*xsink)
+            return -1;
+         if (!h)
+            break;
+         if (buf->add(**h, xsink))
+            return -1;
       }
    }
 
-   return has_res();
+   // read the remaining results so that the row count is available and the command is complete; statements with
+   // further row or output parameter results are not buffered, as only the current result set could be returned
+   while (true) {
+      res = conn->readNextResult(*context.get(), connection_reset, xsink);
+      if (*xsink)
+         return -1;
+      if (expect_row(res)) {
+         printd(5, "Statement::buffer() %p further results pending; not buffered\n", this);
+         return -1;
+      }
+      if (res == command::RES_STATUS) {
+         // the return status is not returned by the statement
+         while (context->fetch_row_into_buffers(xsink)) {}
+         if (*xsink)
+            return -1;
+         continue;
+      }
+      if (res == command::RES_END || res == command::RES_CANCELED || res == command::RES_ERROR)
+         break;
+   }
+
+   buffered_row_count = context->get_row_count();
+   printd(5, "Statement::buffer() %p buffered %lu row(s) (file: %d)\n", this, buf->size(), buf->spilled());
+   rows = std::move(buf);
+   context.reset();
+   return 0;
+}
+
+QoreHashNode* ss::Statement::buffered_columns(int max, ExceptionSink* xsink) {
+   ReferenceHolder<QoreHashNode> rv(new QoreHashNode(autoTypeInfo), xsink);
+   for (int i = 0; max <= 0 || i < max; ++i) {
+      ReferenceHolder<QoreHashNode> h(xsink);
+      if (has_res())
+         h = release_res();
+      else
+         h = rows->next(xsink);
+      if (*xsink)
+         return 0;
+      if (!h)
+         break;
+
+      ConstHashIterator hi(*h);
+      while (hi.next()) {
+         QoreListNode* l;
+         QoreValue v = rv->getKeyValue(hi.getKey());
+         if (v.isNothing()) {
+            l = new QoreListNode(autoTypeInfo);
+            rv->setKeyValue(hi.getKey(), l, xsink);
+         } else {
+            l = v.get<QoreListNode>();
+         }
+         l->push(hi.getReferencedValue(), xsink);
+      }
+   }
+   return rv.release();
 }
 
 void ss::init(qore_dbi_method_list &methods) {
@@ -22,6 +22,7 @@
 #include "command.h"
 #include "dbmodulewrap.h"
 #include "utils.h"
+#include "row_buffer.h"
 
 namespace ss {
 
@@ -62,9 +63,24 @@ class Statement : public EmptyStatement {
 
     ~Statement() {}
 
+    // reads the next row of the current result set from the server
+    // returns nullptr if there are no more rows or on error
+    DLLLOCAL QoreHashNode* read_row(connection* conn, ExceptionSink* xsink);
+
+    // returns the remaining buffered rows as a hash of lists
+    DLLLOCAL QoreHashNode* buffered_columns(int rows, ExceptionSink* xsink);
+
     SafePtr<command> context;
     Placeholders placeholders;
+    // binder plan reused while the statement is executed with arguments of the same types; it does not hold any
+    // bound values
+    BindPlan plan;
     bool valid;
+    // remaining rows read from the server when another command was executed on the connection
+    std::unique_ptr<RowBuffer> rows;
+    int buffered_row_count = 0;
+    // true if the statement is executed as a cursor
+    bool cursor = false;
 public:
     typedef connection Connection;
 
@@ -91,6 +107,21 @@ public:
         return valid;
     }
 
+    // reads all remaining rows into a client-side buffer and releases the command so that the connection can be
+    // used for other commands; only the current result set is buffered, so statements with output parameters or
+    // further row or parameter results are not buffered
+    // returns 0=OK, -1=error or the statement cannot be buffered
+    DLLLOCAL int buffer(connection* conn, size_t mem_limit, ExceptionSink* xsink);
+
+    DLLLOCAL bool isBuffered() const {
+        return (bool)rows;
+    }
+
+    // statements with an open cursor do not need to be released when other commands are executed
+    DLLLOCAL bool isCursor() const {
+        return cursor;
+    }
+
     QoreHashNode * fetch_row(SQLStatement* stmt, ExceptionSink* xsink) {
         return release_res();
     }
@@ -129,6 +160,9 @@ public:
     QoreHashNode* get_output(SQLStatement* stmt, ExceptionSink* xsink) {
         if (checkValid(xsink))
            return 0;
+        // buffered statements have no output parameters; the remaining rows are returned as with read_cols()
+        if (rows)
+           return buffered_columns(-1, xsink);
         return context->read_cols(&placeholders, false, xsink);
     }
 
@@ -137,6 +171,8 @@ public:
     QoreHashNode* fetch_columns(SQLStatement* stmt, int rows, ExceptionSink* xsink) {
         if (checkValid(xsink))
            return 0;
+        if (this->rows)
+           return buffered_columns(rows, xsink);
         return context->read_cols(0, rows, false, xsink);
     }
 
@@ -33,6 +33,9 @@
 #include "sybase.h"
 #include "connection.h"
 #include "encoding_helpers.h"
+#include "parallel.h"
+#include "server_info.h"
+#include "async_query.h"
 
 #include "minitest.hpp"
 
@@ -55,6 +58,9 @@ DLLEXPORT qore_license_t qore_module_license = QL_MIT;
 DLLEXPORT char qore_module_license_str[] = "MIT";
 static DBIDriver* DBID_SYBASE;
 
+// namespace for the module's functions
+static QoreNamespace SybaseNS(SYBASE_NS_NAME);
+
 // capabilities of this driver
 int DBI_SYBASE_CAPS =
    DBI_CAP_TRANSACTION_MANAGEMENT
@@ -163,9 +169,23 @@ static int sybase_open(Datasource *ds, ExceptionSink *xsink) {
         return -1;
     }
 
+    {
+        ReferenceHolder<QoreHashNode> opts(ds->getConnectOptions(), xsink);
+        if (sc->setConnectOptions(*opts, xsink))
+            return -1;
+    }
+
     // make the actual connection to the database
-    sc->init(ds->getUsername(), ds->getPassword() ? ds->getPassword() : "", ds->getDBName(), ds->getDBEncoding(),
-        ds->getQoreEncoding(), ds->getHostName(), port, xsink);
+    if (sc->asyncConnect()) {
+        sc->initAsync(ds->getUsername(), ds->getPassword() ? ds->getPassword() : "", ds->getDBName(),
+            ds->getDBEncoding(), ds->getQoreEncoding(), ds->getHostName(), port, xsink);
+    } else if (sc->hasFailover()) {
+        sc->connectFailover(ds->getUsername(), ds->getPassword() ? ds->getPassword() : "", ds->getDBName(),
+            ds->getDBEncoding(), ds->getQoreEncoding(), ds->getHostName(), port, xsink);
+    } else {
+        sc->init(ds->getUsername(), ds->getPassword() ? ds->getPassword() : "", ds->getDBName(), ds->getDBEncoding(),
+            ds->getQoreEncoding(), ds->getHostName(), port, xsink);
+    }
     // return with an error if it didn't work
     if (*xsink)
         return -1;
@@ -191,6 +211,10 @@ static QoreValue sybase_select(Datasource *ds, const QoreString *qstr, const Qor
         ExceptionSink *xsink) {
     BEGIN_CALLBACK;
     connection* conn = (connection*)ds->getPrivateData();
+    bool routed;
+    ValueHolder rv(conn->routeSelect(connection::SELECT, qstr, args, routed, xsink), xsink);
+    if (routed)
+        return rv.release();
     return conn->select(qstr, args, xsink);
     END_CALLBACK(0);
 }
@@ -199,7 +223,10 @@ static QoreHashNode* sybase_select_row(Datasource *ds, const QoreString *qstr, c
         ExceptionSink *xsink) {
     BEGIN_CALLBACK;
     connection *conn = (connection*)ds->getPrivateData();
-    ValueHolder holder(conn->exec_row(qstr, args, xsink), xsink);
+    bool routed;
+    ValueHolder holder(conn->routeSelect(connection::SELECT_ROW, qstr, args, routed, xsink), xsink);
+    if (!routed)
+        holder = conn->exec_row(qstr, args, xsink);
     qore_type_t nt = holder->getType();
     if (nt != NT_HASH && nt != NT_NOTHING) {
         if (!*xsink)
@@ -215,7 +242,10 @@ static QoreValue sybase_select_rows(Datasource *ds, const QoreString *qstr, cons
         ExceptionSink *xsink) {
     BEGIN_CALLBACK;
     connection *conn = (connection*)ds->getPrivateData();
-    QoreValue rv = conn->exec_rows(qstr, args, xsink);
+    bool routed;
+    QoreValue rv = conn->routeSelect(connection::SELECT_ROWS, qstr, args, routed, xsink);
+    if (!routed)
+        rv = conn->exec_rows(qstr, args, xsink);
     if (rv.getType() == NT_HASH) {
         QoreListNode* l = new QoreListNode(autoTypeInfo);
         l->push(rv, xsink);
@@ -263,9 +293,17 @@ static int sybase_rollback(Datasource *ds, ExceptionSink *xsink) {
     END_CALLBACK(0);
 }
 
+static int sybase_begin_transaction(Datasource *ds, ExceptionSink *xsink) {
+    BEGIN_CALLBACK;
+    connection* conn = (connection*)ds->getPrivateData();
+    return conn->begin_transaction(xsink);
+    END_CALLBACK(0);
+}
+
 static QoreValue sybase_get_client_version(const Datasource *ds, ExceptionSink *xsink) {
     BEGIN_CALLBACK;
-    context m_context(xsink);
+    // uses the shared context if any connections are open
+    context_holder m_context(xsink);
     if (!m_context)
         return QoreValue();
 
@@ -296,6 +334,98 @@ static QoreValue sybase_opt_get(const Datasource* ds, const char* opt) {
     }
 }
 
+static QoreValue f_parallel_select(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    BEGIN_CALLBACK;
+    return ss::parallel_select(args->retrieveEntry(0).get<const QoreStringNode>(),
+        args->retrieveEntry(1).get<const QoreStringNode>(), args->retrieveEntry(2).get<const QoreStringNode>(),
+        args->retrieveEntry(3).get<const QoreHashNode>(), args->retrieveEntry(4).get<const ResolvedCallReferenceNode>(),
+        xsink);
+    END_CALLBACK(0);
+}
+
+static QoreValue f_scatter_gather(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    BEGIN_CALLBACK;
+    return ss::scatter_gather(args->retrieveEntry(0).get<const QoreListNode>(),
+        args->retrieveEntry(1).get<const QoreStringNode>(), args->retrieveEntry(2).get<const QoreListNode>(),
+        args->retrieveEntry(3).get<const QoreHashNode>(), args->retrieveEntry(4).get<const ResolvedCallReferenceNode>(),
+        xsink);
+    END_CALLBACK(0);
+}
+
+static QoreValue f_clear_server_info_cache(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    const QoreStringNode* host = args->retrieveEntry(0).get<const QoreStringNode>();
+    return ss::server_info_cache.invalidate(host ? host->c_str() : nullptr);
+}
+
+static QoreValue f_set_server_info_cache_ttl(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    ss::server_info_cache.setTtl(args->retrieveEntry(0).getAsBigInt());
+    return QoreValue();
+}
+
+static QoreValue f_cancel_connection(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    return ss::connection_registry.cancel(args->retrieveEntry(0).getAsBigInt());
+}
+
+static QoreValue f_get_connection_messages(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    return ss::connection_registry.getMessages(args->retrieveEntry(0).getAsBigInt());
+}
+
+static QoreValue f_get_transaction_stats(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    return ss::transaction_stats.getHash();
+}
+
+static QoreValue f_async_query(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    return ss::async_queries.start(args->retrieveEntry(0).get<const QoreStringNode>(),
+        args->retrieveEntry(1).get<const QoreStringNode>(), args->retrieveEntry(2).get<const QoreListNode>(),
+        args->retrieveEntry(3).get<const QoreHashNode>(), xsink);
+}
+
+static QoreValue f_async_poll(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    return ss::async_queries.poll(args->retrieveEntry(0).getAsBigInt(), xsink);
+}
+
+static QoreValue f_async_wait(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    return ss::async_queries.wait(args->retrieveEntry(0).getAsBigInt(), args->retrieveEntry(1).getAsBigInt(), xsink);
+}
+
+static QoreValue f_async_wait_any(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    int64 id = ss::async_queries.waitAny(args->retrieveEntry(0).get<const QoreListNode>(),
+        args->retrieveEntry(1).getAsBigInt(), xsink);
+    return id ? QoreValue(id) : QoreValue();
+}
+
+static QoreValue f_async_cancel(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    return ss::async_queries.cancel(args->retrieveEntry(0).getAsBigInt());
+}
+
+static QoreValue f_get_validation_stats(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    return ss::validation_stats.getHash();
+}
+
+static QoreValue f_get_deadlock_stats(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    return ss::deadlock_stats.getHash();
+}
+
+static QoreValue f_build_batch(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    return sybase_query::buildBatch(args->retrieveEntry(0).get<const QoreListNode>(), xsink);
+}
+
+static QoreValue f_get_replica_stats(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    return ss::replica_registry.getList(xsink);
+}
+
+static QoreValue f_get_failover_stats(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    return ss::host_breakers.getList(xsink);
+}
+
+static QoreValue f_get_cancel_stats(const QoreListNode* args, q_rt_flags_t flags, ExceptionSink* xsink) {
+    return ss::cancel_stats.getHash();
+}
+
+DBIDriver* sybase_get_driver() {
+    return DBID_SYBASE;
+}
+
 namespace ss {
     void init(qore_dbi_method_list &methods);
 }
@@ -323,6 +453,7 @@ QoreStringNode* sybase_module_init() {
     methods.add(QDBI_METHOD_EXECRAW, sybase_execRaw);
     methods.add(QDBI_METHOD_COMMIT, sybase_commit);
     methods.add(QDBI_METHOD_ROLLBACK, sybase_rollback);
+    methods.add(QDBI_METHOD_BEGIN_TRANSACTION, sybase_begin_transaction);
     methods.add(QDBI_METHOD_GET_CLIENT_VERSION, sybase_get_client_version);
     methods.add(QDBI_METHOD_GET_SERVER_VERSION, sybase_get_server_version);
 
@@ -346,6 +477,74 @@ QoreStringNode* sybase_module_init() {
         "resolution including microseconds, however this will cause any operations with date/time values with "
         "microseconds bound for DATETIME columns to fail, if this is not set, then date/time values are bound with "
         "an approach that works for all columns but gives a maximum of 1/300 second resolution");
+    methods.registerOption(SYBASE_OPT_RPC_EXEC, "when set, simple stored procedure calls like "
+        "\"exec proc %v, @name = :out output\" are executed as native RPC commands, which allows output parameters "
+        "and the return status to be retrieved with all servers; the argument is ignored");
+    methods.registerOption(SYBASE_OPT_ASYNC_CONNECT, "when set in the datasource options, the connection is "
+        "established in a background thread and the open call returns immediately; the first operation on the "
+        "connection waits for the connection to be established; the argument is ignored");
+    methods.registerOption(SYBASE_OPT_PACKET_SIZE, "when set in the datasource options, the TDS packet size to "
+        "request when connecting (between 512 and 65535); larger packets reduce the number of network round trips "
+        "for large result sets and LOB values; the server may negotiate a smaller size, and the size actually in use "
+        "is returned when reading the option", softBigIntTypeInfo);
+    methods.registerOption(SYBASE_OPT_CONNECT_TIMEOUT, "the login timeout in seconds (default: 60); must be set in "
+        "the datasource options to affect the initial connection", softBigIntTypeInfo);
+    methods.registerOption(SYBASE_OPT_COMMAND_TIMEOUT, "the command timeout in milliseconds; commands that run "
+        "longer are canceled and the connection is reset; 0 (the default) means no timeout", softBigIntTypeInfo);
+    methods.registerOption(SYBASE_OPT_LOCK_TIMEOUT, "the time in milliseconds that the server waits for a lock "
+        "before returning an error; -1 (the default) means to use the server's setting; Sybase servers use a "
+        "resolution of seconds", softBigIntTypeInfo);
+    methods.registerOption(SYBASE_OPT_COMMIT_IN_BATCH, "when set, in autocommit mode a commit is appended to each "
+        "single select, insert, update, or delete statement so that no separate commit is sent to the server "
+        "afterwards; the argument is ignored");
+    methods.registerOption(SYBASE_OPT_NATIVE_AUTOCOMMIT, "when set in the datasource options, chained transaction "
+        "mode is not enabled, so the server commits each statement itself and no commit is sent after each "
+        "command in autocommit mode; transactions started by Qore are started explicitly with \"begin tran\"; "
+        "the argument is ignored");
+    methods.registerOption(SYBASE_OPT_CURSOR_STATEMENTS, "when set, select statements executed with SQLStatement "
+        "objects are declared as Client-Library cursors, so rows are fetched from the server in batches and other "
+        "commands can be executed on the connection while the cursor is open; the argument is ignored");
+    methods.registerOption(SYBASE_OPT_CURSOR_ROWS, "the number of rows fetched from the server in each batch for "
+        "cursor statements (default: 100)", softBigIntTypeInfo);
+    methods.registerOption(SYBASE_OPT_CURSOR_UPDATABLE, "when set, cursors are declared \"for update\" instead "
+        "of read-only; the argument is ignored");
+    methods.registerOption(SYBASE_OPT_READ_REPLICAS, "a comma-separated list of read replicas as \"host:port\"; "
+        "selects executed outside of a transaction are executed on the replica with the fewest outstanding requests "
+        "with the same credentials and options as the primary connection", stringTypeInfo);
+    methods.registerOption(SYBASE_OPT_FAILOVER_HOSTS, "when set in the datasource options, a list of further "
+        "servers as \"host:port\" separated by commas or spaces that are tried when connecting and reconnecting "
+        "if the datasource's server cannot be reached", stringTypeInfo);
+    methods.registerOption(SYBASE_OPT_FAILOVER_ORDER, "the order in which failover hosts are tried: \"ordered\" "
+        "(the default: the datasource's server first, then the failover hosts in the order given) or \"random\"",
+        stringTypeInfo);
+    methods.registerOption(SYBASE_OPT_FAILOVER_ATTEMPTS, "the number of passes over the failover hosts before "
+        "giving up (default: 3)", softBigIntTypeInfo);
+    methods.registerOption(SYBASE_OPT_FAILOVER_BACKOFF, "the time in milliseconds to wait before the second pass "
+        "over the failover hosts; doubled for each further pass with random jitter (default: 100)",
+        softBigIntTypeInfo);
+    methods.registerOption(SYBASE_OPT_FAILOVER_MAX_BACKOFF, "the maximum time in milliseconds to wait between "
+        "passes over the failover hosts (default: 5000)", softBigIntTypeInfo);
+    methods.registerOption(SYBASE_OPT_FAILOVER_STANDBY, "when set in the datasource options, a standby connection "
+        "to the next failover host is opened in the background so that a failover does not wait for a new login; "
+        "the argument is ignored");
+    methods.registerOption(SYBASE_OPT_VALIDATE_IDLE, "the idle time in milliseconds after which the connection is "
+        "checked with a round trip to the server before the next command is sent; a dead connection is then "
+        "reestablished before the command is executed; 0 (the default) means no validation", softBigIntTypeInfo);
+    methods.registerOption(SYBASE_OPT_KEEPALIVE, "when greater than zero, TCP keepalive is enabled on the "
+        "connection with the given idle time and probe interval in seconds to keep idle connections open through "
+        "firewalls and NAT devices; 0 (the default) means no keepalive", softBigIntTypeInfo);
+    methods.registerOption(SYBASE_OPT_DEADLOCK_RETRIES, "the maximum number of times a command chosen as a "
+        "deadlock victim (error 1205) is executed again when it was executed in autocommit mode or as the first "
+        "command of a transaction; 0 (the default) means no retries", softBigIntTypeInfo);
+    methods.registerOption(SYBASE_OPT_DEADLOCK_BACKOFF, "the time in milliseconds to wait before the first retry "
+        "of a deadlock victim; doubled for each further retry with random jitter (default: 50)", softBigIntTypeInfo);
+    methods.registerOption(SYBASE_OPT_BUFFER_STATEMENTS, "when set, the remaining rows of an open SQLStatement are "
+        "read into a client-side buffer when another command is executed on the connection instead of invalidating "
+        "the statement, so the statement can still be iterated; the argument is ignored");
+    methods.registerOption(SYBASE_OPT_STATEMENT_BUFFER_MEMORY, "the number of bytes of buffered statement rows kept "
+        "in memory before further rows are written to a temporary file (default: 1048576)", softBigIntTypeInfo);
+    methods.registerOption(SYBASE_OPT_CONNECTION_ID, "read-only: the unique id of the connection in the current "
+        "process for use with " SYBASE_NS_NAME "::cancel_connection()", bigIntTypeInfo);
 
     ss::init(methods);
 
@@ -355,12 +554,75 @@ QoreStringNode* sybase_module_init() {
     DBID_SYBASE = DBI.registerDriver("freetds", methods, DBI_SYBASE_CAPS);
 #endif
 
+    SybaseNS.addBuiltinVariant("parallel_select", f_parallel_select, QCF_NO_FLAGS, QDOM_DATABASE, autoTypeInfo, 5,
+        stringTypeInfo, QORE_PARAM_NO_ARG, "ds",
+        stringTypeInfo, QORE_PARAM_NO_ARG, "table",
+        stringTypeInfo, QORE_PARAM_NO_ARG, "key",
+        hashOrNothingTypeInfo, QORE_PARAM_NO_ARG, "opts",
+        codeOrNothingTypeInfo, QORE_PARAM_NO_ARG, "callback");
+    SybaseNS.addBuiltinVariant("scatter_gather", f_scatter_gather, QCF_NO_FLAGS, QDOM_DATABASE, hashTypeInfo, 5,
+        listTypeInfo, QORE_PARAM_NO_ARG, "ds",
+        stringTypeInfo, QORE_PARAM_NO_ARG, "sql",
+        listOrNothingTypeInfo, QORE_PARAM_NO_ARG, "args",
+        hashOrNothingTypeInfo, QORE_PARAM_NO_ARG, "opts",
+        codeOrNothingTypeInfo, QORE_PARAM_NO_ARG, "callback");
+    SybaseNS.addBuiltinVariant("clear_server_info_cache", f_clear_server_info_cache, QCF_NO_FLAGS, QDOM_DATABASE,
+        bigIntTypeInfo, 1,
+        stringOrNothingTypeInfo, QORE_PARAM_NO_ARG, "host");
+    SybaseNS.addBuiltinVariant("set_server_info_cache_ttl", f_set_server_info_cache_ttl, QCF_NO_FLAGS, QDOM_DATABASE,
+        nothingTypeInfo, 1,
+        softBigIntTypeInfo, QORE_PARAM_NO_ARG, "secs");
+    SybaseNS.addBuiltinVariant("cancel_connection", f_cancel_connection, QCF_NO_FLAGS, QDOM_DATABASE,
+        boolTypeInfo, 1,
+        softBigIntTypeInfo, QORE_PARAM_NO_ARG, "id");
+    SybaseNS.addBuiltinVariant("get_cancel_stats", f_get_cancel_stats, QCF_NO_FLAGS, QDOM_DATABASE,
+        hashTypeInfo, 0);
+    SybaseNS.addBuiltinVariant("get_connection_messages", f_get_connection_messages, QCF_NO_FLAGS, QDOM_DATABASE,
+        listOrNothingTypeInfo, 1,
+        softBigIntTypeInfo, QORE_PARAM_NO_ARG, "id");
+    SybaseNS.addBuiltinVariant("get_transaction_stats", f_get_transaction_stats, QCF_NO_FLAGS, QDOM_DATABASE,
+        hashTypeInfo, 0);
+    SybaseNS.addBuiltinVariant("get_replica_stats", f_get_replica_stats, QCF_NO_FLAGS, QDOM_DATABASE,
+        listTypeInfo, 0);
+    SybaseNS.addBuiltinVariant("get_failover_stats", f_get_failover_stats, QCF_NO_FLAGS, QDOM_DATABASE,
+        listTypeInfo, 0);
+    SybaseNS.addBuiltinVariant("get_validation_stats", f_get_validation_stats, QCF_NO_FLAGS, QDOM_DATABASE,
+        hashTypeInfo, 0);
+    SybaseNS.addBuiltinVariant("get_deadlock_stats", f_get_deadlock_stats, QCF_NO_FLAGS, QDOM_DATABASE,
+        hashTypeInfo, 0);
+    SybaseNS.addBuiltinVariant("build_batch", f_build_batch, QCF_NO_FLAGS, QDOM_DATABASE,
+        hashTypeInfo, 1,
+        listTypeInfo, QORE_PARAM_NO_ARG, "stmts");
+    SybaseNS.addBuiltinVariant("async_query", f_async_query, QCF_NO_FLAGS, QDOM_DATABASE,
+        bigIntTypeInfo, 4,
+        stringTypeInfo, QORE_PARAM_NO_ARG, "ds",
+        stringTypeInfo, QORE_PARAM_NO_ARG, "sql",
+        listOrNothingTypeInfo, QORE_PARAM_NO_ARG, "args",
+        hashOrNothingTypeInfo, QORE_PARAM_NO_ARG, "opts");
+    SybaseNS.addBuiltinVariant("async_poll", f_async_poll, QCF_NO_FLAGS, QDOM_DATABASE,
+        boolTypeInfo, 1,
+        softBigIntTypeInfo, QORE_PARAM_NO_ARG, "id");
+    SybaseNS.addBuiltinVariant("async_wait", f_async_wait, QCF_NO_FLAGS, QDOM_DATABASE,
+        autoTypeInfo, 2,
+        softBigIntTypeInfo, QORE_PARAM_NO_ARG, "id",
+        bigIntOrNothingTypeInfo, QORE_PARAM_NO_ARG, "timeout_ms");
+    SybaseNS.addBuiltinVariant("async_wait_any", f_async_wait_any, QCF_NO_FLAGS, QDOM_DATABASE,
+        bigIntOrNothingTypeInfo, 2,
+        listTypeInfo, QORE_PARAM_NO_ARG, "ids",
+        bigIntOrNothingTypeInfo, QORE_PARAM_NO_ARG, "timeout_ms");
+    SybaseNS.addBuiltinVariant("async_cancel", f_async_cancel, QCF_NO_FLAGS, QDOM_DATABASE,
+        boolTypeInfo, 1,
+        softBigIntTypeInfo, QORE_PARAM_NO_ARG, "id");
+
     return 0;
 }
 
 void sybase_module_ns_init(QoreNamespace *rns, QoreNamespace* qns) {
+    qns->addNamespace(SybaseNS.copy());
 }
 
 void sybase_module_delete() {
     QORE_TRACE("sybase_module_delete()");
+    ss::async_queries.shutdown();
+    ss::replica_registry.shutdown();
 }
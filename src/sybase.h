@@ -31,5 +31,15 @@ extern QoreStringNode *sybase_module_init();
 extern void sybase_module_ns_init(QoreNamespace *rns, QoreNamespace *qns);
 extern void sybase_module_delete();
 
+// returns the DBI driver registered by this module
+extern DBIDriver* sybase_get_driver();
+
+// the namespace for the module's functions
+#ifdef SYBASE
+#define SYBASE_NS_NAME "Sybase"
+#else
+#define SYBASE_NS_NAME "FreeTDS"
+#endif
+
 #endif
 
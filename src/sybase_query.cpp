@@ -25,9 +25,13 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <string.h>
+
+#include <set>
 
 #include "sybase.h"
 #include "sybase_query.h"
+#include "resultfactory.h"
 
 #include "minitest.hpp"
 
@@ -140,3 +144,426 @@ next:
    return 0;
 }
 
+// keywords that start a statement
+static const char* stmt_keywords[] = {
+    "alter", "begin", "commit", "create", "declare", "delete", "drop", "dump", "exec", "execute", "grant", "if",
+    "insert", "load", "print", "raiserror", "return", "revoke", "rollback", "select", "set", "truncate", "update",
+    "use", "waitfor", "while",
+};
+
+static bool is_stmt_keyword(const std::string& w) {
+    for (const char* kw : stmt_keywords) {
+        if (w == kw)
+            return true;
+    }
+    return false;
+}
+
+// returns true if the keyword can appear at the top level of a statement starting with "first"
+static bool continues_statement(const std::string& first, const std::string& prev, const std::string& w) {
+    if (w == "select") {
+        // "insert ... select" and set operations
+        return first == "insert" || prev == "union" || prev == "all" || prev == "except" || prev == "intersect";
+    }
+    if (w == "update")
+        // "select ... for update"
+        return prev == "for";
+    if (w == "set")
+        return first == "update";
+    if (w == "exec" || w == "execute")
+        return first == "insert";
+    return false;
+}
+
+bool sybase_query::isSingleStatement(const char* p, std::string& keyword, bool* into) {
+    keyword.clear();
+    if (into)
+        *into = false;
+    std::string prev;
+    int depth = 0;
+    bool after_dot = false;
+    while (*p) {
+        char ch = *p;
+        if (isspace(ch)) {
+            ++p;
+            continue;
+        }
+        // comments
+        if (ch == '-' && p[1] == '-') {
+            while (*p && *p != '\n')
+                ++p;
+            continue;
+        }
+        if (ch == '/' && p[1] == '*') {
+            const char* e = strstr(p + 2, "*/");
+            p = e ? e + 2 : p + strlen(p);
+            continue;
+        }
+        // quoted strings and identifiers
+        if (ch == '\'' || ch == '"' || ch == '[') {
+            char end = ch == '[' ? ']' : ch;
+            ++p;
+            while (*p) {
+                if (*p == end) {
+                    // doubled quotes are escaped quotes
+                    if (p[1] == end && end != ']') {
+                        p += 2;
+                        continue;
+                    }
+                    ++p;
+                    break;
+                }
+                ++p;
+            }
+            after_dot = false;
+            prev.clear();
+            continue;
+        }
+        if (isalpha(ch) || ch == '_' || ch == '@' || ch == '#') {
+            const char* start = p;
+            while (isalnum(*p) || *p == '_' || *p == '@' || *p == '#' || *p == '$')
+                ++p;
+            std::string w(start, p - start);
+            for (auto& c : w)
+                c = tolower(c);
+            if (keyword.empty()) {
+                keyword = w;
+            } else if (into && !after_dot && w == "into") {
+                *into = true;
+            } else if (!depth && !after_dot && *p != '.' && w[0] != '@' && w[0] != '#' && is_stmt_keyword(w)
+                && !continues_statement(keyword, prev, w)) {
+                return false;
+            }
+            prev = w;
+            after_dot = false;
+            continue;
+        }
+        if (ch == '(')
+            ++depth;
+        else if (ch == ')' && depth)
+            --depth;
+        else if (ch == ';' && !depth) {
+            // anything but whitespace and comments after the terminator is another statement
+            std::string ignored;
+            ++p;
+            while (isspace(*p))
+                ++p;
+            return !*p || (isSingleStatement(p, ignored, nullptr) && ignored.empty());
+        }
+        after_dot = ch == '.';
+        ++p;
+    }
+    return true;
+}
+
+bool sybase_query::isSingleSelect(const char* sql) {
+    std::string kw;
+    bool into;
+    return isSingleStatement(sql, kw, &into) && kw == "select" && !into;
+}
+
+bool sybase_query::isSingleDml() const {
+    if (rpc)
+        return false;
+    std::string kw;
+    if (!isSingleStatement(m_cmd.c_str(), kw))
+        return false;
+    return kw == "select" || kw == "insert" || kw == "update" || kw == "delete";
+}
+
+unsigned sybase_query::countParams(const char* s) {
+    unsigned rv = 0;
+    while (*s) {
+        char ch = *s++;
+        // skip quoted strings
+        if (ch == '"' || ch == '\'') {
+            char quote = ch;
+            while (*s) {
+                ch = *s++;
+                if (ch == '\\') {
+                    if (*s)
+                        ++s;
+                    continue;
+                }
+                if (ch == quote)
+                    break;
+            }
+            continue;
+        }
+        if (ch == '%' && (*s == 'v' || *s == 'd' || *s == 's')) {
+            ++rv;
+            ++s;
+        }
+    }
+    return rv;
+}
+
+// copies a quoted string at p to the output and returns the position after it
+static const char* batch_copy_quoted(const char* p, QoreString& out) {
+    char quote = *p;
+    out.concat(*p++);
+    while (*p) {
+        char ch = *p++;
+        out.concat(ch);
+        if (ch == '\\') {
+            if (*p)
+                out.concat(*p++);
+            continue;
+        }
+        if (ch == quote)
+            break;
+    }
+    return p;
+}
+
+// copies the SQL of statement "i" of a batch to the output, appending the batch placeholder suffix and the
+// statement index to the names of all :name placeholders and of the variables with the same names, so that the
+// variables of different statements do not clash
+static void batch_rename_placeholders(const char* sql, unsigned i, QoreString& out) {
+    // collect the placeholder names of the statement
+    std::set<std::string> names;
+    for (const char* p = sql; *p;) {
+        if (*p == '"' || *p == '\'') {
+            QoreString tmp;
+            p = batch_copy_quoted(p, tmp);
+            continue;
+        }
+        if (*p++ != ':')
+            continue;
+        const char* start = p;
+        while (isalnum(*p) || *p == '_')
+            ++p;
+        if (p != start)
+            names.insert(std::string(start, p - start));
+    }
+
+    if (names.empty()) {
+        out.concat(sql);
+        return;
+    }
+
+    QoreStringMaker suffix(SYBASE_BATCH_PH_SUFFIX "%u", i);
+    for (const char* p = sql; *p;) {
+        if (*p == '"' || *p == '\'') {
+            p = batch_copy_quoted(p, out);
+            continue;
+        }
+        char ch = *p++;
+        out.concat(ch);
+        // skip global variables like @@rowcount
+        if (ch == '@' && *p == '@') {
+            out.concat(*p++);
+            continue;
+        }
+        if (ch != ':' && ch != '@')
+            continue;
+        const char* start = p;
+        while (isalnum(*p) || *p == '_')
+            ++p;
+        if (p == start)
+            continue;
+        out.concat(start, p - start);
+        if (names.find(std::string(start, p - start)) != names.end())
+            out.concat(&suffix);
+    }
+}
+
+QoreHashNode* sybase_query::buildBatch(const QoreListNode* stmts, ExceptionSink* xsink) {
+    if (!stmts->size()) {
+        xsink->raiseException("TDS-BATCH-ERROR", "no statements given for the batch");
+        return nullptr;
+    }
+
+    // the batch has the encoding of the first statement
+    SimpleRefHolder<QoreStringNode> sql;
+    ReferenceHolder<QoreListNode> args(new QoreListNode(autoTypeInfo), xsink);
+
+    ConstListIterator li(stmts);
+    while (li.next()) {
+        unsigned i = li.index();
+        QoreValue v = li.getValue();
+        const QoreStringNode* str = nullptr;
+        const QoreListNode* sargs = nullptr;
+        if (v.getType() == NT_STRING) {
+            str = v.get<const QoreStringNode>();
+        } else if (v.getType() == NT_LIST) {
+            const QoreListNode* l = v.get<const QoreListNode>();
+            QoreValue s0 = l->retrieveEntry(0);
+            QoreValue s1 = l->retrieveEntry(1);
+            if (s0.getType() == NT_STRING && l->size() <= 2
+                && (s1.getType() == NT_LIST || s1.getType() == NT_NOTHING)) {
+                str = s0.get<const QoreStringNode>();
+                sargs = s1.getType() == NT_LIST ? s1.get<const QoreListNode>() : nullptr;
+            }
+        }
+        if (!str) {
+            xsink->raiseException("TDS-BATCH-ERROR", "statement %u: expecting a string or a list of the SQL string "
+                "and an optional list of arguments; got type '%s'", i, v.getTypeName());
+            return nullptr;
+        }
+
+        // the arguments of all statements are bound in order, so each statement must use exactly its own
+        unsigned n = countParams(str->c_str());
+        unsigned argc = sargs ? sargs->size() : 0;
+        if (n != argc) {
+            xsink->raiseException("TDS-BATCH-ERROR", "statement %u has %u placeholder(s) but %u argument(s) were "
+                "given", i, n, argc);
+            return nullptr;
+        }
+
+        QoreString stmt(str->getEncoding());
+        batch_rename_placeholders(str->c_str(), i, stmt);
+        if (!i) {
+            size_t len = stmt.strlen();
+            sql = new QoreStringNode(stmt.giveBuffer(), len, len + 1, str->getEncoding());
+        } else {
+            sql->concat('\n');
+            if (sql->concat(&stmt, xsink))
+                return nullptr;
+        }
+        // %v placeholders are numbered over the whole batch when the command is bound, so each statement's
+        // parameters get unique names
+        sql->sprintf("\nselect @@rowcount as " SYBASE_BATCH_MARKER "%u", i);
+
+        if (sargs) {
+            ConstListIterator ai(sargs);
+            while (ai.next())
+                args->push(ai.getReferencedValue(), xsink);
+        }
+    }
+
+    ReferenceHolder<QoreHashNode> rv(new QoreHashNode(autoTypeInfo), xsink);
+    rv->setKeyValue("sql", sql.release(), xsink);
+    rv->setKeyValue("args", args.release(), xsink);
+    return rv.release();
+}
+
+static inline const char* rpc_skip_ws(const char* p) {
+    while (isspace(*p))
+        ++p;
+    return p;
+}
+
+static inline bool rpc_is_ident_char(char c) {
+    return isalnum(c) || c == '_';
+}
+
+// matches a keyword case-insensitively and advances the pointer if found
+static bool rpc_match_keyword(const char*& p, const char* kw) {
+    size_t len = strlen(kw);
+    if (strncasecmp(p, kw, len) || rpc_is_ident_char(p[len]))
+        return false;
+    p += len;
+    return true;
+}
+
+static bool rpc_read_ident(const char*& p, std::string& id) {
+    const char* start = p;
+    while (rpc_is_ident_char(*p))
+        ++p;
+    if (p == start)
+        return false;
+    id.assign(start, p - start);
+    return true;
+}
+
+bool sybase_query::isSelect() const {
+    if (rpc)
+        return false;
+    // batches with more than one statement and "select ... into" cannot be declared as cursors
+    return isSingleSelect(m_cmd.c_str());
+}
+
+bool sybase_query::init_rpc(const QoreString *cmd_text) {
+    const char* p = rpc_skip_ws(cmd_text->c_str());
+    if (!rpc_match_keyword(p, "execute") && !rpc_match_keyword(p, "exec"))
+        return false;
+
+    p = rpc_skip_ws(p);
+    // the procedure name may be qualified with the database and owner
+    const char* start = p;
+    while (rpc_is_ident_char(*p) || *p == '.' || *p == '#' || *p == '$')
+        ++p;
+    if (p == start)
+        return false;
+    std::string proc(start, p - start);
+
+    rpc_param_list_t params;
+    Placeholders ph;
+    int argc = 0;
+    bool named = false;
+
+    p = rpc_skip_ws(p);
+    while (*p && *p != ';') {
+        rpc_param param;
+        param.output = false;
+
+        // named parameter: @name = value
+        if (*p == '@') {
+            ++p;
+            std::string name;
+            if (!rpc_read_ident(p, name))
+                return false;
+            param.name = "@" + name;
+            p = rpc_skip_ws(p);
+            if (*p != '=')
+                return false;
+            p = rpc_skip_ws(p + 1);
+            named = true;
+        } else if (named) {
+            // positional parameters cannot follow named parameters
+            return false;
+        }
+
+        std::string placeholder;
+        if (p[0] == '%' && p[1] == 'v') {
+            param.arg = argc++;
+            p += 2;
+        } else if (*p == ':') {
+            ++p;
+            if (!rpc_read_ident(p, placeholder))
+                return false;
+            param.arg = -1;
+        } else {
+            // literals and other expressions can only be sent in a language command
+            return false;
+        }
+
+        p = rpc_skip_ws(p);
+        if (rpc_match_keyword(p, "output") || rpc_match_keyword(p, "out")) {
+            param.output = true;
+            p = rpc_skip_ws(p);
+        }
+        // placeholders only make sense for output parameters
+        if (param.arg < 0 && !param.output)
+            return false;
+
+        if (param.output) {
+            if (!placeholder.empty())
+                ph.push_back(placeholder);
+            else
+                ph.push_back(param.name.empty() ? std::string() : param.name.substr(1));
+        }
+        params.push_back(param);
+
+        if (*p == ',') {
+            p = rpc_skip_ws(p + 1);
+            continue;
+        }
+        if (*p && *p != ';')
+            return false;
+    }
+    if (*p == ';' && *rpc_skip_ws(p + 1))
+        return false;
+
+    m_cmd = *cmd_text;
+    rpc = true;
+    rpc_proc = proc;
+    rpc_params.swap(params);
+    placeholders.swap(ph);
+    param_list.assign(argc, 'v');
+    printd(5, "sybase_query::init_rpc() proc: %s params: %d args: %d\n", rpc_proc.c_str(), (int)rpc_params.size(),
+        argc);
+    return true;
+}
+
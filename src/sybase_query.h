@@ -34,6 +34,22 @@ typedef std::vector<char> param_list_t;
 typedef std::vector<CS_SMALLINT> ind_list_t;
 typedef std::vector<std::string> Placeholders;
 
+// a parameter of a stored procedure executed as an RPC command
+struct rpc_param {
+    // the parameter name including the leading '@' or empty for positional parameters
+    std::string name;
+    // the index of the bind argument, -1 for output placeholders without a value
+    int arg;
+    bool output;
+    // the type of an output placeholder without a value from the procedure's parameter metadata; empty if unknown
+    std::string type;
+    // the size or precision and the scale of the type; -1 if not applicable
+    int type_arg1 = -1;
+    int type_arg2 = -1;
+};
+
+typedef std::vector<rpc_param> rpc_param_list_t;
+
 struct sybase_query {
 public:
     DLLLOCAL sybase_query() {}
@@ -44,6 +60,12 @@ public:
     param_list_t param_list;
     Placeholders placeholders;
 
+    // true if the command is executed as an RPC command
+    bool rpc = false;
+    // the name of the stored procedure for RPC commands
+    std::string rpc_proc;
+    rpc_param_list_t rpc_params;
+
     // returns 0=OK, -1=err (exception raised)
     DLLLOCAL int init(const QoreString *n_cmd, const QoreListNode *args, ExceptionSink *xsink);
 
@@ -51,6 +73,43 @@ public:
         m_cmd = *n_cmd;
     }
 
+    // clears the object for reuse; allocated memory is retained
+    DLLLOCAL void reset() {
+        m_cmd.clear();
+        param_list.clear();
+        placeholders.clear();
+        rpc = false;
+        rpc_proc.clear();
+        rpc_params.clear();
+    }
+
+    // tries to parse the command as a simple stored procedure call like "exec proc %v, @p = :out output"
+    // returns true if the command can be executed as an RPC command; in this case the object is initialized
+    DLLLOCAL bool init_rpc(const QoreString *n_cmd);
+
+    // returns true if the command is a single select statement that can be executed as a cursor
+    DLLLOCAL bool isSelect() const;
+
+    // scans the SQL for the first statement and returns true if no other statement follows it; "keyword" is set
+    // to the lower-case first keyword of the statement; if "into" is given, it is set to true if the statement
+    // contains the "into" keyword outside of strings and comments
+    DLLLOCAL static bool isSingleStatement(const char* sql, std::string& keyword, bool* into = nullptr);
+
+    // returns true if the SQL is a single select statement that does not create a table with "select ... into"
+    DLLLOCAL static bool isSingleSelect(const char* sql);
+
+    // returns true if the command is a single select, insert, update, or delete statement
+    DLLLOCAL bool isSingleDml() const;
+
+    // returns the number of %v, %d, and %s placeholders in the SQL that take an argument
+    DLLLOCAL static unsigned countParams(const char* sql);
+
+    // concatenates a list of statements with their arguments into a single language batch that returns one result
+    // per statement when executed; each statement is followed by a select of the statement's row count with a
+    // column name starting with SYBASE_BATCH_MARKER
+    // returns a hash with "sql" and "args" keys or nullptr on error (exception raised)
+    DLLLOCAL static QoreHashNode* buildBatch(const QoreListNode* stmts, ExceptionSink* xsink);
+
     DLLLOCAL const char * buff() const {
         return m_cmd.getBuffer();
     }
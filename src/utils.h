@@ -123,6 +123,15 @@ public:
         return h.release();
     }
 
+    QoreListNode *release_to_list() {
+        ReferenceHolder<QoreListNode> l(new QoreListNode(autoTypeInfo), xsink);
+        for (iterator it = begin(); it != end(); ++it) {
+            l->push(*it, xsink);
+        }
+        v.clear();
+        return l.release();
+    }
+
     template<typename Fn>
     QoreValue release_smart(Fn keygen) {
         if (empty()) return QoreValue();